@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <iostream>
+#include <sched.h>
+#include <unistd.h>
+#include "bench_threads.h"
+
+void pin_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % sysconf(_SC_NPROCESSORS_ONLN), &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        std::cout << "failed to pin thread to cpu " << cpu << std::endl;
+    }
+}
+
+BenchmarkThreads::BenchmarkThreads(int num, bool pin) : seconds(num), starts(num), ends(num) {
+    // the workers and the calling thread
+    pthread_barrier_init(&start_barrier, NULL, num + 1);
+    pthread_barrier_init(&done_barrier, NULL, num + 1);
+    for (int i = 0; i < num; ++i) {
+        workers.emplace_back(&BenchmarkThreads::loop, this, i, pin);
+    }
+}
+
+BenchmarkThreads::~BenchmarkThreads() {
+    quit = true;
+    pthread_barrier_wait(&start_barrier);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    pthread_barrier_destroy(&start_barrier);
+    pthread_barrier_destroy(&done_barrier);
+}
+
+std::vector<double> BenchmarkThreads::run(int n, const std::function<void(int)> &work) {
+    job = work;
+    active = n;
+    pthread_barrier_wait(&start_barrier);
+    pthread_barrier_wait(&done_barrier);
+    wall_seconds = std::chrono::duration<double>(*std::max_element(ends.begin(), ends.begin() + n) -
+                                                 *std::min_element(starts.begin(), starts.begin() + n)).count();
+    return std::vector<double>(seconds.begin(), seconds.begin() + n);
+}
+
+void BenchmarkThreads::loop(int tid, bool pin) {
+    if (pin) {
+        pin_thread(tid);
+    }
+    while (true) {
+        pthread_barrier_wait(&start_barrier);
+        if (quit) {
+            return;
+        }
+        if (tid < active) {
+            starts[tid] = std::chrono::steady_clock::now();
+            job(tid);
+            ends[tid] = std::chrono::steady_clock::now();
+            seconds[tid] = std::chrono::duration<double>(ends[tid] - starts[tid]).count();
+        }
+        pthread_barrier_wait(&done_barrier);
+    }
+}
+
+std::vector<int> thread_sweep(int max) {
+    std::vector<int> res;
+    for (int n = 1; n < max; n *= 2) {
+        res.push_back(n);
+    }
+    res.push_back(max);
+    return res;
+}
@@ -0,0 +1,54 @@
+#ifndef NVMKV_BENCH_THREADS_H
+#define NVMKV_BENCH_THREADS_H
+
+#include <pthread.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/*
+ * Worker threads of the multi-threaded benchmark.
+ *
+ * The workers are created once and reused by every run, so each keeps its allocator arena
+ * for the whole benchmark instead of leaving one behind per phase. A run releases the first
+ * n workers through a barrier, so they start together, and waits on a second barrier until
+ * all of them are done. Each worker times its own share of the run.
+ */
+
+// pin the calling thread to cpu, wrapping around the online cpus
+void pin_thread(int cpu);
+
+class BenchmarkThreads {
+public:
+    // pin: worker i runs on cpu i
+    BenchmarkThreads(int num, bool pin);
+
+    ~BenchmarkThreads();
+
+    // run work(tid) on workers 0 .. n - 1 and return the seconds each of them took
+    std::vector<double> run(int n, const std::function<void(int)> &work);
+
+    // seconds from the first start to the last finish of the previous run
+    double wall() { return wall_seconds; }
+
+    int size() { return workers.size(); }
+
+private:
+    std::vector<std::thread> workers;
+    pthread_barrier_t start_barrier, done_barrier;
+    std::function<void(int)> job;
+    int active = 0;
+    bool quit = false;
+    std::vector<double> seconds;
+    std::vector<std::chrono::steady_clock::time_point> starts, ends;
+    double wall_seconds = 0;
+
+    void loop(int tid, bool pin);
+};
+
+// thread counts of a sweep up to max: 1, 2, 4, ... and max itself
+std::vector<int> thread_sweep(int max);
+
+#endif //NVMKV_BENCH_THREADS_H
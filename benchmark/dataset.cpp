@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dataset.h"
+#include "../rng/rng.h"
+
+const char *dataset_format_name(dataset_format format) {
+    switch (format) {
+        case DATASET_SOSD:
+            return "sosd";
+        case DATASET_BINARY:
+            return "binary";
+        default:
+            return "text";
+    }
+}
+
+const char *key_generator_name(key_generator generator) {
+    switch (generator) {
+        case KEYGEN_RANDOM:
+            return "random";
+        case KEYGEN_SEQUENTIAL:
+            return "sequential";
+        case KEYGEN_CLUSTERED:
+            return "clustered";
+        default:
+            return "normal";
+    }
+}
+
+// rng_next returns 63 bits
+static double next_double(rng *r) {
+    return (rng_next(r) >> 10) * (1.0 / ((uint64_t) 1 << 53));
+}
+
+// standard normal by Box-Muller
+static double next_normal(rng *r) {
+    double u = 1 - next_double(r), v = next_double(r);
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+void shuffle_keys(uint64_t *keys, uint64_t n, uint64_t seed) {
+    rng r;
+    rng_init(&r, seed, seed + 1);
+    for (uint64_t i = 1; i < n; ++i) {
+        std::swap(keys[i], keys[rng_next(&r) % (i + 1)]);
+    }
+}
+
+std::vector<uint64_t> generate_keys(key_generator generator, uint64_t n, uint64_t seed) {
+    rng r;
+    rng_init(&r, seed, seed + 1);
+    std::vector<uint64_t> keys(n);
+    switch (generator) {
+        case KEYGEN_RANDOM:
+            for (auto &key : keys) {
+                key = rng_next(&r);
+            }
+            break;
+        case KEYGEN_SEQUENTIAL:
+            for (uint64_t i = 0; i < n; ++i) {
+                keys[i] = i + 1;
+            }
+            break;
+        case KEYGEN_CLUSTERED: {
+            // the jumps between clusters add up to about 2^62
+            uint64_t jump = ((uint64_t) 1 << 63) / (n / KEYGEN_CLUSTER_KEYS + 1);
+            uint64_t key = 0;
+            for (auto &k : keys) {
+                if (rng_next(&r) % KEYGEN_CLUSTER_KEYS == 0) {
+                    key += rng_next(&r) % jump;
+                }
+                key += 1 + (uint64_t) fabs(next_normal(&r) * KEYGEN_CLUSTER_SIGMA);
+                k = key;
+            }
+            shuffle_keys(keys.data(), n, seed + 2);
+            break;
+        }
+        default:
+            for (auto &key : keys) {
+                double k = 0x1p62 + next_normal(&r) * 0x1p58;
+                key = k < 0 ? 0 : k >= 0x1p63 ? ((uint64_t) 1 << 63) - 1 : (uint64_t) k;
+            }
+    }
+    return keys;
+}
+
+Dataset::~Dataset() {
+    unmap();
+}
+
+void Dataset::unmap() {
+    if (map != NULL) {
+        munmap(map, map_size);
+        map = NULL;
+    }
+}
+
+bool Dataset::open(const std::string &path, dataset_format format) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path.c_str());
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    map_size = st.st_size;
+    map = map_size == 0 ? NULL : mmap(NULL, map_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path.c_str());
+        map = NULL;
+        return false;
+    }
+    const char *bytes = (const char *) map;
+    switch (format) {
+        case DATASET_SOSD:
+            if (map_size < sizeof(uint64_t) || *(const uint64_t *) bytes > (map_size - sizeof(uint64_t)) / 8) {
+                fprintf(stderr, "%s: not a SOSD key file\n", path.c_str());
+                return false;
+            }
+            count = *(const uint64_t *) bytes;
+            data = (const uint64_t *) (bytes + sizeof(uint64_t));
+            break;
+        case DATASET_BINARY:
+            count = map_size / sizeof(uint64_t);
+            data = (const uint64_t *) bytes;
+            break;
+        default: {
+            // keys are digits, anything else separates them
+            bool inKey = false;
+            for (size_t i = 0; i < map_size; ++i) {
+                if (bytes[i] >= '0' && bytes[i] <= '9') {
+                    if (!inKey) {
+                        owned.push_back(0);
+                    }
+                    owned.back() = owned.back() * 10 + bytes[i] - '0';
+                    inKey = true;
+                } else {
+                    inKey = false;
+                }
+            }
+            unmap();
+            data = owned.data();
+            count = owned.size();
+        }
+    }
+    return true;
+}
+
+void Dataset::own() {
+    if (owned.empty()) {
+        owned.assign(data, data + count);
+        data = owned.data();
+        unmap();
+    }
+}
+
+void Dataset::truncate(uint64_t n, bool sample, uint64_t seed) {
+    if (n >= count) {
+        return;
+    }
+    if (!sample) {
+        if (!owned.empty()) {
+            owned.resize(n);
+            data = owned.data();
+        }
+        count = n;
+        return;
+    }
+    // selection sampling (Knuth, algorithm S): keep each key with probability needed / left
+    rng r;
+    rng_init(&r, seed, seed + 1);
+    std::vector<uint64_t> res;
+    res.reserve(n);
+    for (uint64_t i = 0; i < count && res.size() < n; ++i) {
+        if (rng_next(&r) % (count - i) < n - res.size()) {
+            res.push_back(data[i]);
+        }
+    }
+    owned.swap(res);
+    data = owned.data();
+    count = n;
+    unmap();
+}
+
+void Dataset::shuffle(uint64_t seed) {
+    own();
+    shuffle_keys(owned.data(), count, seed);
+}
@@ -0,0 +1,93 @@
+#ifndef NVMKV_DATASET_H
+#define NVMKV_DATASET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Key sets of the benchmark besides the uniform random keys: key files and generated
+ * distributions.
+ *
+ * A key file is mapped read-only and populated up front, so loading it neither copies it into
+ * the process nor takes page faults in a timed phase. The formats are
+ *
+ *   sosd    a uint64 count followed by count uint64 keys, as in the SOSD benchmark
+ *   binary  uint64 keys without a header
+ *   text    one decimal key per line
+ *
+ * The keys of sosd and binary files are used in place. Text files, samples and shuffles need
+ * their own copy of the keys.
+ *
+ * The generators produce
+ *
+ *   random      uniform 63 bit keys
+ *   sequential  1, 2, 3, ... in ascending order
+ *   clustered   runs of about KEYGEN_CLUSTER_KEYS keys with gaps of 1 + |N(0, KEYGEN_CLUSTER_SIGMA)|,
+ *               the runs spread uniformly over the key space; in random order
+ *   normal      N(2^62, 2^58) in random order
+ */
+
+enum dataset_format {
+    DATASET_SOSD,
+    DATASET_BINARY,
+    DATASET_TEXT,
+    DATASET_FORMAT_NUM
+};
+
+enum key_generator {
+    KEYGEN_RANDOM,
+    KEYGEN_SEQUENTIAL,
+    KEYGEN_CLUSTERED,
+    KEYGEN_NORMAL,
+    KEYGEN_NUM
+};
+
+// mean keys of a cluster and standard deviation of the gaps inside it
+#define KEYGEN_CLUSTER_KEYS 1024
+#define KEYGEN_CLUSTER_SIGMA 64
+
+const char *dataset_format_name(dataset_format format);
+
+const char *key_generator_name(key_generator generator);
+
+// n keys of generator
+std::vector<uint64_t> generate_keys(key_generator generator, uint64_t n, uint64_t seed);
+
+// Fisher-Yates
+void shuffle_keys(uint64_t *keys, uint64_t n, uint64_t seed);
+
+class Dataset {
+public:
+    ~Dataset();
+
+    // map the keys of path, false with a message on stderr if it cannot be read
+    bool open(const std::string &path, dataset_format format);
+
+    // keep count keys, the first ones or a uniform sample in file order
+    void truncate(uint64_t count, bool sample, uint64_t seed);
+
+    void shuffle(uint64_t seed);
+
+    const uint64_t *keys() { return data; }
+
+    uint64_t size() { return count; }
+
+    // true while the keys are read from the mapping
+    bool mapped() { return map != NULL; }
+
+private:
+    void *map = NULL;
+    size_t map_size = 0;
+    const uint64_t *data = NULL;
+    uint64_t count = 0;
+    std::vector<uint64_t> owned;
+
+    // take a copy of the mapped keys before they are reordered
+    void own();
+
+    void unmap();
+};
+
+#endif //NVMKV_DATASET_H
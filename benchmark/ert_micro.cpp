@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../extendible_radix_tree/ERT_int.h"
+#include "../fastalloc/fastalloc_emu.h"
+#include "../rng/rng.h"
+#include "harness.h"
+
+/*
+ * Microbenchmarks of the ERT mechanisms on synthetic nodes.
+ *
+ * Each mechanism runs on its own with a controlled fill: bucket lookups on buckets holding
+ * 0 .. ERT_BUCKET_SIZE entries, prefix compares of every header length, one segment split of
+ * a segment shared by two directory entries, one directory doubling of a node of global depth
+ * g (with the split that follows it), one prefix split of a root with a 4 byte prefix, and
+ * scans of a single node holding n keys. Splits are timed one put at a time, with the node built untimed before each.
+ * Rows are ns/op and cache lines flushed per op, on stdout and in ../Result/ert_micro.csv.
+ *
+ * usage: ert_micro [OptanePath]
+ */
+
+using namespace std;
+
+ofstream out;
+rng r;
+
+void report(const string &mechanism, const string &fill, uint64_t ops, double ns, uint64_t flushes) {
+    printf("%-20s %-22s %10.1f ns/op %8.2f flushes/op\n", mechanism.c_str(), fill.c_str(), ns / ops,
+           (double) flushes / ops);
+    out << mechanism << "," << fill << "," << ops << "," << ns / ops << "," << (double) flushes / ops << endl;
+}
+
+double elapsed_ns(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+}
+
+// random 32 bit subkey of bucket, never 0
+uint64_t random_subkey(uint64_t bucket) {
+    return (rng_next(&r) & 0xffffff00) | bucket | 0x100;
+}
+
+// findPlace and get of present and absent subkeys on buckets holding fill entries
+void bucket_test() {
+    const int buckets = 4096, ops = 1 << 22;
+    for (int fill = 0; fill <= ERT_BUCKET_SIZE; ++fill) {
+        vector<ERTIntBucket> bucket(buckets);
+        vector<uint64_t> present(buckets), absent(buckets);
+        for (int b = 0; b < buckets; ++b) {
+            for (int j = 0; j < fill; ++j) {
+                bucket[b].counter[j].subkey = PUT_KEY_VALUE_FLAG(random_subkey(b & 0xff));
+                bucket[b].counter[j].value = j + 1;
+            }
+            present[b] = fill ? REMOVE_NODE_FLAG(bucket[b].counter[rng_next(&r) % fill].subkey) : 0;
+            absent[b] = random_subkey(b & 0xff);
+        }
+        string name = "fill=" + to_string(fill);
+        for (int hit = fill ? 1 : 0; hit >= 0; --hit) {
+            vector<uint64_t> &keys = hit ? present : absent;
+            const char *kind = hit ? " hit" : " miss";
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < ops; ++i) {
+                harness_sink(bucket[i & (buckets - 1)].findPlace(keys[i & (buckets - 1)], ERT_NODE_LENGTH, 0));
+            }
+            report(string("findPlace") + kind, name, ops, elapsed_ns(start), 0);
+            start = chrono::steady_clock::now();
+            for (int i = 0; i < ops; ++i) {
+                bool keyValueFlag;
+                harness_sink(bucket[i & (buckets - 1)].get(keys[i & (buckets - 1)], keyValueFlag));
+            }
+            report(string("get") + kind, name, ops, elapsed_ns(start), 0);
+        }
+    }
+}
+
+// computePrefix of keys matching none or all of a header of each length
+void prefix_test() {
+    const int ops = 1 << 22;
+    uint64_t key = rng_next(&r);
+    for (int len = 1; len <= ERT_NODE_PREFIX_MAX_BYTES; ++len) {
+        ERTIntHeader header;
+        header.len = len;
+        header.assign(key, 0);
+        for (int matched : {0, len}) {
+            // flip the top bit of byte matched
+            uint64_t probe = matched == len ? key : key ^ ((uint64_t) 0x80 << (56 - matched * SIZE_OF_CHAR));
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < ops; ++i) {
+                harness_sink(header.computePrefix(probe, 0));
+            }
+            report("computePrefix", "len=" + to_string(len) + " matched=" + to_string(matched), ops,
+                   elapsed_ns(start), 0);
+        }
+    }
+}
+
+// fill bucket 0 of seg with ERT_BUCKET_SIZE subkeys, alternating bit split_bit, below the top depth bits
+void fill_full_bucket(ERTIntSegment *seg, int split_bit) {
+    for (int j = 0; j < ERT_BUCKET_SIZE; ++j) {
+        uint64_t subkey = (random_subkey(0) & (((uint64_t) 1 << split_bit) - 1)) | ((uint64_t) (j & 1) << split_bit);
+        seg->bucket[0].counter[j].subkey = PUT_KEY_VALUE_FLAG(subkey);
+        seg->bucket[0].counter[j].value = j + 1;
+    }
+}
+
+// a put into a full bucket of a segment of depth 0 under global depth 1; fill entries in every other
+// bucket are migrated along
+void split_test() {
+    const int reps = 256;
+    for (int fill : {0, ERT_BUCKET_SIZE / 2, ERT_BUCKET_SIZE}) {
+        double ns = 0;
+        uint64_t flushes = 0;
+        for (int rep = 0; rep < reps; ++rep) {
+            ERTIntNode *node = NewERTIntNode(ERT_NODE_LENGTH, 1, 1);
+            ERTIntSegment *seg = *(ERTIntSegment **) GET_SEG_POS(node, 0);
+            *(ERTIntSegment **) GET_SEG_POS(node, 1) = seg;
+            seg->depth = 0;
+            for (int b = 1; b < ERT_MAX_BUCKET_NUM; ++b) {
+                for (int j = 0; j < fill; ++j) {
+                    seg->bucket[b].counter[j].subkey = PUT_KEY_VALUE_FLAG(random_subkey(b));
+                    seg->bucket[b].counter[j].value = j + 1;
+                }
+            }
+            fill_full_bucket(seg, ERT_NODE_LENGTH - 1);
+            uint64_t subkey = (random_subkey(0) & 0x7fffffff) | ((uint64_t) 1 << (ERT_NODE_LENGTH - 1));
+            ERTIntNode *holder = node;
+            uint64_t lines = pm_flush_lines;
+            auto start = chrono::steady_clock::now();
+            node->put(subkey, 1, (uint64_t) &holder);
+            ns += elapsed_ns(start);
+            flushes += pm_flush_lines - lines;
+        }
+        report("segment split", "fill=" + to_string(fill), reps, ns, flushes);
+    }
+}
+
+// a put into a full bucket of a segment at the global depth g, which doubles the directory and then
+// splits the segment
+void doubling_test() {
+    for (int depth = 0; depth <= 8; depth += 2) {
+        int reps = max(8, 1024 >> depth);
+        double ns = 0;
+        uint64_t flushes = 0;
+        for (int rep = 0; rep < reps; ++rep) {
+            ERTIntNode *node = NewERTIntNode(ERT_NODE_LENGTH, 1, depth);
+            int split_bit = ERT_NODE_LENGTH - 1 - depth;
+            fill_full_bucket(*(ERTIntSegment **) GET_SEG_POS(node, 0), split_bit);
+            uint64_t subkey = (random_subkey(0) & (((uint64_t) 1 << split_bit) - 1)) | ((uint64_t) 1 << split_bit);
+            ERTIntNode *holder = node;
+            uint64_t lines = pm_flush_lines;
+            auto start = chrono::steady_clock::now();
+            node->put(subkey, 1, (uint64_t) &holder);
+            ns += elapsed_ns(start);
+            flushes += pm_flush_lines - lines;
+        }
+        report("directory doubling", "global depth=" + to_string(depth), reps, ns, flushes);
+    }
+}
+
+// an insert into a root holding one key under a prefix of ERT_NODE_LENGTH bits, differing from the
+// prefix in byte matched. Nodes come zeroed from the allocator, so a header is only ever given a
+// prefix here
+void prefix_split_test() {
+    const int reps = 256;
+    int prefix = ERT_NODE_LENGTH / SIZE_OF_CHAR;
+    for (int matched = 0; matched < prefix; ++matched) {
+        double ns = 0;
+        uint64_t flushes = 0;
+        for (int rep = 0; rep < reps; ++rep) {
+            ERTInt *tree = NewExtendibleRadixTreeInt();
+            uint64_t key = rng_next(&r);
+            tree->root->header.len = prefix;
+            tree->root->header.assign(key, 0);
+            tree->Insert(key, 1);
+            ERTIntNode *old = tree->root;
+            uint64_t lines = pm_flush_lines;
+            auto start = chrono::steady_clock::now();
+            tree->Insert(key ^ ((uint64_t) 0x80 << (56 - matched * SIZE_OF_CHAR)), 2);
+            ns += elapsed_ns(start);
+            flushes += pm_flush_lines - lines;
+            if (tree->root == old) {
+                cout << "prefix split: the root was not split" << endl;
+            }
+        }
+        report("prefix split", "matched=" + to_string(matched), reps, ns, flushes);
+    }
+}
+
+// scans of len keys in a single node holding n keys under one 32 bit prefix
+void scan_test() {
+    const int scans = 4096;
+    for (int n : {1024, 16384, 131072}) {
+        ERTInt *tree = NewExtendibleRadixTreeInt();
+        uint64_t high = rng_next(&r) & 0xffffffff00000000;
+        vector<uint64_t> keys;
+        for (int i = 0; i < n; ++i) {
+            keys.push_back(high | (rng_next(&r) & 0xffffffff));
+        }
+        sort(keys.begin(), keys.end());
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+        for (uint64_t key : keys) {
+            tree->Insert(key, key);
+        }
+        for (int len : {1, 10, 100}) {
+            vector<ERTIntKeyValue> res;
+            uint64_t errors = 0;
+            double ns = 0;
+            for (int i = 0; i < scans; ++i) {
+                uint64_t s = rng_next(&r) % (keys.size() - len + 1);
+                res.clear();
+                auto start = chrono::steady_clock::now();
+                tree->nodeScan(tree->root, keys[s], keys[s + len - 1], res);
+                ns += elapsed_ns(start);
+                errors += res.size() != (size_t) len;
+            }
+            report("nodeScan", "keys=" + to_string(n) + " len=" + to_string(len), scans, ns, 0);
+            if (errors != 0) {
+                cout << "nodeScan: " << errors << " scans returned a wrong count" << endl;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    init_fast_allocator(true, argc > 1, argc > 1 ? argv[1] : "");
+    rng_init(&r, 1, 2);
+    out.open("../Result/ert_micro.csv", ios::out);
+    out << "mechanism,fill,ops,ns/op,flushes/op" << endl;
+    bucket_test();
+    prefix_test();
+    split_test();
+    doubling_test();
+    prefix_split_test();
+    scan_test();
+    cout << "Saved result to ./Result/ert_micro.csv" << endl;
+    fast_free();
+    return 0;
+}
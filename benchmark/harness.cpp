@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <cmath>
+#include "harness.h"
+
+double RunStats::mean() const {
+    double sum = 0;
+    for (double x : samples) {
+        sum += x;
+    }
+    return samples.empty() ? 0 : sum / samples.size();
+}
+
+double RunStats::stddev() const {
+    if (samples.size() < 2) {
+        return 0;
+    }
+    double m = mean(), sum = 0;
+    for (double x : samples) {
+        sum += (x - m) * (x - m);
+    }
+    return sqrt(sum / (samples.size() - 1));
+}
+
+double RunStats::ci95() const {
+    if (samples.size() < 2) {
+        return 0;
+    }
+    return student_t95(samples.size() - 1) * stddev() / sqrt(samples.size());
+}
+
+double RunStats::min() const {
+    return samples.empty() ? 0 : *std::min_element(samples.begin(), samples.end());
+}
+
+double RunStats::max() const {
+    return samples.empty() ? 0 : *std::max_element(samples.begin(), samples.end());
+}
+
+double student_t95(int df) {
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df <= 0) {
+        return 0;
+    }
+    if (df <= 30) {
+        return table[df - 1];
+    }
+    // within 0.5% of the exact quantile above 30
+    return 1.960 + 2.4 / df;
+}
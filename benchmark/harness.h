@@ -0,0 +1,71 @@
+#ifndef NVMKV_HARNESS_H
+#define NVMKV_HARNESS_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/*
+ * Repeated timing of a benchmark phase.
+ *
+ * A phase is a pass of op(0) .. op(n - 1). harness_run runs warmup untimed passes, then reps
+ * passes timed with steady_clock, each after an untimed setup (a fresh index for inserts). The
+ * values op returns go into a sink the compiler cannot drop. A returned 0 is counted as a miss,
+ * so a lookup of a key that was inserted cannot silently fail. The spread of the passes is
+ * given as the sample standard deviation and the 95% confidence interval of the mean.
+ */
+
+class RunStats {
+public:
+    std::vector<double> samples;
+
+    void add(double x) { samples.push_back(x); }
+
+    double mean() const;
+
+    // sample standard deviation, 0 for fewer than two samples
+    double stddev() const;
+
+    // half width of the 95% confidence interval of the mean, Student's t
+    double ci95() const;
+
+    double min() const;
+
+    double max() const;
+};
+
+// two-sided 95% quantile of Student's t with df degrees of freedom
+double student_t95(int df);
+
+// keep v alive without storing it
+inline void harness_sink(uint64_t v) {
+    asm volatile("" : : "r"(v) : "memory");
+}
+
+// Mops of each timed pass; misses gets the zeros op returned over the timed passes
+template<class F>
+RunStats harness_run(int warmup, int reps, int n, const std::function<void()> &setup, F op, uint64_t &misses) {
+    RunStats res;
+    misses = 0;
+    for (int pass = 0; pass < warmup + reps; ++pass) {
+        if (setup) {
+            setup();
+        }
+        uint64_t zeros = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < n; ++i) {
+            uint64_t v = op(i);
+            harness_sink(v);
+            zeros += v == 0;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (pass >= warmup) {
+            res.add(n / seconds / 1000000);
+            misses += zeros;
+        }
+    }
+    return res;
+}
+
+#endif //NVMKV_HARNESS_H
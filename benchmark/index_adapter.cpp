@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <shared_mutex>
+#include <x86intrin.h>
+#include "index_adapter.h"
+#include "../extendible_radix_tree/ERT_int.h"
+#include "../fastfair/fastfair.h"
+#include "../lbtree/lbtree.h"
+#include "../wort/wort.h"
+#include "../woart/woart.h"
+#include "../roart/roart.h"
+
+// persist an out-of-line value overwritten in place
+static void persist_value(uint64_t *value) {
+    _mm_mfence();
+    _mm_clflush(value);
+    pm_emulate_flush(1);
+    _mm_mfence();
+}
+
+void IndexAdapter::batchInsert(const uint64_t *keys, const uint64_t *values, int n) {
+    for (int i = 0; i < n; ++i) {
+        insert(keys[i], values[i]);
+    }
+}
+
+void IndexAdapter::batchLookup(const uint64_t *keys, uint64_t *values, int n) {
+    for (int i = 0; i < n; ++i) {
+        values[i] = lookup(keys[i]);
+    }
+}
+
+class ERTAdapter : public IndexAdapter {
+public:
+    ERTInt *tree = NewExtendibleRadixTreeInt();
+
+    const char *name() override { return "ERT"; }
+
+    // ERT runs behind LockedAdapter, so no lookup overlaps a write and the blocks it retired can be
+    // freed right away
+    void insert(uint64_t key, uint64_t value) override {
+        tree->Insert(key, value);
+        tree->Reclaim();
+    }
+
+    uint64_t lookup(uint64_t key) override { return tree->Search(key); }
+
+    void update(uint64_t key, uint64_t value) override {
+        tree->Insert(key, value);
+        tree->Reclaim();
+    }
+
+    bool remove(uint64_t key) override {
+        bool res = tree->Remove(key);
+        tree->Reclaim();
+        return res;
+    }
+
+    uint64_t scan(uint64_t left, uint64_t right) override {
+        vector<ERTIntKeyValue> res;
+        tree->nodeScan(tree->root, left, right, res);
+        return res.size();
+    }
+
+    // one writer critical section for the whole batch
+    void batchInsert(const uint64_t *keys, const uint64_t *values, int n) override {
+        vector<ERTIntKeyValue> kvs(n);
+        for (int i = 0; i < n; ++i) {
+            kvs[i].key = keys[i];
+            kvs[i].value = values[i];
+        }
+        sort(kvs.begin(), kvs.end(), [](const ERTIntKeyValue &a, const ERTIntKeyValue &b) { return a.key < b.key; });
+        tree->BulkInsert(kvs);
+        tree->Reclaim();
+    }
+
+    uint64_t memory() override { return tree->memory_profile(tree->root); }
+
+    void stats(std::ostream &out) override {
+        if (tree->cache != NULL) {
+            out << "cache hit ratio " << tree->cache->hitRatio();
+        }
+    }
+};
+
+class FastFairAdapter : public IndexAdapter {
+public:
+    fastfair *tree = new_fastfair();
+
+    const char *name() override { return "FAST&FAIR"; }
+
+    void insert(uint64_t key, uint64_t value) override { tree->put(key, (char *) &value); }
+
+    uint64_t lookup(uint64_t key) override {
+        char *value = tree->get(key);
+        return value == NULL ? 0 : *(uint64_t *) value;
+    }
+
+    void update(uint64_t key, uint64_t value) override {
+        char *old = tree->get(key);
+        if (old == NULL) {
+            tree->put(key, (char *) &value);
+            return;
+        }
+        *(uint64_t *) old = value;
+        persist_value((uint64_t *) old);
+    }
+
+    bool remove(uint64_t key) override {
+        char *value = tree->get(key);
+        if (value == NULL) {
+            return false;
+        }
+        tree->fastfair_delete(key);
+        concurrency_fast_dealloc(value, sizeof(uint64_t), true, fastfair_tag_value);
+        return true;
+    }
+
+    uint64_t scan(uint64_t left, uint64_t right) override { return tree->scan(left, right).size(); }
+
+    uint64_t memory() override { return tree->memory_profile(NULL); }
+};
+
+class LBTreeAdapter : public IndexAdapter {
+public:
+    lbtree *tree = new_lbtree();
+
+    const char *name() override { return "LB+Trees"; }
+
+    void insert(uint64_t key, uint64_t value) override { tree->insert(key, &value); }
+
+    uint64_t lookup(uint64_t key) override {
+        int pos;
+        void *leaf = tree->lookup(key, &pos);
+        return pos < 0 ? 0 : *(uint64_t *) tree->get_recptr(leaf, pos);
+    }
+
+    // insert leaves an existing key untouched
+    void update(uint64_t key, uint64_t value) override {
+        int pos;
+        void *leaf = tree->lookup(key, &pos);
+        if (pos < 0) {
+            tree->insert(key, &value);
+            return;
+        }
+        uint64_t *old = (uint64_t *) tree->get_recptr(leaf, pos);
+        *old = value;
+        persist_value(old);
+    }
+
+    bool remove(uint64_t key) override {
+        int pos;
+        void *leaf = tree->lookup(key, &pos);
+        if (pos < 0) {
+            return false;
+        }
+        void *value = tree->get_recptr(leaf, pos);
+        tree->del(key);
+        concurrency_fast_dealloc(value, sizeof(uint64_t), true, lbtree_tag_value);
+        return true;
+    }
+
+    uint64_t scan(uint64_t left, uint64_t right) override { return tree->rangeQuery(left, right).size(); }
+
+    uint64_t memory() override { return tree->memory_profile(); }
+
+    void stats(std::ostream &out) override { out << "levels " << tree->level() + 1; }
+};
+
+class WORTAdapter : public IndexAdapter {
+public:
+    // the profiler counts every tree, so the bytes of the earlier ones are subtracted
+    uint64_t baseline = wort_memory_usage;
+    wort_tree *tree = new_wort_tree();
+
+    const char *name() override { return "WORT"; }
+
+    void insert(uint64_t key, uint64_t value) override { update(key, value); }
+
+    uint64_t lookup(uint64_t key) override { return wort_get(tree, key, 8); }
+
+    // put swaps in a new value record and returns the old one
+    void update(uint64_t key, uint64_t value) override {
+        void *old = wort_put(tree, key, 8, &value);
+        if (old != NULL) {
+            concurrency_fast_dealloc(old, sizeof(uint64_t), true, wort_tag_value);
+        }
+    }
+
+    bool remove(uint64_t key) override { return false; }
+
+    bool supportsRemove() override { return false; }
+
+    uint64_t scan(uint64_t left, uint64_t right) override { return wort_scan(tree, left, right).size(); }
+
+    uint64_t memory() override { return wort_memory_profile(tree->root) - baseline; }
+};
+
+class WOARTAdapter : public IndexAdapter {
+public:
+    // see WORTAdapter::baseline
+    uint64_t baseline = woart_memory_usage;
+    woart_tree *tree = new_woart_tree();
+
+    const char *name() override { return "WOART"; }
+
+    void insert(uint64_t key, uint64_t value) override { update(key, value); }
+
+    uint64_t lookup(uint64_t key) override { return woart_get(tree, key, 8); }
+
+    void update(uint64_t key, uint64_t value) override {
+        void *old = woart_put(tree, key, 8, &value);
+        if (old != NULL) {
+            concurrency_fast_dealloc(old, sizeof(uint64_t), true, woart_tag_value);
+        }
+    }
+
+    bool remove(uint64_t key) override { return false; }
+
+    bool supportsRemove() override { return false; }
+
+    uint64_t scan(uint64_t left, uint64_t right) override { return woart_scan(tree, left, right).size(); }
+
+    uint64_t memory() override { return woart_memory_profile(tree->root) - baseline; }
+};
+
+class ROARTAdapter : public IndexAdapter {
+public:
+    ROART *tree = new_roart();
+
+    const char *name() override { return "ROART"; }
+
+    void insert(uint64_t key, uint64_t value) override { tree->put(key, value); }
+
+    uint64_t lookup(uint64_t key) override { return tree->get(key); }
+
+    void update(uint64_t key, uint64_t value) override {
+        ROART_KEY k(key, sizeof(uint64_t), value);
+        if (tree->update(&k) == ROART::OperationResults::NotFound) {
+            tree->put(key, value);
+        }
+    }
+
+    bool remove(uint64_t key) override {
+        ROART_KEY k(key, sizeof(uint64_t), 0);
+        return tree->remove(&k) == ROART::OperationResults::Success;
+    }
+
+    // ROART excludes max, so a range up to UINT64_MAX looks that key up on its own. get returns 0
+    // for an absent key, so a UINT64_MAX stored with the value 0 is not counted
+    uint64_t scan(uint64_t left, uint64_t right) override {
+        if (right != UINT64_MAX) {
+            return tree->scan(left, right + 1).size();
+        }
+        return tree->scan(left, UINT64_MAX).size() + (tree->get(UINT64_MAX) != 0);
+    }
+
+    uint64_t memory() override { return tree->memory_profile(); }
+
+    // optimistic lock coupling
+    bool threadSafe() override { return true; }
+};
+
+// lookups and scans share the lock, everything else takes it exclusively
+class LockedAdapter : public IndexAdapter {
+public:
+    IndexAdapter *index;
+    std::shared_mutex lock;
+
+    LockedAdapter(IndexAdapter *_index) : index(_index) {}
+
+    ~LockedAdapter() override { delete index; }
+
+    const char *name() override { return index->name(); }
+
+    void insert(uint64_t key, uint64_t value) override {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        index->insert(key, value);
+    }
+
+    uint64_t lookup(uint64_t key) override {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        return index->lookup(key);
+    }
+
+    void update(uint64_t key, uint64_t value) override {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        index->update(key, value);
+    }
+
+    bool remove(uint64_t key) override {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        return index->remove(key);
+    }
+
+    bool supportsRemove() override { return index->supportsRemove(); }
+
+    bool threadSafe() override { return true; }
+
+    uint64_t scan(uint64_t left, uint64_t right) override {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        return index->scan(left, right);
+    }
+
+    void batchInsert(const uint64_t *keys, const uint64_t *values, int n) override {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        index->batchInsert(keys, values, n);
+    }
+
+    void batchLookup(const uint64_t *keys, uint64_t *values, int n) override {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        index->batchLookup(keys, values, n);
+    }
+
+    uint64_t memory() override {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        return index->memory();
+    }
+
+    void stats(std::ostream &out) override { index->stats(out); }
+};
+
+const std::vector<std::string> &index_adapter_names() {
+    static const std::vector<std::string> names = {"FAST&FAIR", "LB+Trees", "WORT", "WOART", "ROART", "ERT"};
+    return names;
+}
+
+IndexAdapter *new_index_adapter(const std::string &name) {
+    if (name == "ERT") {
+        return new ERTAdapter;
+    } else if (name == "FAST&FAIR") {
+        return new FastFairAdapter;
+    } else if (name == "LB+Trees") {
+        return new LBTreeAdapter;
+    } else if (name == "WORT") {
+        return new WORTAdapter;
+    } else if (name == "WOART") {
+        return new WOARTAdapter;
+    } else if (name == "ROART") {
+        return new ROARTAdapter;
+    }
+    return NULL;
+}
+
+IndexAdapter *new_concurrent_index_adapter(const std::string &name) {
+    IndexAdapter *index = new_index_adapter(name);
+    if (index == NULL || index->threadSafe()) {
+        return index;
+    }
+    return new LockedAdapter(index);
+}
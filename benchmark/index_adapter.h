@@ -0,0 +1,68 @@
+#ifndef NVMKV_INDEX_ADAPTER_H
+#define NVMKV_INDEX_ADAPTER_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * Common interface over the evaluated indexes, so a workload is written once and run on each.
+ *
+ * Keys and values are 8 bytes. lookup returns the stored value and 0 for a missing key, so the
+ * indexes that keep values out of line (FAST&FAIR, LB+Tree, WORT, WOART) pay the dereference.
+ * insert of a key that is already present is index specific: FAST&FAIR adds a duplicate and
+ * LB+Tree keeps the old value, the others overwrite. update always overwrites the value and
+ * inserts the key if it is missing. remove returns false for a missing key and on indexes
+ * without a delete, see supportsRemove.
+ *
+ * Only ROART synchronizes concurrent operations itself. ERT serializes its writers but its
+ * readers are not safe against a concurrent split, and the others have no synchronization,
+ * so new_concurrent_index_adapter puts those behind a reader-writer lock.
+ */
+
+class IndexAdapter {
+public:
+    virtual ~IndexAdapter() {}
+
+    // name of the CSV row
+    virtual const char *name() = 0;
+
+    virtual void insert(uint64_t key, uint64_t value) = 0;
+
+    virtual uint64_t lookup(uint64_t key) = 0;
+
+    virtual void update(uint64_t key, uint64_t value) = 0;
+
+    virtual bool remove(uint64_t key) = 0;
+
+    virtual bool supportsRemove() { return true; }
+
+    // true if concurrent calls are safe without an external lock
+    virtual bool threadSafe() { return false; }
+
+    // number of keys in [left, right]
+    virtual uint64_t scan(uint64_t left, uint64_t right) = 0;
+
+    virtual void batchInsert(const uint64_t *keys, const uint64_t *values, int n);
+
+    // values[i] = lookup(keys[i])
+    virtual void batchLookup(const uint64_t *keys, uint64_t *values, int n);
+
+    // bytes reported by the index's own memory profiler
+    virtual uint64_t memory() = 0;
+
+    // index specific counters on one line, nothing if there are none
+    virtual void stats(std::ostream &out) {}
+};
+
+// registered indexes in report order
+const std::vector<std::string> &index_adapter_names();
+
+// a new empty index, NULL for an unknown name
+IndexAdapter *new_index_adapter(const std::string &name);
+
+// new_index_adapter, behind a reader-writer lock unless the index is thread-safe
+IndexAdapter *new_concurrent_index_adapter(const std::string &name);
+
+#endif //NVMKV_INDEX_ADAPTER_H
@@ -0,0 +1,63 @@
+#include <chrono>
+#include <cmath>
+#include "latency.h"
+
+const double latency_percentiles[LATENCY_PERCENTILE_NUM] = {50, 90, 99, 99.9, 99.99};
+
+double tsc_per_ns() {
+    static double res = 0;
+    if (res == 0) {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t tsc = tsc_now();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50));
+        uint64_t cycles = tsc_now() - tsc;
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        res = cycles / ns;
+    }
+    return res;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+        counts[i] += other.counts[i];
+    }
+    total += other.total;
+    if (other.maximum > maximum) {
+        maximum = other.maximum;
+    }
+}
+
+void LatencyHistogram::reset() {
+    *this = LatencyHistogram();
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const {
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = std::ceil(percent / 100 * total), seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank && counts[i] != 0) {
+            int shift = i < 2 * LATENCY_SUB_BUCKETS ? 0 : (i >> LATENCY_SUB_BITS) - 1;
+            uint64_t high = (((uint64_t) (i - (shift << LATENCY_SUB_BITS)) + 1) << shift) - 1;
+            return high < maximum ? high : maximum;
+        }
+    }
+    return maximum;
+}
+
+void latency_csv_header(std::ostream &out) {
+    for (double p : latency_percentiles) {
+        out << "p" << p << " ns,";
+    }
+    out << "max ns";
+}
+
+void latency_csv_row(std::ostream &out, const LatencyHistogram &hist) {
+    double scale = tsc_per_ns();
+    for (double p : latency_percentiles) {
+        out << hist.percentile(p) / scale << ",";
+    }
+    out << hist.max() / scale;
+}
@@ -0,0 +1,72 @@
+#ifndef NVMKV_LATENCY_H
+#define NVMKV_LATENCY_H
+
+#include <cstdint>
+#include <ostream>
+#include <x86intrin.h>
+
+/*
+ * Per-operation latency in TSC cycles, recorded into a log-linear histogram in the style of
+ * HdrHistogram.
+ *
+ * Values below 2 * LATENCY_SUB_BUCKETS cycles are counted exactly. Above that, every power of
+ * two is split into LATENCY_SUB_BUCKETS equal buckets, so a recorded value is off by at most
+ * 1 / LATENCY_SUB_BUCKETS (about 3%). The counts are a flat array: recording does no allocation
+ * and no atomic, so each thread records into its own histogram and the histograms are merged
+ * after the run. Percentiles report the highest value of their bucket, max is exact.
+ */
+
+#define LATENCY_SUB_BITS 5
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+// the exact range takes two rows of sub-buckets, then one row per octave up to 2^64
+#define LATENCY_BUCKETS ((65 - LATENCY_SUB_BITS) * LATENCY_SUB_BUCKETS)
+
+// percentiles of the reports, in percent
+#define LATENCY_PERCENTILE_NUM 5
+extern const double latency_percentiles[LATENCY_PERCENTILE_NUM];
+
+inline uint64_t tsc_now() {
+    return __rdtsc();
+}
+
+// TSC cycles per nanosecond, calibrated against steady_clock on the first call
+double tsc_per_ns();
+
+class LatencyHistogram {
+public:
+    void record(uint64_t cycles) {
+        int shift = 63 - __builtin_clzll(cycles | 1) - LATENCY_SUB_BITS;
+        if (shift < 0) {
+            shift = 0;
+        }
+        counts[(shift << LATENCY_SUB_BITS) + (cycles >> shift)]++;
+        total++;
+        if (cycles > maximum) {
+            maximum = cycles;
+        }
+    }
+
+    void merge(const LatencyHistogram &other);
+
+    void reset();
+
+    uint64_t count() const { return total; }
+
+    uint64_t max() const { return maximum; }
+
+    // cycles below which percent of the recorded values fall, 0 if nothing is recorded
+    uint64_t percentile(double percent) const;
+
+private:
+    uint64_t counts[LATENCY_BUCKETS] = {};
+    uint64_t total = 0;
+    uint64_t maximum = 0;
+};
+
+// "p50 ns,p90 ns,...,max ns"
+void latency_csv_header(std::ostream &out);
+
+// the percentiles and max of hist in ns, comma separated as in latency_csv_header
+void latency_csv_row(std::ostream &out, const LatencyHistogram &hist);
+
+#endif //NVMKV_LATENCY_H
@@ -0,0 +1,159 @@
+#include <cstdio>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "perf_counters.h"
+#include "../fastalloc/fastalloc_emu.h"
+
+const char *perf_counter_name(int counter) {
+    switch (counter) {
+        case PERF_CYCLES:
+            return "cycles";
+        case PERF_INSTRUCTIONS:
+            return "instructions";
+        case PERF_LLC_MISSES:
+            return "LLC-load-misses";
+        case PERF_DTLB_MISSES:
+            return "dTLB-load-misses";
+        case PERF_BRANCH_MISSES:
+            return "branch-misses";
+        default:
+            return "flushes";
+    }
+}
+
+void PerfSample::add(const PerfSample &other) {
+    for (int i = 0; i < PERF_COUNTER_NUM; ++i) {
+        value[i] += other.value[i];
+        valid[i] = (threads == 0 || valid[i]) && other.valid[i];
+    }
+    threads += other.threads;
+}
+
+static int perf_open(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// config of a PERF_TYPE_HW_CACHE read miss
+#define PERF_CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+PerfCounters::PerfCounters() {
+    fds[PERF_CYCLES] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[PERF_INSTRUCTIONS] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[PERF_LLC_MISSES] = perf_open(PERF_TYPE_HW_CACHE, PERF_CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL));
+    fds[PERF_DTLB_MISSES] = perf_open(PERF_TYPE_HW_CACHE, PERF_CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB));
+    fds[PERF_BRANCH_MISSES] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    fds[PERF_FLUSHES] = -1;
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+bool PerfCounters::available() {
+    for (int i = 0; i < PERF_FLUSHES; ++i) {
+        if (fds[i] >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PerfCounters::start() {
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    flush_start = pm_flush_lines;
+}
+
+PerfSample PerfCounters::stop() {
+    PerfSample res;
+    res.threads = 1;
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    res.value[PERF_FLUSHES] = pm_flush_lines - flush_start;
+    res.valid[PERF_FLUSHES] = true;
+    for (int i = 0; i < PERF_FLUSHES; ++i) {
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (fds[i] < 0 || read(fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+            continue;
+        }
+        res.value[i] = data[2] < data[1] ? (double) data[0] * data[1] / data[2] : data[0];
+        res.valid[i] = true;
+    }
+    return res;
+}
+
+static double ipc(const PerfSample &sample) {
+    return sample.value[PERF_CYCLES] == 0 ? 0 : sample.value[PERF_INSTRUCTIONS] / sample.value[PERF_CYCLES];
+}
+
+static bool ipc_valid(const PerfSample &sample) {
+    return sample.valid[PERF_CYCLES] && sample.valid[PERF_INSTRUCTIONS];
+}
+
+void perf_csv_header(std::ostream &out) {
+    for (int i = 0; i < PERF_COUNTER_NUM; ++i) {
+        out << (i == 0 ? "" : ",") << perf_counter_name(i) << "/op";
+        if (i == PERF_INSTRUCTIONS) {
+            out << ",IPC";
+        }
+    }
+}
+
+void perf_csv_row(std::ostream &out, const PerfSample &sample, uint64_t ops) {
+    for (int i = 0; i < PERF_COUNTER_NUM; ++i) {
+        out << (i == 0 ? "" : ",");
+        if (sample.valid[i] && ops != 0) {
+            out << sample.value[i] / ops;
+        }
+        if (i == PERF_INSTRUCTIONS) {
+            out << ",";
+            if (ipc_valid(sample)) {
+                out << ipc(sample);
+            }
+        }
+    }
+}
+
+void perf_print(std::ostream &out, const PerfSample &sample, uint64_t ops) {
+    for (int i = 0; i < PERF_COUNTER_NUM; ++i) {
+        out << (i == 0 ? "" : ", ") << perf_counter_name(i) << "/op ";
+        if (sample.valid[i] && ops != 0) {
+            out << sample.value[i] / ops;
+        } else {
+            out << "n/a";
+        }
+        if (i == PERF_INSTRUCTIONS) {
+            out << ", IPC ";
+            if (ipc_valid(sample)) {
+                out << ipc(sample);
+            } else {
+                out << "n/a";
+            }
+        }
+    }
+}
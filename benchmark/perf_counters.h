@@ -0,0 +1,73 @@
+#ifndef NVMKV_PERF_COUNTERS_H
+#define NVMKV_PERF_COUNTERS_H
+
+#include <cstdint>
+#include <ostream>
+
+/*
+ * Hardware counters of a benchmark phase through perf_event_open.
+ *
+ * Every event is opened on its own for the calling thread and counts user space only, so
+ * perf_event_paranoid up to 2 is enough. An event that does not open (no PMU in a VM, paranoid
+ * 3, an event the CPU lacks) is reported as missing and the others are still counted. When the
+ * PMU multiplexes, counts are scaled by time enabled over time running. The flushes are the
+ * thread's pm_flush_lines, the write-backs of PM emulation or of the real flushes on PM.
+ */
+
+enum perf_counter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_FLUSHES,
+    PERF_COUNTER_NUM
+};
+
+const char *perf_counter_name(int counter);
+
+// counts of one phase, summed over the threads that ran it
+class PerfSample {
+public:
+    double value[PERF_COUNTER_NUM] = {};
+    // false if the event could not be counted on some thread
+    bool valid[PERF_COUNTER_NUM] = {};
+    // threads added, valid starts out true on the first one
+    int threads = 0;
+
+    void add(const PerfSample &other);
+};
+
+class PerfCounters {
+public:
+    PerfCounters();
+
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters &) = delete;
+
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    // false if no hardware event could be opened
+    bool available();
+
+    void start();
+
+    // counts since start
+    PerfSample stop();
+
+private:
+    int fds[PERF_COUNTER_NUM];
+    uint64_t flush_start = 0;
+};
+
+// "cycles/op,instructions/op,IPC,...,flushes/op"
+void perf_csv_header(std::ostream &out);
+
+// the counts of sample per operation, comma separated as in perf_csv_header, empty if missing
+void perf_csv_row(std::ostream &out, const PerfSample &sample, uint64_t ops);
+
+// the same on one line for the console
+void perf_print(std::ostream &out, const PerfSample &sample, uint64_t ops);
+
+#endif //NVMKV_PERF_COUNTERS_H
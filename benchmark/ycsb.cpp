@@ -0,0 +1,201 @@
+#include <cmath>
+#include "ycsb.h"
+#include "../rng/rng.h"
+
+bool ycsb_workload(char name, YCSBWorkload &workload) {
+    workload = YCSBWorkload();
+    workload.name = std::string(1, name);
+    double *p = workload.proportion;
+    switch (name) {
+        case 'A':
+            // update heavy
+            p[YCSB_READ] = 0.5;
+            p[YCSB_UPDATE] = 0.5;
+            break;
+        case 'B':
+            // read mostly
+            p[YCSB_READ] = 0.95;
+            p[YCSB_UPDATE] = 0.05;
+            break;
+        case 'C':
+            // read only
+            p[YCSB_READ] = 1;
+            break;
+        case 'D':
+            // read latest
+            p[YCSB_READ] = 0.95;
+            p[YCSB_INSERT] = 0.05;
+            workload.distribution = YCSB_LATEST;
+            break;
+        case 'E':
+            // short ranges
+            p[YCSB_SCAN] = 0.95;
+            p[YCSB_INSERT] = 0.05;
+            break;
+        case 'F':
+            // read-modify-write
+            p[YCSB_READ] = 0.5;
+            p[YCSB_RMW] = 0.5;
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+const char *ycsb_distribution_name(ycsb_distribution distribution) {
+    switch (distribution) {
+        case YCSB_UNIFORM:
+            return "uniform";
+        case YCSB_ZIPFIAN:
+            return "zipfian";
+        case YCSB_LATEST:
+            return "latest";
+        default:
+            return "hotspot";
+    }
+}
+
+const char *ycsb_op_name(int type) {
+    switch (type) {
+        case YCSB_READ:
+            return "read";
+        case YCSB_UPDATE:
+            return "update";
+        case YCSB_INSERT:
+            return "insert";
+        case YCSB_SCAN:
+            return "scan";
+        default:
+            return "rmw";
+    }
+}
+
+ZipfianGenerator::ZipfianGenerator(uint64_t n, double theta) : items(0), theta(theta), zetan(0) {
+    zeta2 = 1 + pow(0.5, theta);
+    alpha = 1 / (1 - theta);
+    grow(n);
+}
+
+void ZipfianGenerator::grow(uint64_t n) {
+    for (uint64_t i = items; i < n; ++i) {
+        zetan += 1 / pow(i + 1, theta);
+    }
+    items = n;
+    eta = (1 - pow(2.0 / items, 1 - theta)) / (1 - zeta2 / zetan);
+}
+
+uint64_t ZipfianGenerator::next(double u) {
+    double uz = u * zetan;
+    if (uz < 1) {
+        return 0;
+    }
+    if (uz < zeta2) {
+        return 1;
+    }
+    uint64_t res = items * pow(eta * u - eta + 1, alpha);
+    return res < items ? res : items - 1;
+}
+
+// rng_next returns 63 bits
+static double next_double(rng *r) {
+    return (rng_next(r) >> 10) * (1.0 / ((uint64_t) 1 << 53));
+}
+
+// 80% of the draws go to the first 20% of n
+static uint64_t hotspot_id(rng *r, uint64_t n) {
+    uint64_t hot = n / 5 == 0 ? 1 : n / 5;
+    if (next_double(r) < 0.8 || hot == n) {
+        return rng_next(r) % hot;
+    }
+    return hot + rng_next(r) % (n - hot);
+}
+
+std::vector<YCSBOp> ycsb_generate(const YCSBWorkload &workload, uint64_t record_count, uint64_t op_count,
+                                  double theta, uint64_t seed) {
+    rng r;
+    rng_init(&r, seed, seed + 1);
+    ZipfianGenerator zipf(record_count, theta);
+    uint64_t inserted = record_count;
+    std::vector<YCSBOp> ops(op_count);
+    for (auto &op : ops) {
+        double u = next_double(&r), sum = 0;
+        op.type = YCSB_READ;
+        for (int i = 0; i < YCSB_OP_NUM; ++i) {
+            sum += workload.proportion[i];
+            if (u < sum) {
+                op.type = i;
+                break;
+            }
+        }
+        op.scan_length = op.type == YCSB_SCAN ? 1 + rng_next(&r) % workload.max_scan_length : 0;
+        if (op.type == YCSB_INSERT) {
+            op.key = ycsb_key(inserted++);
+            continue;
+        }
+        uint64_t id;
+        switch (workload.distribution) {
+            case YCSB_UNIFORM:
+                id = rng_next(&r) % inserted;
+                break;
+            case YCSB_ZIPFIAN:
+                id = zipf.next(next_double(&r));
+                break;
+            case YCSB_LATEST:
+                zipf.grow(inserted);
+                id = inserted - 1 - zipf.next(next_double(&r));
+                break;
+            default:
+                id = hotspot_id(&r, inserted);
+        }
+        op.key = ycsb_key(id);
+    }
+    return ops;
+}
+
+std::vector<uint64_t> ycsb_ids(ycsb_distribution distribution, uint64_t n, uint64_t count, double theta,
+                               uint64_t seed) {
+    rng r;
+    rng_init(&r, seed, seed + 1);
+    ZipfianGenerator zipf(distribution == YCSB_ZIPFIAN || distribution == YCSB_LATEST ? n : 1, theta);
+    std::vector<uint64_t> ids(count);
+    for (auto &id : ids) {
+        switch (distribution) {
+            case YCSB_UNIFORM:
+                id = rng_next(&r) % n;
+                break;
+            case YCSB_ZIPFIAN:
+                id = ycsb_key(zipf.next(next_double(&r))) % n;
+                break;
+            case YCSB_LATEST:
+                id = n - 1 - zipf.next(next_double(&r));
+                break;
+            default:
+                id = hotspot_id(&r, n);
+        }
+    }
+    return ids;
+}
+
+uint64_t ycsb_run(IndexAdapter *index, const YCSBOp &op, uint64_t value, uint64_t record_count) {
+    switch (op.type) {
+        case YCSB_READ:
+            return index->lookup(op.key);
+        case YCSB_UPDATE:
+            index->update(op.key, value);
+            return 0;
+        case YCSB_INSERT:
+            index->insert(op.key, value);
+            return 0;
+        case YCSB_SCAN: {
+            uint64_t width = UINT64_MAX / (record_count == 0 ? 1 : record_count) * op.scan_length;
+            uint64_t right = op.key > UINT64_MAX - width ? UINT64_MAX : op.key + width;
+            return index->scan(op.key, right);
+        }
+        default: {
+            uint64_t old = index->lookup(op.key);
+            index->update(op.key, old + 1);
+            return old;
+        }
+    }
+}
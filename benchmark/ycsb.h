@@ -0,0 +1,105 @@
+#ifndef NVMKV_YCSB_H
+#define NVMKV_YCSB_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "index_adapter.h"
+
+/*
+ * YCSB core workloads for the index benchmark.
+ *
+ * The load phase inserts record ids 0 .. record_count - 1, and every insert of the run phase
+ * takes the next id. An id is stored under ycsb_key(id), the FNV-1a hash of the id, so
+ * consecutive ids and the hot ids of a skewed distribution are spread over the key space as in
+ * YCSB with hashed inserts. The distributions pick ids:
+ *
+ *   uniform  every loaded or inserted id is equally likely
+ *   zipfian  id i has weight 1 / (i + 1)^theta (Gray et al.), theta in (0, 1), YCSB uses 0.99
+ *   latest   zipfian over recency, the newest insert is the most popular
+ *   hotspot  80% of the operations go to the first 20% of the ids
+ *
+ * A scan of length l starts at a chosen key and covers l times the mean key gap, so it returns
+ * about l keys. The operations are generated before the run so the random numbers are not timed.
+ */
+
+enum ycsb_op_type {
+    YCSB_READ,
+    YCSB_UPDATE,
+    YCSB_INSERT,
+    YCSB_SCAN,
+    // read-modify-write
+    YCSB_RMW,
+    YCSB_OP_NUM
+};
+
+enum ycsb_distribution {
+    YCSB_UNIFORM,
+    YCSB_ZIPFIAN,
+    YCSB_LATEST,
+    YCSB_HOTSPOT,
+    YCSB_DISTRIBUTION_NUM
+};
+
+class YCSBWorkload {
+public:
+    std::string name;
+    // fraction of each ycsb_op_type, summing to 1
+    double proportion[YCSB_OP_NUM] = {};
+    ycsb_distribution distribution = YCSB_ZIPFIAN;
+    // scan lengths are uniform in [1, max_scan_length]
+    int max_scan_length = 100;
+};
+
+class YCSBOp {
+public:
+    uint64_t key;
+    uint32_t type;
+    uint32_t scan_length;
+};
+
+// core workload A - F, false for an unknown name
+bool ycsb_workload(char name, YCSBWorkload &workload);
+
+const char *ycsb_distribution_name(ycsb_distribution distribution);
+
+const char *ycsb_op_name(int type);
+
+// key of record id
+inline uint64_t ycsb_key(uint64_t id) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 8; ++i) {
+        hash ^= (id >> (i * 8)) & 0xff;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// draws 0 .. n - 1 with weight 1 / (i + 1)^theta; n may grow, the zeta sum is extended incrementally
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(uint64_t n, double theta);
+
+    void grow(uint64_t n);
+
+    // u uniform in [0, 1)
+    uint64_t next(double u);
+
+private:
+    uint64_t items;
+    double theta, zeta2, zetan, alpha, eta;
+};
+
+// op_count operations of workload over record_count loaded records
+std::vector<YCSBOp> ycsb_generate(const YCSBWorkload &workload, uint64_t record_count, uint64_t op_count,
+                                  double theta, uint64_t seed);
+
+// count ids in [0, n): zipfian ids are scrambled over [0, n) as in YCSB, latest favours the ids
+// near n and hotspot the first 20%
+std::vector<uint64_t> ycsb_ids(ycsb_distribution distribution, uint64_t n, uint64_t count, double theta,
+                               uint64_t seed);
+
+// perform op, value is written by updates and inserts; returns the value read or the scan count
+uint64_t ycsb_run(IndexAdapter *index, const YCSBOp &op, uint64_t value, uint64_t record_count);
+
+#endif //NVMKV_YCSB_H
@@ -0,0 +1,286 @@
+#include <cstring>
+#include <algorithm>
+#include "ERT_int.h"
+
+inline void mfence(void) {
+    asm volatile("mfence":: :"memory");
+}
+
+inline void clflush(char *data, size_t len) {
+    volatile char *ptr = (char *) ((unsigned long) data & (~(CACHELINESIZE - 1)));
+    mfence();
+    for (; ptr < data + len; ptr += CACHELINESIZE) {
+        asm volatile("clflush %0" : "+m" (*(volatile char *) ptr));
+    }
+    pm_emulate_flush(pm_flush_line_num(data, len));
+    mfence();
+}
+
+ERTIntBucketKeyValue *ERTIntArtNode::find(uint64_t subkey) {
+    ERTIntBucketKeyValue *entries = GET_ART_ENTRIES(this);
+    for (int i = 0; i < num; ++i) {
+        if (subkey == REMOVE_NODE_FLAG(entries[i].subkey)) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+uint64_t ERTIntArtNode::get(uint64_t subkey, bool &keyValueFlag, bool &artNodeFlag) {
+    ERTIntBucketKeyValue *entry = find(subkey);
+    if (entry == NULL) {
+        return 0;
+    }
+    keyValueFlag = GET_NODE_FLAG(entry->subkey);
+    artNodeFlag = GET_ART_NODE_FLAG(entry->subkey);
+    return entry->value;
+}
+
+uint64_t ERTIntArtNode::size() {
+    return sizeof(ERTIntArtNode) + sizeof(ERTIntBucketKeyValue) * capacity;
+}
+
+ERTIntArtNode *NewERTIntArtNode(unsigned char capacity) {
+    ERTIntArtNode *_new_node = static_cast<ERTIntArtNode *>(concurrency_fast_alloc(
+            sizeof(ERTIntArtNode) + sizeof(ERTIntBucketKeyValue) * capacity, true, ert_tag_art));
+    _new_node->capacity = capacity;
+    _new_node->num = 0;
+    _new_node->version = ert_write_epoch.load(std::memory_order_relaxed);
+    return _new_node;
+}
+
+void ERTInt::EnableHybrid() {
+    hybrid = true;
+}
+
+// len counts the key bytes consumed above node, parentSlot is the entry pointing to node
+void ERTInt::artInsert(uint64_t key, uint64_t value, ERTIntArtNode *node, int len,
+                       ERTIntBucketKeyValue *parentSlot) {
+    uint64_t subkey = GET_SUBKEY(key, len * SIZE_OF_CHAR, ERT_NODE_LENGTH);
+    len += ERT_NODE_LENGTH / SIZE_OF_CHAR;
+    ERTIntBucketKeyValue *entry = node->find(subkey);
+    if (entry != NULL) {
+        if (len == ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+            entry->value = value;
+            clflush((char *) &entry->value, 8);
+        } else if (GET_NODE_FLAG(entry->subkey)) {
+            ERTIntKeyValue *kv = (ERTIntKeyValue *) entry->value;
+            if (kv->key == key) {
+                kv->value = value;
+                clflush((char *) &kv->value, 8);
+                return;
+            }
+            ERTIntArtNode *newNode = NewERTIntArtNode(ERT_ART_NODE4);
+            artInsert(kv->key, kv->value, newNode, len, NULL);
+            artInsert(key, value, newNode, len, NULL);
+            entry->subkey = PUT_ART_NODE_FLAG(subkey);
+            entry->value = (uint64_t) newNode;
+            clflush((char *) entry, sizeof(ERTIntBucketKeyValue));
+            retire(kv, sizeof(ERTIntKeyValue), ert_tag_kv);
+        } else if (GET_ART_NODE_FLAG(entry->subkey)) {
+            artInsert(key, value, (ERTIntArtNode *) entry->value, len, entry);
+        } else {
+            nodeInsert(key, value, (ERTIntNode *) entry->value, len, (uint64_t) &entry->value);
+        }
+        return;
+    }
+
+    uint64_t newValue = value;
+    if (len < ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+        ERTIntKeyValue *kv = NewERTIntKeyValue(key, value);
+        clflush((char *) kv, sizeof(ERTIntKeyValue));
+        newValue = (uint64_t) kv;
+    }
+    ERTIntBucketKeyValue *entries = GET_ART_ENTRIES(node);
+    if (node->num < node->capacity) {
+        entries[node->num].value = newValue;
+        entries[node->num].subkey = PUT_KEY_VALUE_FLAG(subkey);
+        clflush((char *) &entries[node->num], sizeof(ERTIntBucketKeyValue));
+        node->num++;
+        clflush((char *) &node->num, sizeof(node->num));
+        return;
+    }
+    if (node->capacity < ERT_ART_NODE16) {
+        // grow: copy into a larger node, then swing the parent pointer
+        ERTIntArtNode *newNode = NewERTIntArtNode(ERT_ART_NODE16);
+        ERTIntBucketKeyValue *newEntries = GET_ART_ENTRIES(newNode);
+        memcpy(newEntries, entries, sizeof(ERTIntBucketKeyValue) * node->num);
+        newEntries[node->num].value = newValue;
+        newEntries[node->num].subkey = PUT_KEY_VALUE_FLAG(subkey);
+        newNode->num = node->num + 1;
+        clflush((char *) newNode, newNode->size());
+        parentSlot->value = (uint64_t) newNode;
+        clflush((char *) &parentSlot->value, 8);
+        retire(node, node->size(), ert_tag_art);
+        return;
+    }
+    // promote: fanout crossed ERT_ART_NODE16, rebuild the subtree root as a hash node
+    ERTIntNode *newNode = NewERTIntNode(ERT_NODE_LENGTH,
+                                       (len * SIZE_OF_CHAR - ERT_NODE_LENGTH) / ERT_NODE_LENGTH);
+    for (int i = 0; i < node->num; ++i) {
+        newNode->put(REMOVE_NODE_FLAG(entries[i].subkey), entries[i].value, (uint64_t) &newNode,
+                     entries[i].subkey & ~REMOVE_NODE_FLAG(entries[i].subkey), this);
+    }
+    newNode->put(subkey, newValue, (uint64_t) &newNode, ERT_KEY_VALUE_FLAG, this);
+    clflush((char *) newNode, sizeof(ERTIntNode));
+    parentSlot->subkey = REMOVE_NODE_FLAG(parentSlot->subkey);
+    parentSlot->value = (uint64_t) newNode;
+    clflush((char *) parentSlot, sizeof(ERTIntBucketKeyValue));
+    retire(node, node->size(), ert_tag_art);
+}
+
+uint64_t ERTInt::artSearch(uint64_t key, ERTIntArtNode *node, int pos) {
+    while (pos < ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+        uint64_t subkey = GET_SUBKEY(key, pos * SIZE_OF_CHAR, ERT_NODE_LENGTH);
+        bool keyValueFlag = false, artNodeFlag = false;
+        uint64_t next = node->get(subkey, keyValueFlag, artNodeFlag);
+        pos += ERT_NODE_LENGTH / SIZE_OF_CHAR;
+        if (next == 0) {
+            return 0;
+        }
+        if (keyValueFlag) {
+            if (pos == ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+                return next;
+            }
+            return key == ((ERTIntKeyValue *) next)->key ? ((ERTIntKeyValue *) next)->value : 0;
+        }
+        if (!artNodeFlag) {
+            return nodeSearch(key, (ERTIntNode *) next, pos);
+        }
+        node = (ERTIntArtNode *) next;
+    }
+    return 0;
+}
+
+// the last entry moves into the hole before num shrinks, so a crash leaves at most a duplicate
+bool ERTInt::artRemove(uint64_t key, ERTIntArtNode *node, int pos) {
+    while (pos < ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+        uint64_t subkey = GET_SUBKEY(key, pos * SIZE_OF_CHAR, ERT_NODE_LENGTH);
+        ERTIntBucketKeyValue *entry = node->find(subkey);
+        pos += ERT_NODE_LENGTH / SIZE_OF_CHAR;
+        if (entry == NULL || entry->value == 0) {
+            return false;
+        }
+        if (GET_NODE_FLAG(entry->subkey)) {
+            ERTIntKeyValue *kv = NULL;
+            if (pos != ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+                kv = (ERTIntKeyValue *) entry->value;
+                if (kv->key != key) {
+                    return false;
+                }
+            }
+            ERTIntBucketKeyValue *last = GET_ART_ENTRIES(node) + node->num - 1;
+            if (entry != last) {
+                *entry = *last;
+                clflush((char *) entry, sizeof(ERTIntBucketKeyValue));
+            }
+            node->num--;
+            clflush((char *) &node->num, sizeof(node->num));
+            if (kv != NULL) {
+                retire(kv, sizeof(ERTIntKeyValue), ert_tag_kv);
+            }
+            return true;
+        }
+        if (!GET_ART_NODE_FLAG(entry->subkey)) {
+            return nodeRemove(key, (ERTIntNode *) entry->value, pos);
+        }
+        node = (ERTIntArtNode *) entry->value;
+    }
+    return false;
+}
+
+// pos counts the key bits consumed above tmp and prefix holds them, as in nodeScan
+void ERTInt::artScan(ERTIntArtNode *tmp, uint64_t left, uint64_t right, vector<ERTIntKeyValue> &res, int pos,
+                     uint64_t prefix) {
+    pos += ERT_NODE_LENGTH;
+    int shift = ERT_KEY_LENGTH - pos;
+    ERTIntBucketKeyValue entries[ERT_ART_NODE16];
+    memcpy(entries, GET_ART_ENTRIES(tmp), sizeof(ERTIntBucketKeyValue) * tmp->num);
+    sort(entries, entries + tmp->num, [](const ERTIntBucketKeyValue &a, const ERTIntBucketKeyValue &b) {
+        return REMOVE_NODE_FLAG(a.subkey) < REMOVE_NODE_FLAG(b.subkey);
+    });
+    for (int i = 0; i < tmp->num; ++i) {
+        uint64_t curPrefix = (prefix << ERT_NODE_LENGTH) | REMOVE_NODE_FLAG(entries[i].subkey);
+        uint64_t lo = curPrefix << shift;
+        uint64_t hi = lo | (((uint64_t) 1 << shift) - 1);
+        if (hi < left) {
+            continue;
+        }
+        if (lo > right) {
+            break;
+        }
+        uint64_t value = entries[i].value;
+        if (pos == ERT_KEY_LENGTH) {
+            ERTIntKeyValue kv;
+            kv.key = lo;
+            kv.value = value;
+            res.push_back(kv);
+        } else if (GET_NODE_FLAG(entries[i].subkey)) {
+            ERTIntKeyValue &kv = *(ERTIntKeyValue *) value;
+            if (kv.key >= left && kv.key <= right) {
+                res.push_back(kv);
+            }
+        } else if (GET_ART_NODE_FLAG(entries[i].subkey)) {
+            artScan((ERTIntArtNode *) value, left, right, res, pos, curPrefix);
+        } else {
+            nodeScan((ERTIntNode *) value, left, right, res, pos, curPrefix);
+        }
+    }
+}
+
+uint64_t ERTInt::artMemory(ERTIntArtNode *tmp, int pos) {
+    uint64_t res = tmp->size();
+    pos += ERT_NODE_LENGTH;
+    if (pos == ERT_KEY_LENGTH) {
+        return res;
+    }
+    ERTIntBucketKeyValue *entries = GET_ART_ENTRIES(tmp);
+    for (int i = 0; i < tmp->num; ++i) {
+        if (GET_NODE_FLAG(entries[i].subkey)) {
+            res += sizeof(ERTIntKeyValue);
+        } else if (GET_ART_NODE_FLAG(entries[i].subkey)) {
+            res += artMemory((ERTIntArtNode *) entries[i].value, pos);
+        } else {
+            res += memory_profile((ERTIntNode *) entries[i].value, pos);
+        }
+    }
+    return res;
+}
+
+// copy-on-write counterpart of cowPath for a chain of art nodes starting at slot; returns the
+// hash node the path continues into (its slot address in beforeAddress) or NULL when done
+ERTIntNode *ERTInt::artCowPath(uint64_t key, ERTIntBucketKeyValue *slot, int &pos, uint64_t &beforeAddress,
+                               uint64_t now) {
+    while (true) {
+        ERTIntArtNode *node = (ERTIntArtNode *) slot->value;
+        if (node->version <= cow_epoch) {
+            ERTIntArtNode *newNode = static_cast<ERTIntArtNode *>(concurrency_fast_alloc(node->size(), true, ert_tag_art));
+            memcpy(newNode, node, node->size());
+            newNode->version = now;
+            clflush((char *) newNode, newNode->size());
+            slot->value = (uint64_t) newNode;
+            clflush((char *) &slot->value, 8);
+            snapshots->retire(node, node->size(), now, ert_tag_art);
+            node = newNode;
+        }
+        ERTIntBucketKeyValue *entry = node->find(GET_SUBKEY(key, pos * SIZE_OF_CHAR, ERT_NODE_LENGTH));
+        pos += ERT_NODE_LENGTH / SIZE_OF_CHAR;
+        if (entry == NULL || pos == ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+            return NULL;
+        }
+        if (GET_NODE_FLAG(entry->subkey)) {
+            ERTIntKeyValue *old_kv = (ERTIntKeyValue *) entry->value;
+            ERTIntKeyValue *kv = NewERTIntKeyValue(old_kv->key, old_kv->value);
+            clflush((char *) kv, sizeof(ERTIntKeyValue));
+            entry->value = (uint64_t) kv;
+            clflush((char *) &entry->value, 8);
+            snapshots->retire(old_kv, sizeof(ERTIntKeyValue), now, ert_tag_kv);
+            return NULL;
+        }
+        if (!GET_ART_NODE_FLAG(entry->subkey)) {
+            beforeAddress = (uint64_t) &entry->value;
+            return (ERTIntNode *) entry->value;
+        }
+        slot = entry;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef NVMKV_ERT_ART_INT_H
+#define NVMKV_ERT_ART_INT_H
+
+#include "ERT_node_int.h"
+
+/*
+ * Small adaptive node used by the hybrid ERT for low-fanout subtrees.
+ *
+ * A full ERTIntNode costs a directory plus a 16 KB segment even for two keys. In hybrid mode
+ * a collision below the root starts an ERTIntArtNode instead: like an ERTIntNode without
+ * prefix it consumes one ERT_NODE_LENGTH subkey, but its entries sit in one small unsorted
+ * array. It grows from 4 to 16 entries and is promoted to an ERTIntNode once a full 16-entry
+ * node receives another subkey. A parent slot pointing to it carries ERT_ART_NODE_FLAG.
+ *
+ * New entries are appended and then published by bumping num, so a crash never exposes a
+ * partially written entry; growing and promoting build the new node before swinging the
+ * parent slot.
+ */
+
+#define ERT_ART_NODE4 4
+#define ERT_ART_NODE16 16
+#define GET_ART_ENTRIES(currentNode) ((ERTIntBucketKeyValue *)((uint64_t)(currentNode) + sizeof(ERTIntArtNode)))
+
+class ERTIntArtNode {
+public:
+    unsigned char capacity;
+    unsigned char num;
+    // write epoch of the node, see ERT_snapshot_int.h
+    uint64_t version;
+
+    ERTIntBucketKeyValue *find(uint64_t subkey);
+
+    uint64_t get(uint64_t subkey, bool &keyValueFlag, bool &artNodeFlag);
+
+    uint64_t size();
+};
+
+ERTIntArtNode *NewERTIntArtNode(unsigned char capacity);
+
+#endif //NVMKV_ERT_ART_INT_H
@@ -0,0 +1,105 @@
+#include "ERT_int.h"
+
+inline void mfence(void) {
+    asm volatile("mfence":: :"memory");
+}
+
+inline void clflush(char *data, size_t len) {
+    volatile char *ptr = (char *) ((unsigned long) data & (~(CACHELINESIZE - 1)));
+    mfence();
+    for (; ptr < data + len; ptr += CACHELINESIZE) {
+        asm volatile("clflush %0" : "+m" (*(volatile char *) ptr));
+    }
+    pm_emulate_flush(pm_flush_line_num(data, len));
+    mfence();
+}
+
+void ERTIntBufferShard::lockShard() {
+    while (lock.exchange(true, std::memory_order_acquire)) {
+        asm volatile("pause");
+    }
+}
+
+void ERTIntBufferShard::unlockShard() {
+    lock.store(false, std::memory_order_release);
+}
+
+ERTIntWriteBuffer::ERTIntWriteBuffer(ERTIntBufferLog *logs) {
+    for (int i = 0; i < ERT_BUFFER_SHARD_NUM; ++i) {
+        shards[i].lock.store(false);
+        shards[i].log = &logs[i];
+    }
+}
+
+ERTIntBufferShard *ERTIntWriteBuffer::getShard(uint64_t key) {
+    return &shards[((key * 0x9E3779B97F4A7C15ULL) >> 32) % ERT_BUFFER_SHARD_NUM];
+}
+
+void ERTIntWriteBuffer::put(ERTInt *tree, uint64_t key, uint64_t value) {
+    ERTIntBufferShard *shard = getShard(key);
+    shard->lockShard();
+    if (shard->log->count == ERT_BUFFER_SHARD_SIZE) {
+        merge(tree, shard);
+    }
+    ERTIntKeyValue *kv = &shard->log->kvs[shard->log->count];
+    kv->key = key;
+    kv->value = value;
+    clflush((char *) kv, sizeof(ERTIntKeyValue));
+    shard->log->count++;
+    clflush((char *) &shard->log->count, sizeof(uint64_t));
+    shard->pending[key] = value;
+    shard->unlockShard();
+}
+
+bool ERTIntWriteBuffer::get(uint64_t key, uint64_t &value) {
+    ERTIntBufferShard *shard = getShard(key);
+    shard->lockShard();
+    auto it = shard->pending.find(key);
+    bool res = it != shard->pending.end();
+    if (res) {
+        value = it->second;
+    }
+    shard->unlockShard();
+    return res;
+}
+
+void ERTIntWriteBuffer::merge(ERTInt *tree, ERTIntBufferShard *shard) {
+    if (shard->pending.empty()) {
+        return;
+    }
+    vector<ERTIntKeyValue> batch;
+    batch.reserve(shard->pending.size());
+    for (auto &it : shard->pending) {
+        ERTIntKeyValue kv;
+        kv.key = it.first;
+        kv.value = it.second;
+        batch.push_back(kv);
+    }
+    tree->BulkInsert(batch);
+    // truncate only after the batch is persisted in the tree
+    shard->log->count = 0;
+    clflush((char *) &shard->log->count, sizeof(uint64_t));
+    shard->pending.clear();
+    merged_batches++;
+    merged_keys += batch.size();
+}
+
+void ERTIntWriteBuffer::flush(ERTInt *tree) {
+    for (int i = 0; i < ERT_BUFFER_SHARD_NUM; ++i) {
+        shards[i].lockShard();
+        merge(tree, &shards[i]);
+        shards[i].unlockShard();
+    }
+}
+
+void ERTIntWriteBuffer::recover() {
+    for (int i = 0; i < ERT_BUFFER_SHARD_NUM; ++i) {
+        ERTIntBufferShard &shard = shards[i];
+        shard.lock.store(false);
+        shard.pending.clear();
+        // later entries of the log win, as they did when they were inserted
+        for (uint64_t j = 0; j < shard.log->count; ++j) {
+            shard.pending[shard.log->kvs[j].key] = shard.log->kvs[j].value;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef NVMKV_ERT_BUFFER_INT_H
+#define NVMKV_ERT_BUFFER_INT_H
+
+#include "ERT_node_int.h"
+
+/*
+ * Write buffer absorbing bursts of ERTInt inserts.
+ *
+ * Inserts are hashed to a shard; each shard keeps a sorted DRAM map of pending pairs and an
+ * append-only log in the PM arena that makes them durable (value/key written and flushed
+ * before the persisted count covers them). A full shard is merged into the tree in key order
+ * through ERTInt::BulkInsert and its log truncated afterwards; replaying a log is idempotent,
+ * so a crash between the merge and the truncation loses nothing. The tree keeps the logs in
+ * ERTInt::buffer_logs, and OpenExtendibleRadixTreeInt rebuilds the buffer of a reopened tree
+ * from them.
+ */
+
+#define ERT_BUFFER_SHARD_NUM 16
+#define ERT_BUFFER_SHARD_SIZE 1024
+
+class ERTInt;
+
+class ERTIntBufferLog {
+public:
+    uint64_t count;
+    ERTIntKeyValue kvs[ERT_BUFFER_SHARD_SIZE];
+};
+
+class ERTIntBufferShard {
+public:
+    std::atomic<bool> lock;
+    map<uint64_t, uint64_t> pending;
+    ERTIntBufferLog *log;
+
+    void lockShard();
+
+    void unlockShard();
+};
+
+class ERTIntWriteBuffer {
+public:
+    ERTIntBufferShard shards[ERT_BUFFER_SHARD_NUM];
+    uint64_t merged_batches = 0;
+    uint64_t merged_keys = 0;
+
+    // shards over the ERT_BUFFER_SHARD_NUM logs at logs, whose entries stay pending until recover
+    ERTIntWriteBuffer(ERTIntBufferLog *logs);
+
+    ERTIntBufferShard *getShard(uint64_t key);
+
+    void put(ERTInt *tree, uint64_t key, uint64_t value);
+
+    bool get(uint64_t key, uint64_t &value);
+
+    // merge the shard into tree, the caller holds the shard lock
+    void merge(ERTInt *tree, ERTIntBufferShard *shard);
+
+    void flush(ERTInt *tree);
+
+    // rebuild the DRAM maps from the persistent logs
+    void recover();
+};
+
+#endif //NVMKV_ERT_BUFFER_INT_H
@@ -0,0 +1,110 @@
+#include <cstring>
+#include "ERT_cache_int.h"
+
+void ERTIntCache::init(uint64_t capacity) {
+    uint64_t set_num = 1;
+    while (set_num * ERT_CACHE_WAYS < capacity) {
+        set_num <<= 1;
+    }
+    set_mask = set_num - 1;
+    // the cache always lives in DRAM, whatever arena the tree uses
+    sets = static_cast<ERTIntCacheSet *>(concurrency_fast_alloc(sizeof(ERTIntCacheSet) * set_num, false, ert_tag_cache));
+    memset((void *) sets, 0, sizeof(ERTIntCacheSet) * set_num);
+    hits.store(0);
+    misses.store(0);
+}
+
+ERTIntCacheSet *ERTIntCache::getSet(uint64_t key) {
+    return &sets[(key * 0x9E3779B97F4A7C15ULL) >> 32 & set_mask];
+}
+
+bool ERTIntCache::get(uint64_t key, uint64_t &value, uint32_t &version) {
+    ERTIntCacheSet *set = getSet(key);
+    int way;
+    uint32_t before, after;
+    do {
+        before = set->version.load(std::memory_order_acquire);
+        way = -1;
+        value = 0;
+        for (int i = 0; i < ERT_CACHE_WAYS; ++i) {
+            if (set->key[i] == key && set->value[i] != 0) {
+                way = i;
+                value = set->value[i];
+                break;
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = set->version.load(std::memory_order_relaxed);
+    } while (before != after || (before & 1));
+    version = before;
+    if (way == -1) {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (!(set->ref.load(std::memory_order_relaxed) & (1 << way))) {
+        set->ref.fetch_or(1 << way, std::memory_order_relaxed);
+    }
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void ERTIntCache::fill(uint64_t key, uint64_t value, uint32_t version) {
+    if (value == 0) {
+        return;
+    }
+    ERTIntCacheSet *set = getSet(key);
+    // give up if the set changed since the lookup started, e.g. an insert invalidated it
+    if (!set->version.compare_exchange_strong(version, version + 1, std::memory_order_acquire)) {
+        return;
+    }
+    int way = -1;
+    for (int i = 0; i < ERT_CACHE_WAYS; ++i) {
+        if (set->value[i] == 0) {
+            way = i;
+            break;
+        }
+    }
+    while (way == -1) {
+        // CLOCK: clear reference bits until a way without one is found
+        uint8_t bit = 1 << set->hand;
+        if (set->ref.load(std::memory_order_relaxed) & bit) {
+            set->ref.fetch_and(~bit, std::memory_order_relaxed);
+        } else {
+            way = set->hand;
+        }
+        set->hand = (set->hand + 1) % ERT_CACHE_WAYS;
+    }
+    set->key[way] = key;
+    set->value[way] = value;
+    set->ref.fetch_and(~(1 << way), std::memory_order_relaxed);
+    set->version.store(version + 2, std::memory_order_release);
+}
+
+void ERTIntCache::invalidate(uint64_t key) {
+    ERTIntCacheSet *set = getSet(key);
+    uint32_t version;
+    do {
+        version = set->version.load(std::memory_order_relaxed) & ~1u;
+    } while (!set->version.compare_exchange_weak(version, version + 1, std::memory_order_acquire));
+    for (int i = 0; i < ERT_CACHE_WAYS; ++i) {
+        if (set->key[i] == key) {
+            set->value[i] = 0;
+        }
+    }
+    set->version.store(version + 2, std::memory_order_release);
+}
+
+double ERTIntCache::hitRatio() {
+    uint64_t total = hits.load() + misses.load();
+    return total == 0 ? 0 : (double) hits.load() / total;
+}
+
+uint64_t ERTIntCache::memory_profile() {
+    return sizeof(ERTIntCache) + sizeof(ERTIntCacheSet) * (set_mask + 1);
+}
+
+ERTIntCache *NewERTIntCache(uint64_t capacity) {
+    ERTIntCache *_new_cache = static_cast<ERTIntCache *>(concurrency_fast_alloc(sizeof(ERTIntCache), false, ert_tag_cache));
+    _new_cache->init(capacity);
+    return _new_cache;
+}
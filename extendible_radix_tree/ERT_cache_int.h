@@ -0,0 +1,54 @@
+#ifndef NVMKV_ERT_CACHE_INT_H
+#define NVMKV_ERT_CACHE_INT_H
+
+#include "ERT_node_int.h"
+
+/*
+ * DRAM lookaside cache for hot keys of a (PM resident) ERTInt.
+ *
+ * Set-associative, keyed by the full 64-bit key, with CLOCK eviction inside each set. A set is
+ * two cache lines; its version works as a seqlock: readers retry on a concurrent change,
+ * writers move it to odd while they modify the set. A fill only succeeds if the set version
+ * is still the one read before the tree lookup, so a fill racing with an invalidation is dropped.
+ * A value of 0 marks an empty way, matching Search returning 0 for a missing key.
+ */
+
+#define ERT_CACHE_WAYS 7
+
+class ERTIntCacheSet {
+public:
+    std::atomic<uint32_t> version;
+    // CLOCK reference bit per way
+    std::atomic<uint8_t> ref;
+    uint8_t hand;
+    uint64_t key[ERT_CACHE_WAYS];
+    uint64_t value[ERT_CACHE_WAYS];
+} __attribute__((aligned(64)));
+
+class ERTIntCache {
+public:
+    ERTIntCacheSet *sets;
+    uint64_t set_mask;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+    void init(uint64_t capacity);
+
+    ERTIntCacheSet *getSet(uint64_t key);
+
+    // returns true on a hit; otherwise version holds the set version to pass to fill()
+    bool get(uint64_t key, uint64_t &value, uint32_t &version);
+
+    void fill(uint64_t key, uint64_t value, uint32_t version);
+
+    void invalidate(uint64_t key);
+
+    double hitRatio();
+
+    uint64_t memory_profile();
+};
+
+// capacity is the number of cached keys, rounded up to a power of two number of sets
+ERTIntCache *NewERTIntCache(uint64_t capacity);
+
+#endif //NVMKV_ERT_CACHE_INT_H
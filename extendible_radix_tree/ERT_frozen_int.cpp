@@ -0,0 +1,289 @@
+#include <algorithm>
+#include "ERT_frozen_int.h"
+#include "ERT_art_int.h"
+
+#define ALIGN_8(x) (((x) + 7) & ~((uint64_t)7))
+
+uint64_t ERTIntFrozenNode::blockSize(uint32_t _dir_num, uint32_t _entry_num, uint32_t _leaf_num, int headerLen) {
+    uint64_t size = sizeof(ERTIntFrozenNode);
+    size += ALIGN_8(sizeof(uint32_t) * ((uint64_t) _dir_num + 1));
+    size += sizeof(ERTIntBucketKeyValue) * _entry_num;
+    size += sizeof(ERTIntKeyValue) * _leaf_num;
+    if (headerLen) {
+        size += sizeof(ERTIntKeyValue) * ERT_FROZEN_VALUES_NUM(headerLen);
+    }
+    return size;
+}
+
+uint64_t ERTIntFrozenNode::get(uint64_t subkey, bool &keyValueFlag) {
+    uint64_t dir_index = (subkey >> dir_shift) - dir_base;
+    if (dir_index >= dir_num) {
+        return 0;
+    }
+    uint32_t *dir = GET_FROZEN_DIR_POS(this, 0);
+    for (uint32_t i = dir[dir_index]; i < dir[dir_index + 1]; ++i) {
+        if (subkey == REMOVE_NODE_FLAG(entries[i].subkey)) {
+            keyValueFlag = GET_NODE_FLAG(entries[i].subkey);
+            return entries[i].value;
+        }
+    }
+    return 0;
+}
+
+// index only [min subkey, max subkey], with about ERT_FROZEN_SLOT_SIZE entries per slot
+static void frozenDirShape(vector<ERTIntBucketKeyValue> &entries, unsigned char &dirShift, uint32_t &dirBase,
+                           uint32_t &dirNum) {
+    dirShift = 0;
+    dirBase = 0;
+    dirNum = 1;
+    if (entries.empty()) {
+        return;
+    }
+    uint64_t target = entries.size() / ERT_FROZEN_SLOT_SIZE;
+    target = target == 0 ? 1 : (target > ERT_FROZEN_MAX_DIR_NUM ? ERT_FROZEN_MAX_DIR_NUM : target);
+    uint64_t min = REMOVE_NODE_FLAG(entries.front().subkey), max = REMOVE_NODE_FLAG(entries.back().subkey);
+    while ((max >> dirShift) - (min >> dirShift) + 1 > target) {
+        dirShift++;
+    }
+    dirBase = min >> dirShift;
+    dirNum = (max >> dirShift) - dirBase + 1;
+}
+
+static int frozenHeaderLen(ERTIntNode *node, bool art) {
+    // a header length above ERT_NODE_PREFIX_MAX_BYTES marks a node that never received a prefix
+    if (art || node->header.len > ERT_NODE_PREFIX_MAX_BYTES) {
+        return 0;
+    }
+    return node->header.len;
+}
+
+// collect the live entries of a mutable node, skipping duplicated directory slots and the
+// stale copies segment splits leave behind, sorted by subkey. art marks an ERTIntArtNode.
+static void frozenCollect(ERTIntNode *node, bool art, vector<ERTIntBucketKeyValue> &res) {
+    if (art) {
+        ERTIntArtNode *artNode = (ERTIntArtNode *) node;
+        ERTIntBucketKeyValue *entries = GET_ART_ENTRIES(artNode);
+        res.assign(entries, entries + artNode->num);
+    } else {
+        ERTIntSegment *last_seg = NULL;
+        for (uint32_t i = 0; i < node->dir_size; i++) {
+            ERTIntSegment *tmp_seg = *(ERTIntSegment **) GET_SEG_POS(node, i);
+            if (tmp_seg == last_seg)
+                continue;
+            last_seg = tmp_seg;
+            for (int j = 0; j < ERT_MAX_BUCKET_NUM; j++) {
+                for (int k = 0; k < ERT_BUCKET_SIZE; k++) {
+                    ERTIntBucketKeyValue &item = tmp_seg->bucket[j].counter[k];
+                    uint64_t curSubkey = REMOVE_NODE_FLAG(item.subkey);
+                    if (item.subkey == 0 && item.value == 0) {
+                        continue;
+                    }
+                    if (tmp_seg != *(ERTIntSegment **) GET_SEG_POS(node, GET_SEG_NUM(curSubkey, ERT_NODE_LENGTH,
+                                                                                      node->global_depth))) {
+                        continue;
+                    }
+                    res.push_back(item);
+                }
+            }
+        }
+    }
+    sort(res.begin(), res.end(), [](const ERTIntBucketKeyValue &a, const ERTIntBucketKeyValue &b) {
+        return REMOVE_NODE_FLAG(a.subkey) < REMOVE_NODE_FLAG(b.subkey);
+    });
+}
+
+static uint64_t frozenSize(ERTIntNode *node, bool art, int pos) {
+    vector<ERTIntBucketKeyValue> entries;
+    frozenCollect(node, art, entries);
+    int headerLen = frozenHeaderLen(node, art);
+    pos += headerLen + ERT_NODE_LENGTH / SIZE_OF_CHAR;
+    uint64_t res = 0;
+    uint32_t leafNum = 0;
+    if (pos < ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+        for (auto &item : entries) {
+            if (GET_NODE_FLAG(item.subkey)) {
+                leafNum++;
+            } else {
+                res += frozenSize((ERTIntNode *) item.value, GET_ART_NODE_FLAG(item.subkey), pos);
+            }
+        }
+    }
+    unsigned char dirShift;
+    uint32_t dirBase, dirNum;
+    frozenDirShape(entries, dirShift, dirBase, dirNum);
+    return res + ERTIntFrozenNode::blockSize(dirNum, entries.size(), leafNum, headerLen);
+}
+
+// copy node into the block at cursor, then lay its children out right after it (DFS order)
+static ERTIntFrozenNode *frozenLayout(ERTIntNode *node, bool art, int pos, char *&cursor) {
+    vector<ERTIntBucketKeyValue> entries;
+    frozenCollect(node, art, entries);
+    int headerLen = frozenHeaderLen(node, art);
+    pos += headerLen + ERT_NODE_LENGTH / SIZE_OF_CHAR;
+    bool lastLevel = pos >= ERT_KEY_LENGTH / SIZE_OF_CHAR;
+
+    uint32_t leafNum = 0;
+    if (!lastLevel) {
+        for (auto &item : entries) {
+            if (GET_NODE_FLAG(item.subkey)) {
+                leafNum++;
+            }
+        }
+    }
+    unsigned char dirShift;
+    uint32_t dirBase, dirNum;
+    frozenDirShape(entries, dirShift, dirBase, dirNum);
+
+    ERTIntFrozenNode *res = (ERTIntFrozenNode *) cursor;
+    cursor += ERTIntFrozenNode::blockSize(dirNum, entries.size(), leafNum, headerLen);
+    res->header = art ? ERTIntHeader() : node->header;
+    res->header.len = headerLen;
+    res->dir_shift = dirShift;
+    res->dir_base = dirBase;
+    res->dir_num = dirNum;
+    res->entry_num = entries.size();
+    res->leaf_num = leafNum;
+    res->entries = (ERTIntBucketKeyValue *) ((char *) res + sizeof(ERTIntFrozenNode) +
+                                             ALIGN_8(sizeof(uint32_t) * (dirNum + 1)));
+    ERTIntKeyValue *leaves = (ERTIntKeyValue *) (res->entries + res->entry_num);
+    res->treeNodeValues = NULL;
+    if (headerLen) {
+        res->treeNodeValues = leaves + leafNum;
+        for (int i = 0; i < ERT_FROZEN_VALUES_NUM(headerLen); i++) {
+            res->treeNodeValues[i] = node->treeNodeValues[i];
+        }
+    }
+
+    uint32_t *dir = GET_FROZEN_DIR_POS(res, 0);
+    uint32_t dir_index = 0;
+    leafNum = 0;
+    for (uint32_t i = 0; i < res->entry_num; i++) {
+        uint64_t curSubkey = REMOVE_NODE_FLAG(entries[i].subkey);
+        while (dir_index <= (curSubkey >> dirShift) - dirBase) {
+            dir[dir_index++] = i;
+        }
+        // frozen children are all ERTIntFrozenNode, whatever they were in the mutable tree
+        res->entries[i].subkey = entries[i].subkey & ~ERT_ART_NODE_FLAG;
+        if (lastLevel) {
+            res->entries[i].value = entries[i].value;
+        } else if (GET_NODE_FLAG(entries[i].subkey)) {
+            leaves[leafNum] = *(ERTIntKeyValue *) entries[i].value;
+            res->entries[i].value = (uint64_t) &leaves[leafNum++];
+        } else {
+            res->entries[i].value = (uint64_t) frozenLayout((ERTIntNode *) entries[i].value,
+                                                              GET_ART_NODE_FLAG(entries[i].subkey), pos, cursor);
+        }
+    }
+    while (dir_index <= dirNum) {
+        dir[dir_index++] = res->entry_num;
+    }
+    return res;
+}
+
+uint64_t ERTIntFrozen::Search(uint64_t key) {
+    auto currentNode = root;
+    if (currentNode == NULL) {
+        return 0;
+    }
+    int pos = 0;
+    while (pos < ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+        if (currentNode->header.len) {
+            if (ERT_KEY_LENGTH / SIZE_OF_CHAR - pos <= currentNode->header.len) {
+                ERTIntKeyValue &kv = currentNode->treeNodeValues[currentNode->header.len -
+                                                                 ERT_KEY_LENGTH / SIZE_OF_CHAR + pos];
+                return kv.key == key ? kv.value : 0;
+            }
+            unsigned char *array = currentNode->header.array;
+            uint64_t subkey = GET_SUBKEY(key, pos * SIZE_OF_CHAR, currentNode->header.len * SIZE_OF_CHAR);
+            for (int i = currentNode->header.len - 1; i >= 0; i--, subkey >>= SIZE_OF_CHAR) {
+                if ((subkey & 0xff) != array[i]) {
+                    return 0;
+                }
+            }
+            pos += currentNode->header.len;
+        }
+        uint64_t subkey = GET_SUBKEY(key, pos * SIZE_OF_CHAR, ERT_NODE_LENGTH);
+        bool keyValueFlag = false;
+        auto next = currentNode->get(subkey, keyValueFlag);
+        pos += ERT_NODE_LENGTH / SIZE_OF_CHAR;
+        if (next == 0) {
+            return 0;
+        }
+        if (keyValueFlag) {
+            if (pos == ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+                return next;
+            }
+            // leaves are inlined in the node block
+            return key == ((ERTIntKeyValue *) next)->key ? ((ERTIntKeyValue *) next)->value : 0;
+        }
+        currentNode = (ERTIntFrozenNode *) next;
+    }
+    return 0;
+}
+
+uint64_t ERTIntFrozen::scan(uint64_t left, uint64_t right) {
+    vector<ERTIntKeyValue> res;
+    nodeScan(root, left, right, res, 0);
+    return res.size();
+}
+
+// pos and prefix count bytes of the key consumed above tmp; results come out in key order
+void ERTIntFrozen::nodeScan(ERTIntFrozenNode *tmp, uint64_t left, uint64_t right, vector<ERTIntKeyValue> &res,
+                            int pos, uint64_t prefix) {
+    if (unlikely(tmp == NULL)) {
+        tmp = root;
+    }
+    if (tmp->header.len) {
+        for (int i = 0; i < ERT_FROZEN_VALUES_NUM(tmp->header.len); i++) {
+            ERTIntKeyValue &kv = tmp->treeNodeValues[i];
+            if (kv.value != 0 && kv.key >= left && kv.key <= right) {
+                res.push_back(kv);
+            }
+        }
+        for (int i = 0; i < tmp->header.len; i++) {
+            prefix = (prefix << SIZE_OF_CHAR) | tmp->header.array[i];
+        }
+        pos += tmp->header.len;
+    }
+    pos += ERT_NODE_LENGTH / SIZE_OF_CHAR;
+    int shift = ERT_KEY_LENGTH - pos * SIZE_OF_CHAR;
+    for (uint32_t i = 0; i < tmp->entry_num; i++) {
+        uint64_t curPrefix = (prefix << ERT_NODE_LENGTH) | REMOVE_NODE_FLAG(tmp->entries[i].subkey);
+        // [lo, hi] is the key range covered by this entry
+        uint64_t lo = curPrefix << shift;
+        uint64_t hi = lo | (((uint64_t) 1 << shift) - 1);
+        if (hi < left) {
+            continue;
+        }
+        if (lo > right) {
+            break;
+        }
+        uint64_t value = tmp->entries[i].value;
+        if (pos == ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+            ERTIntKeyValue kv;
+            kv.key = lo;
+            kv.value = value;
+            res.push_back(kv);
+        } else if (GET_NODE_FLAG(tmp->entries[i].subkey)) {
+            ERTIntKeyValue &kv = *(ERTIntKeyValue *) value;
+            if (kv.key >= left && kv.key <= right) {
+                res.push_back(kv);
+            }
+        } else {
+            nodeScan((ERTIntFrozenNode *) value, left, right, res, pos, curPrefix);
+        }
+    }
+}
+
+uint64_t ERTIntFrozen::memory_profile() {
+    return region_size + sizeof(ERTIntFrozen);
+}
+
+ERTIntFrozen *NewERTIntFrozen(ERTIntNode *root) {
+    ERTIntFrozen *_new_frozen = static_cast<ERTIntFrozen *>(concurrency_fast_alloc(sizeof(ERTIntFrozen), true, ert_tag_frozen));
+    _new_frozen->region_size = frozenSize(root, false, 0);
+    _new_frozen->region = static_cast<char *>(concurrency_fast_alloc(_new_frozen->region_size, true, ert_tag_frozen));
+    char *cursor = _new_frozen->region;
+    _new_frozen->root = frozenLayout(root, false, 0, cursor);
+    return _new_frozen;
+}
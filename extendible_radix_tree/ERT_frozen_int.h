@@ -0,0 +1,68 @@
+#ifndef NVMKV_ERT_FROZEN_INT_H
+#define NVMKV_ERT_FROZEN_INT_H
+
+#include "ERT_node_int.h"
+
+/*
+ * Immutable, read-optimized copy of an ERTInt produced by ERTInt::Freeze().
+ *
+ * Every node is one block inside a single contiguous region, laid out in DFS order:
+ *
+ *   [ERTIntFrozenNode][dir: uint32 * (dir_num + 1)][entries: ERTIntBucketKeyValue * entry_num]
+ *   [inlined leaves: ERTIntKeyValue * leaf_num][treeNodeValues: ERTIntKeyValue * values]
+ *
+ * The directory holds no duplicated segment pointers: entries are sorted by subkey and only the
+ * subkey range actually used by the node is indexed, dir[i] being the first entry with
+ * (subkey >> dir_shift) - dir_base >= i, so a lookup probes the entries in [dir[i], dir[i + 1]).
+ * Entries use the same flag encoding as ERTIntBucketKeyValue, except that a kv flagged value
+ * points to a leaf inlined in the same block. A node with a prefix copies the values of keys
+ * ending inside it, ERT_FROZEN_VALUES_NUM(header.len) of them, as many as the mutable node has.
+ */
+
+// target number of entries probed per directory slot
+#define ERT_FROZEN_SLOT_SIZE 4
+#define ERT_FROZEN_MAX_DIR_NUM (1 << 20)
+#define ERT_FROZEN_VALUES_NUM(headerLen) \
+    ((headerLen) + 1 < ERT_TREE_NODE_VALUES_NUM ? (headerLen) + 1 : ERT_TREE_NODE_VALUES_NUM)
+#define GET_FROZEN_DIR_POS(currentNode, dir_index) ((uint32_t *)((uint64_t)(currentNode) + sizeof(ERTIntFrozenNode)) + (dir_index))
+
+class ERTIntFrozenNode {
+public:
+    ERTIntHeader header;
+    unsigned char dir_shift = 0;
+    uint32_t dir_base = 0;
+    uint32_t dir_num = 1;
+    uint32_t entry_num = 0;
+    uint32_t leaf_num = 0;
+    ERTIntBucketKeyValue *entries;
+    // NULL when the node holds no prefix values
+    ERTIntKeyValue *treeNodeValues;
+
+    uint64_t get(uint64_t subkey, bool &keyValueFlag);
+
+    // size in bytes of a node block holding _entry_num entries and _leaf_num inlined leaves
+    static uint64_t blockSize(uint32_t _dir_num, uint32_t _entry_num, uint32_t _leaf_num, int headerLen);
+};
+
+class ERTIntFrozen {
+public:
+    ERTIntFrozenNode *root = NULL;
+    char *region = NULL;
+    uint64_t region_size = 0;
+
+    uint64_t Search(uint64_t key);
+
+    // number of keys in [left, right]
+    uint64_t scan(uint64_t left, uint64_t right);
+
+    void nodeScan(ERTIntFrozenNode *tmp, uint64_t left, uint64_t right, vector<ERTIntKeyValue> &res, int pos = 0,
+                  uint64_t prefix = 0);
+
+    uint64_t memory_profile();
+};
+
+class ERTIntNode;
+
+ERTIntFrozen *NewERTIntFrozen(ERTIntNode *root);
+
+#endif //NVMKV_ERT_FROZEN_INT_H
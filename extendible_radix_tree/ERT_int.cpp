@@ -1,3 +1,4 @@
+#include <cstring>
 #include "ERT_int.h"
 
 /*
@@ -21,6 +22,7 @@ inline void clflush(char *data, size_t len) {
     for (; ptr < data + len; ptr += CACHELINESIZE) {
         asm volatile("clflush %0" : "+m" (*(volatile char *) ptr));
     }
+    pm_emulate_flush(pm_flush_line_num(data, len));
     mfence();
 }
 
@@ -43,15 +45,24 @@ bool isSame(unsigned char *key1, uint64_t key2, int pos, int length) {
 void ERTInt::Insert(uint64_t key, uint64_t value, ERTIntNode *_node, int len) {
     // 0-index of current bytes
 
-    // 有传入节点则使用传入的，没有则使用root节点
-    ERTIntNode *currentNode = _node;
     if (_node == NULL) {
-        currentNode = root;
+        if (buffer != NULL) {
+            buffer->put(this, key, value);
+            return;
+        }
+        lockWriter();
+        insertLocked(key, value);
+        unlockWriter();
+        return;
     }
+    nodeInsert(key, value, _node, len, (uint64_t) &root);
+}
+
+void ERTInt::nodeInsert(uint64_t key, uint64_t value, ERTIntNode *_node, int len, uint64_t beforeAddress) {
+    // 有传入节点则使用传入的，没有则使用root节点
+    ERTIntNode *currentNode = _node;
     // 基数树深度，即树高？
     unsigned char headerDepth = currentNode->header.depth;
-    // 默认根节点指向当前节点？
-    uint64_t beforeAddress = (uint64_t) &root;
 
     // 最初传入的len默认是0
     while (len < ERT_KEY_LENGTH / SIZE_OF_CHAR) {
@@ -107,7 +118,7 @@ void ERTInt::Insert(uint64_t key, uint64_t value, ERTIntNode *_node, int len) {
             bool keyValueFlag = false;
             uint64_t beforeA;
             for (i = 0; i < ERT_BUCKET_SIZE; ++i) {
-                if (subkey == REMOVE_NODE_FLAG(tmp_bucket->counter[i].subkey)) {
+                if (subkey == REMOVE_NODE_FLAG(tmp_bucket->counter[i].subkey) && tmp_bucket->counter[i].value != 0) {
                     // bucket中找到了匹配的子key，取得对应value
                     next = tmp_bucket->counter[i].value;
                     keyValueFlag = GET_NODE_FLAG(tmp_bucket->counter[i].subkey);
@@ -121,7 +132,7 @@ void ERTInt::Insert(uint64_t key, uint64_t value, ERTIntNode *_node, int len) {
                 if (next == 0) {
                     // next==0表示 subkey对应的bucket中没有找到，当前节点插入subkey
                     currentNode->put(subkey, (uint64_t) value, tmp_seg, tmp_bucket, dir_index, seg_index,
-                                     beforeAddress);
+                                     beforeAddress, ERT_KEY_VALUE_FLAG, this);
                     return;
                 } else {
                     // 找到了subkey，覆盖写入并持久化
@@ -140,7 +151,8 @@ void ERTInt::Insert(uint64_t key, uint64_t value, ERTIntNode *_node, int len) {
                     // bucket里也没找到，subkey无冲突，直接构建kv持久化，并加入到当前节点bucket中。
                     ERTIntKeyValue *kv = NewERTIntKeyValue(key, value);
                     clflush((char *) kv, sizeof(ERTIntKeyValue));
-                    currentNode->put(subkey, (uint64_t) kv, tmp_seg, tmp_bucket, dir_index, seg_index, beforeAddress);
+                    currentNode->put(subkey, (uint64_t) kv, tmp_seg, tmp_bucket, dir_index, seg_index, beforeAddress,
+                                     ERT_KEY_VALUE_FLAG, this);
                     return;
                 } else {
                     // 没达到key长度，keyValueFlag 表示bucket中已经有subkey前缀，表示冲突了需要解决
@@ -154,16 +166,28 @@ void ERTInt::Insert(uint64_t key, uint64_t value, ERTIntNode *_node, int len) {
                             ((ERTIntKeyValue *) next)->value = value;
                             clflush((char *) &(((ERTIntKeyValue *) next)->value), 8);
                             return;
+                        } else if (hybrid) {
+                            // low fanout so far: start the subtree as a small art node
+                            ERTIntArtNode *newNode = NewERTIntArtNode(ERT_ART_NODE4);
+                            artInsert(prekey, prevalue, newNode, len, NULL);
+                            artInsert(key, value, newNode, len, NULL);
+                            tmp_bucket->counter[i].subkey = PUT_ART_NODE_FLAG(
+                                    REMOVE_NODE_FLAG(tmp_bucket->counter[i].subkey));
+                            tmp_bucket->counter[i].value = (uint64_t) newNode;
+                            clflush((char *) &tmp_bucket->counter[i], sizeof(ERTIntBucketKeyValue));
+                            // the old leaf was copied into the new subtree
+                            retire((void *) next, sizeof(ERTIntKeyValue), ert_tag_kv);
+                            return;
                         } else {
                             //not same key: needs to create a new node
                             // 插入key不同，则构建新节点，并将原来的kv和新的kv都加入到节点中
                             ERTIntNode *newNode = NewERTIntNode(ERT_NODE_LENGTH, headerDepth + 1);
 
                             // put pre kv
-                            Insert(prekey, prevalue, newNode, len);
+                            nodeInsert(prekey, prevalue, newNode, len, (uint64_t) &newNode);
 
                             // put new kv
-                            Insert(key, value, newNode, len);
+                            nodeInsert(key, value, newNode, len, (uint64_t) &newNode);
 
                             clflush((char *) newNode, sizeof(ERTIntNode));
 
@@ -172,8 +196,12 @@ void ERTInt::Insert(uint64_t key, uint64_t value, ERTIntNode *_node, int len) {
                             tmp_bucket->counter[i].subkey = REMOVE_NODE_FLAG(tmp_bucket->counter[i].subkey);
                             tmp_bucket->counter[i].value = (uint64_t) newNode;
                             clflush((char *) &tmp_bucket->counter[i].value, 8);
+                            retire((void *) next, sizeof(ERTIntKeyValue), ert_tag_kv);
                             return;
                         }
+                    } else if (GET_ART_NODE_FLAG(tmp_bucket->counter[i].subkey)) {
+                        artInsert(key, value, (ERTIntArtNode *) next, len, &tmp_bucket->counter[i]);
+                        return;
                     } else {
                         // next is next extendible hash
                         // next是节点，则在节点中再递归处理，这里结束后重新进入循环
@@ -232,18 +260,53 @@ void ERTInt::Insert(uint64_t key, uint64_t value, ERTIntNode *_node, int len) {
     }
 }
 
-uint64_t ERTInt::Search(uint64_t key) {
-    auto currentNode = root;
+void ERTInt::insertLocked(uint64_t key, uint64_t value) {
+    if (unlikely(cow_epoch != 0)) {
+        cowPath(key);
+    }
+    nodeInsert(key, value, root, 0, (uint64_t) &root);
+    if (cache != NULL) {
+        cache->invalidate(key);
+    }
+}
+
+void ERTInt::BulkInsert(vector<ERTIntKeyValue> &kvs) {
+    lockWriter();
+    for (auto &kv : kvs) {
+        insertLocked(kv.key, kv.value);
+    }
+    unlockWriter();
+}
+
+uint64_t ERTInt::Search(uint64_t key, ERTIntNode *_node) {
+    uint64_t value;
+    if (buffer != NULL && _node == NULL && buffer->get(key, value)) {
+        return value;
+    }
+    if (cache == NULL || _node != NULL) {
+        return nodeSearch(key, _node == NULL ? root : _node);
+    }
+    uint32_t version;
+    if (cache->get(key, value, version)) {
+        return value;
+    }
+    value = nodeSearch(key, root);
+    cache->fill(key, value, version);
+    return value;
+}
+
+uint64_t ERTInt::nodeSearch(uint64_t key, ERTIntNode *_node, int pos) {
+    auto currentNode = _node;
     if (currentNode == NULL) {
         return 0;
     }
-    int pos = 0;
     while (pos < ERT_KEY_LENGTH / SIZE_OF_CHAR) {
         if (currentNode->header.len) {
             if (ERT_KEY_LENGTH / SIZE_OF_CHAR - pos <= currentNode->header.len) {
-                // TODO（chen） ERT_KEY_LENGTH 不需要除以 SIZE_OF_CHAR 吗？
-                if (currentNode->treeNodeValues[currentNode->header.len - ERT_KEY_LENGTH + pos].key == key) {
-                    return (uint64_t) currentNode->treeNodeValues[currentNode->header.len - ERT_KEY_LENGTH + pos].value;
+                ERTIntKeyValue &kv = currentNode->treeNodeValues[currentNode->header.len -
+                                                                 ERT_KEY_LENGTH / SIZE_OF_CHAR + pos];
+                if (kv.key == key) {
+                    return kv.value;
                 } else {
                     return 0;
                 }
@@ -259,8 +322,8 @@ uint64_t ERTInt::Search(uint64_t key) {
         // currentNode->get方法: dir -> segment -> bucket -> item
         // uint64_t subkey = GET_16BITS(key,pos);
         uint64_t subkey = GET_SUBKEY(key, pos * SIZE_OF_CHAR, ERT_NODE_LENGTH);
-        bool keyValueFlag = false;
-        auto next = currentNode->get(subkey, keyValueFlag);
+        bool keyValueFlag = false, artNodeFlag = false;
+        auto next = currentNode->get(subkey, keyValueFlag, artNodeFlag);
         // pos+=_16_BITS_OF_BYTES;
         // pos跳过subkey的长度（所以每个节点跳过 前缀+subkey 长度？）
         pos += _32_BITS_OF_BYTES;
@@ -282,6 +345,8 @@ uint64_t ERTInt::Search(uint64_t key) {
                     return 0;
                 }
             }
+        } else if (artNodeFlag) {
+            return artSearch(key, (ERTIntArtNode *) next, pos);
         } else {
             // bucket找到的next指向新节点，那么在新节点中继续寻找。pos前面已经更新过了。
             currentNode = (ERTIntNode *) next;
@@ -290,26 +355,199 @@ uint64_t ERTInt::Search(uint64_t key) {
     return 0;
 }
 
+bool ERTInt::Remove(uint64_t key) {
+    // a buffered insert of key must not reappear after the delete
+    FlushWriteBuffer();
+    lockWriter();
+    if (unlikely(cow_epoch != 0)) {
+        cowPath(key);
+    }
+    bool found = nodeRemove(key, root);
+    if (cache != NULL) {
+        cache->invalidate(key);
+    }
+    unlockWriter();
+    return found;
+}
+
+// walks like nodeSearch; a cleared slot has subkey and value 0, the empty state findPlace reuses
+bool ERTInt::nodeRemove(uint64_t key, ERTIntNode *_node, int pos) {
+    auto currentNode = _node;
+    while (currentNode != NULL && pos < ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+        if (currentNode->header.len) {
+            if (ERT_KEY_LENGTH / SIZE_OF_CHAR - pos <= currentNode->header.len) {
+                ERTIntKeyValue *kv = &currentNode->treeNodeValues[currentNode->header.len -
+                                                                  ERT_KEY_LENGTH / SIZE_OF_CHAR + pos];
+                if (kv->key != key) {
+                    return false;
+                }
+                kv->value = 0;
+                clflush((char *) &kv->value, 8);
+                return true;
+            }
+            if (!isSame((unsigned char *) currentNode->header.array, key, pos * SIZE_OF_CHAR,
+                        currentNode->header.len * SIZE_OF_CHAR)) {
+                return false;
+            }
+            pos += currentNode->header.len;
+        }
+        uint64_t subkey = GET_SUBKEY(key, pos * SIZE_OF_CHAR, ERT_NODE_LENGTH);
+        uint64_t dir_index = GET_SEG_NUM(subkey, ERT_NODE_LENGTH, currentNode->global_depth);
+        ERTIntSegment *tmp_seg = *(ERTIntSegment **) GET_SEG_POS(currentNode, dir_index);
+        ERTIntBucket *tmp_bucket = &(tmp_seg->bucket[GET_BUCKET_NUM(subkey, ERT_BUCKET_MASK_LEN)]);
+        ERTIntBucketKeyValue *item = NULL;
+        for (int i = 0; i < ERT_BUCKET_SIZE; ++i) {
+            if (subkey == REMOVE_NODE_FLAG(tmp_bucket->counter[i].subkey) && tmp_bucket->counter[i].value != 0) {
+                item = &tmp_bucket->counter[i];
+                break;
+            }
+        }
+        pos += _32_BITS_OF_BYTES;
+        if (item == NULL || item->value == 0) {
+            return false;
+        }
+        if (GET_NODE_FLAG(item->subkey)) {
+            ERTIntKeyValue *kv = NULL;
+            if (pos != ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+                kv = (ERTIntKeyValue *) item->value;
+                if (kv->key != key) {
+                    return false;
+                }
+            }
+            item->value = 0;
+            item->subkey = 0;
+            clflush((char *) item, sizeof(ERTIntBucketKeyValue));
+            if (kv != NULL) {
+                retire(kv, sizeof(ERTIntKeyValue), ert_tag_kv);
+            }
+            return true;
+        }
+        if (GET_ART_NODE_FLAG(item->subkey)) {
+            return artRemove(key, (ERTIntArtNode *) item->value, pos);
+        }
+        currentNode = (ERTIntNode *) item->value;
+    }
+    return false;
+}
+
+void ERTInt::cowPath(uint64_t key) {
+    uint64_t now = ert_write_epoch.load(std::memory_order_relaxed);
+    uint64_t beforeAddress = (uint64_t) &root;
+    ERTIntNode *currentNode = root;
+    int pos = 0;
+    while (pos < ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+        if (currentNode->version <= cow_epoch) {
+            uint64_t nodeSize = sizeof(ERTIntNode) + sizeof(ERTIntSegment *) * currentNode->dir_size;
+            ERTIntNode *newNode = static_cast<ERTIntNode *>(concurrency_fast_alloc(nodeSize, true, ert_tag_node));
+            memcpy(newNode, currentNode, nodeSize);
+            newNode->version = now;
+            if (currentNode->treeNodeValues != NULL) {
+                newNode->treeNodeValues = static_cast<ERTIntKeyValue *>(concurrency_fast_alloc(
+                        sizeof(ERTIntKeyValue) * ERT_TREE_NODE_VALUES_NUM, true, ert_tag_values));
+                memcpy(newNode->treeNodeValues, currentNode->treeNodeValues,
+                       sizeof(ERTIntKeyValue) * ERT_TREE_NODE_VALUES_NUM);
+                clflush((char *) newNode->treeNodeValues, sizeof(ERTIntKeyValue) * ERT_TREE_NODE_VALUES_NUM);
+                snapshots->retire(currentNode->treeNodeValues, sizeof(ERTIntKeyValue) * ERT_TREE_NODE_VALUES_NUM,
+                                  now, ert_tag_values);
+            }
+            clflush((char *) newNode, nodeSize);
+            *(ERTIntNode **) beforeAddress = newNode;
+            clflush((char *) beforeAddress, sizeof(ERTIntNode *));
+            snapshots->retire(currentNode, nodeSize, now, ert_tag_node);
+            currentNode = newNode;
+        }
+        if (currentNode->header.len) {
+            if (ERT_KEY_LENGTH / SIZE_OF_CHAR - pos <= currentNode->header.len) {
+                return;
+            }
+            if (!isSame((unsigned char *) currentNode->header.array, key, pos * SIZE_OF_CHAR,
+                        currentNode->header.len * SIZE_OF_CHAR)) {
+                return;
+            }
+            pos += currentNode->header.len;
+        }
+        uint64_t subkey = GET_SUBKEY(key, pos * SIZE_OF_CHAR, ERT_NODE_LENGTH);
+        uint64_t dir_index = GET_SEG_NUM(subkey, ERT_NODE_LENGTH, currentNode->global_depth);
+        ERTIntSegment *tmp_seg = *(ERTIntSegment **) GET_SEG_POS(currentNode, dir_index);
+        if (tmp_seg->version <= cow_epoch) {
+            // every directory slot pointing to the shared segment moves to the copy
+            ERTIntSegment *new_seg = NewERTIntSegment(tmp_seg->depth);
+            memcpy(new_seg->bucket, tmp_seg->bucket, sizeof(ERTIntBucket) * ERT_MAX_BUCKET_NUM);
+            clflush((char *) new_seg->bucket, sizeof(ERTIntBucket) * ERT_MAX_BUCKET_NUM);
+            clflush((char *) new_seg, sizeof(ERTIntSegment));
+            int64_t stride = pow(2, currentNode->global_depth - tmp_seg->depth);
+            int64_t left = dir_index - dir_index % stride;
+            for (int64_t i = left; i < left + stride; ++i) {
+                *(ERTIntSegment **) GET_SEG_POS(currentNode, i) = new_seg;
+            }
+            clflush((char *) GET_SEG_POS(currentNode, left), sizeof(ERTIntSegment *) * stride);
+            snapshots->retire(tmp_seg->bucket, sizeof(ERTIntBucket) * ERT_MAX_BUCKET_NUM, now, ert_tag_bucket);
+            snapshots->retire(tmp_seg, sizeof(ERTIntSegment), now, ert_tag_segment);
+            tmp_seg = new_seg;
+        }
+        ERTIntBucket *tmp_bucket = &(tmp_seg->bucket[GET_BUCKET_NUM(subkey, ERT_BUCKET_MASK_LEN)]);
+        ERTIntBucketKeyValue *item = NULL;
+        for (int i = 0; i < ERT_BUCKET_SIZE; ++i) {
+            if (subkey == REMOVE_NODE_FLAG(tmp_bucket->counter[i].subkey) && tmp_bucket->counter[i].value != 0) {
+                item = &tmp_bucket->counter[i];
+                break;
+            }
+        }
+        pos += _32_BITS_OF_BYTES;
+        if (item == NULL || pos == ERT_KEY_LENGTH / SIZE_OF_CHAR) {
+            return;
+        }
+        if (GET_NODE_FLAG(item->subkey)) {
+            // a single-key leaf may be updated in place by Insert, so give it a private copy
+            ERTIntKeyValue *old_kv = (ERTIntKeyValue *) item->value;
+            ERTIntKeyValue *kv = NewERTIntKeyValue(old_kv->key, old_kv->value);
+            clflush((char *) kv, sizeof(ERTIntKeyValue));
+            item->value = (uint64_t) kv;
+            clflush((char *) &item->value, 8);
+            snapshots->retire(old_kv, sizeof(ERTIntKeyValue), now, ert_tag_kv);
+            return;
+        }
+        if (GET_ART_NODE_FLAG(item->subkey)) {
+            currentNode = artCowPath(key, item, pos, beforeAddress, now);
+            if (currentNode == NULL) {
+                return;
+            }
+            continue;
+        }
+        beforeAddress = (uint64_t) &item->value;
+        currentNode = (ERTIntNode *) item->value;
+    }
+}
+
 // 找寻 left~right 区间的元素，放到res中
-void ERTInt::scan(uint64_t left, uint64_t right) {
+uint64_t ERTInt::scan(uint64_t left, uint64_t right) {
     vector<ERTIntKeyValue> res;
     nodeScan(root, left, right, res, 0);
-//    cout << res.size() << endl;
+    return res.size();
 }
 
 
 // TODO（chen）这个里scan数据怎么没看到处理 treeNodeValues 数据
 void ERTInt::nodeScan(ERTIntNode *tmp, uint64_t left, uint64_t right, vector<ERTIntKeyValue> &res, int pos,
                       uint64_t prefix) {
+    // a scan of the live tree covers buffered inserts; a snapshot still sharing root keeps its
+    // view, since the merge copies on write
+    if (pos == 0 && (tmp == NULL || tmp == root)) {
+        FlushWriteBuffer();
+    }
     if (unlikely(tmp == NULL)) {
         tmp = root;
     }
+    // an empty tree has no prefix yet
+    if (tmp->header.len > ERT_NODE_PREFIX_MAX_BYTES) {
+        return;
+    }
     // 在当前节点的dir列表中找到匹配区间left的最左位置，和匹配区间right最右位置
     uint64_t leftPos = UINT64_MAX, rightPos = UINT64_MAX;
 
     // 先在header.array中匹配前缀，与左边界比较。
     for (int i = 0; i < tmp->header.len; i++) {
-        uint64_t subkey = GET_SUBKEY(left, pos + i, 8);
+        uint64_t subkey = GET_SUBKEY(left, pos + i * SIZE_OF_CHAR, SIZE_OF_CHAR);
         if (subkey == (uint64_t) tmp->header.array[i]) {
             // 如果按字节匹配，则继续往前
             continue;
@@ -327,7 +565,7 @@ void ERTInt::nodeScan(ERTIntNode *tmp, uint64_t left, uint64_t right, vector<ERT
 
     // 先在header.array中匹配前缀，与右边界比较。
     for (int i = 0; i < tmp->header.len; i++) {
-        uint64_t subkey = GET_SUBKEY(right, pos + i, 8);
+        uint64_t subkey = GET_SUBKEY(right, pos + i * SIZE_OF_CHAR, SIZE_OF_CHAR);
         if (subkey == (uint64_t) tmp->header.array[i]) {
             continue;
         } else {
@@ -343,9 +581,10 @@ void ERTInt::nodeScan(ERTIntNode *tmp, uint64_t left, uint64_t right, vector<ERT
 
     // 传入的原前缀prefix加上当前节点的header.array保存的前缀，构建新的前缀
     if (tmp->header.len > 0) {
+        nodeValuesScan(tmp, left, right, res);
         prefix = (prefix << tmp->header.len * SIZE_OF_CHAR);
         for (int i = 0; i < tmp->header.len; ++i) {
-            prefix += tmp->header.array[i] << (tmp->header.len - i);
+            prefix += (uint64_t) tmp->header.array[i] << ((tmp->header.len - 1 - i) * SIZE_OF_CHAR);
         }
         pos += tmp->header.len * SIZE_OF_CHAR;
     }
@@ -366,17 +605,18 @@ void ERTInt::nodeScan(ERTIntNode *tmp, uint64_t left, uint64_t right, vector<ERT
     // TODO（chen）这里应该加一个条件 leftSubkey != UINT64_MAX，因为当leftPos和rightPos都不是max时，这俩都为初值max。
     // TODO（chen）这里可以直接讲 leftPos == rightPos 作为更大的特例处理，包含了leftSubkey == rightSubkey。
     // 此时leftPos和rightPos分别为0和dir_size-1，整个节点全都在scan范围内。
-    if (leftSubkey == rightSubkey) {
+    // both bounds outside the node leave both subkeys unset, which the loop below handles
+    if (leftSubkey != UINT64_MAX && leftSubkey == rightSubkey) {
         // 如果 leftSubkey == rightSubkey，相当于定点取一个位置。
-        bool keyValueFlag;
+        bool keyValueFlag, artNodeFlag = false;
         uint64_t dir_index = GET_SEG_NUM(leftSubkey, ERT_NODE_LENGTH, tmp->global_depth);
         ERTIntSegment *tmp_seg = *(ERTIntSegment **) GET_SEG_POS(tmp, dir_index);
         uint64_t seg_index = GET_BUCKET_NUM(leftSubkey, ERT_BUCKET_MASK_LEN);
         ERTIntBucket *tmp_bucket = &(tmp_seg->bucket[seg_index]);
-        uint64_t value = tmp_bucket->get(leftSubkey, keyValueFlag);
+        uint64_t value = tmp_bucket->get(leftSubkey, keyValueFlag, artNodeFlag);
         // local depth取到的seg跟global_depth渠道的seg理论上应该时一样的，不一样就是程序问题。
         if (value == 0 || (tmp_seg != *(ERTIntSegment **) GET_SEG_POS(tmp, GET_SEG_NUM(leftSubkey, ERT_NODE_LENGTH,
-                                                                                       tmp_seg->depth)))) {
+                                                                                       tmp->global_depth)))) {
             return;
         }
         // 因为leftSubkey == rightSubkey，只有一个值，所以这里不用考虑多值情况
@@ -392,7 +632,13 @@ void ERTInt::nodeScan(ERTIntNode *tmp, uint64_t left, uint64_t right, vector<ERT
             // 没到完整的key长度
             if (keyValueFlag) {
                 // keyValueFlag表示value是kv对象，直接加入，只有一个值，不用考虑多值情况
-                res.push_back(*(ERTIntKeyValue *) value);
+                // the rest of its key may still fall outside the range
+                ERTIntKeyValue &kv = *(ERTIntKeyValue *) value;
+                if (kv.key >= left && kv.key <= right) {
+                    res.push_back(kv);
+                }
+            } else if (artNodeFlag) {
+                artScan((ERTIntArtNode *) value, left, right, res, pos, prefix + leftSubkey);
             } else {
                 // value不是kv对象，是指向下一个节点的指针。向下一个节点递归查找。
                 nodeScan((ERTIntNode *) value, left, right, res, pos, prefix + leftSubkey);
@@ -422,7 +668,7 @@ void ERTInt::nodeScan(ERTIntNode *tmp, uint64_t left, uint64_t right, vector<ERT
                 if ((value == 0 && curSubkey == 0) || (tmp_seg != *(ERTIntSegment **) GET_SEG_POS(tmp,
                                                                                                   GET_SEG_NUM(curSubkey,
                                                                                                               ERT_NODE_LENGTH,
-                                                                                                              tmp_seg->depth)))) {
+                                                                                                              tmp->global_depth)))) {
                     continue;
                 }
                 if ((leftSubkey == UINT64_MAX || curSubkey > leftSubkey) &&
@@ -439,9 +685,11 @@ void ERTInt::nodeScan(ERTIntNode *tmp, uint64_t left, uint64_t right, vector<ERT
                         if (keyValueFlag) {
                             // 没达到最大键长，keyValueFlag标识，value是kv对
                             res.push_back(*(ERTIntKeyValue *) value);
+                        } else if (GET_ART_NODE_FLAG(tmp_seg->bucket[j].counter[k].subkey)) {
+                            artScan((ERTIntArtNode *) value, left, right, res, pos, prefix + curSubkey);
                         } else {
                             // 没达到最大键长，不是kv对，直接往下面节点找。后面节点都是范围内数据，所以直接遍历取。
-                            getAllNodes((ERTIntNode *) value, res, prefix + curSubkey);
+                            getAllNodes((ERTIntNode *) value, res, pos, prefix + curSubkey);
                         }
                     }
                 } else if (curSubkey == leftSubkey || curSubkey == rightSubkey) {
@@ -454,11 +702,21 @@ void ERTInt::nodeScan(ERTIntNode *tmp, uint64_t left, uint64_t right, vector<ERT
                         res.push_back(tmp);
                     } else {
                         // TODO（chen）pos == ERT_KEY_LENGTH 这里不需要
-                        if (pos == ERT_KEY_LENGTH || keyValueFlag) {
-                            res.push_back(*(ERTIntKeyValue *) value);
+                        if (keyValueFlag) {
+                            ERTIntKeyValue &kv = *(ERTIntKeyValue *) value;
+                            if (kv.key >= left && kv.key <= right) {
+                                res.push_back(kv);
+                            }
                         } else {
-                            // 没有达到键长，也不是kv标识，指向下一个节点，那么下面节点不一定全都在查询范围内，需要递归再判断
-                            nodeScan((ERTIntNode *) value, left, right, res, pos, prefix + curSubkey);
+                            // the subtree of one bound lies entirely on the inner side of the other
+                            uint64_t subLeft = curSubkey == leftSubkey ? left : 0;
+                            uint64_t subRight = curSubkey == rightSubkey ? right : UINT64_MAX;
+                            if (GET_ART_NODE_FLAG(tmp_seg->bucket[j].counter[k].subkey)) {
+                                artScan((ERTIntArtNode *) value, subLeft, subRight, res, pos, prefix + curSubkey);
+                            } else {
+                                // 没有达到键长，也不是kv标识，指向下一个节点，那么下面节点不一定全都在查询范围内，需要递归再判断
+                                nodeScan((ERTIntNode *) value, subLeft, subRight, res, pos, prefix + curSubkey);
+                            }
                         }
                     }
                 }
@@ -469,6 +727,20 @@ void ERTInt::nodeScan(ERTIntNode *tmp, uint64_t left, uint64_t right, vector<ERT
 
 }
 
+// keys of tmp that end inside its prefix, see ERTIntNode::treeNodeValues
+void ERTInt::nodeValuesScan(ERTIntNode *tmp, uint64_t left, uint64_t right, vector<ERTIntKeyValue> &res) {
+    if (tmp->treeNodeValues == NULL) {
+        return;
+    }
+    for (int i = 0; i < ERT_TREE_NODE_VALUES_NUM; ++i) {
+        ERTIntKeyValue &kv = tmp->treeNodeValues[i];
+        // Remove leaves the key of a cleared entry behind
+        if (kv.value != 0 && kv.key >= left && kv.key <= right) {
+            res.push_back(kv);
+        }
+    }
+}
+
 // 遍历取出指定节点所有数据
 void ERTInt::getAllNodes(ERTIntNode *tmp, vector<ERTIntKeyValue> &res, int pos, uint64_t prefix) {
     if (tmp == NULL) {
@@ -476,9 +748,10 @@ void ERTInt::getAllNodes(ERTIntNode *tmp, vector<ERTIntKeyValue> &res, int pos,
     }
     // prefix左移当前节点前缀长度位数
     if (tmp->header.len > 0) {
+        nodeValuesScan(tmp, 0, UINT64_MAX, res);
         prefix = (prefix << tmp->header.len * SIZE_OF_CHAR);
         for (int i = 0; i < tmp->header.len; ++i) {
-            prefix += tmp->header.array[i] << (tmp->header.len - i);
+            prefix += (uint64_t) tmp->header.array[i] << ((tmp->header.len - 1 - i) * SIZE_OF_CHAR);
         }
         pos += tmp->header.len * SIZE_OF_CHAR;
     }
@@ -502,6 +775,11 @@ void ERTInt::getAllNodes(ERTIntNode *tmp, vector<ERTIntKeyValue> &res, int pos,
                 bool keyValueFlag = GET_NODE_FLAG(tmp_seg->bucket[j].counter[k].subkey);
                 uint64_t curSubkey = REMOVE_NODE_FLAG(tmp_seg->bucket[j].counter[k].subkey);
                 uint64_t value = tmp_seg->bucket[j].counter[k].value;
+                // 跳过无效的item，同前面一样还需要对比segment一致，不一致跳过
+                if ((curSubkey == 0 && value == 0) || (tmp_seg != *(ERTIntSegment **) GET_SEG_POS(tmp, GET_SEG_NUM(
+                        curSubkey, ERT_NODE_LENGTH, tmp->global_depth)))) {
+                    continue;
+                }
                 // kv判断处理
                 if (pos == 64) {
                     // 处理达到了key长度，value即为值
@@ -510,14 +788,11 @@ void ERTInt::getAllNodes(ERTIntNode *tmp, vector<ERTIntKeyValue> &res, int pos,
                     tmp.value = value;
                     res.push_back(tmp);
                 } else {
-                    // 跳过无效的item，同前面一样还需要对比segment一致，不一致跳过
-                    if ((curSubkey == 0 && value == 0) || (tmp_seg != *(ERTIntSegment **) GET_SEG_POS(tmp, GET_SEG_NUM(
-                            curSubkey, ERT_NODE_LENGTH, tmp_seg->depth)))) {
-                        continue;
-                    }
                     if (keyValueFlag) {
                         // kv flag，直接加入
                         res.push_back(*(ERTIntKeyValue *) value);
+                    } else if (GET_ART_NODE_FLAG(tmp_seg->bucket[j].counter[k].subkey)) {
+                        artScan((ERTIntArtNode *) value, 0, UINT64_MAX, res, pos, prefix + curSubkey);
                     } else {
                         // 非kv，往后面节点找，节点数据都加入，递归调用getAllNodes
                         getAllNodes((ERTIntNode *) value, res, pos, prefix + curSubkey);
@@ -530,6 +805,10 @@ void ERTInt::getAllNodes(ERTIntNode *tmp, vector<ERTIntKeyValue> &res, int pos,
 
 // 计算内存用量
 uint64_t ERTInt::memory_profile(ERTIntNode *tmp, int pos) {
+    // count buffered inserts where they will live
+    if (pos == 0 && (tmp == NULL || tmp == root)) {
+        FlushWriteBuffer();
+    }
     if (tmp == NULL) {
         tmp = root;
     }
@@ -561,12 +840,14 @@ uint64_t ERTInt::memory_profile(ERTIntNode *tmp, int pos) {
                 if (pos != 64) {
                     // 过滤无效item，因为无效item如果是指针，那么指针对象如果有效会在其他节点计算的
                     if ((curSubkey == 0 && value == 0) || (tmp_seg != *(ERTIntSegment **) GET_SEG_POS(tmp, GET_SEG_NUM(
-                            curSubkey, ERT_NODE_LENGTH, tmp_seg->depth)))) {
+                            curSubkey, ERT_NODE_LENGTH, tmp->global_depth)))) {
                         continue;
                     }
                     if (keyValueFlag) {
                         // 指针指向的kv对，+sizeof(ERTIntBucketKeyValue)，也就是+16
                         res += 16;
+                    } else if (GET_ART_NODE_FLAG(tmp_seg->bucket[j].counter[k].subkey)) {
+                        res += artMemory((ERTIntArtNode *) value, pos);
                     } else {
                         // 递归调用value指向的节点，计算占用存储空间
                         res += memory_profile((ERTIntNode *) value, pos);
@@ -578,15 +859,134 @@ uint64_t ERTInt::memory_profile(ERTIntNode *tmp, int pos) {
     return res;
 }
 
+ERTIntFrozen *ERTInt::Freeze() {
+    // make buffered inserts part of the frozen copy
+    FlushWriteBuffer();
+    return NewERTIntFrozen(root);
+}
+
+void ERTInt::EnableCache(uint64_t capacity) {
+    cache = NewERTIntCache(capacity);
+}
+
+void ERTInt::EnableWriteBuffer() {
+    if (buffer_logs == NULL) {
+        ERTIntBufferLog *logs = static_cast<ERTIntBufferLog *>(concurrency_fast_alloc(
+                sizeof(ERTIntBufferLog) * ERT_BUFFER_SHARD_NUM, true, ert_tag_buffer));
+        for (int i = 0; i < ERT_BUFFER_SHARD_NUM; ++i) {
+            logs[i].count = 0;
+            clflush((char *) &logs[i].count, sizeof(uint64_t));
+        }
+        buffer_logs = logs;
+        clflush((char *) &buffer_logs, sizeof(uint64_t));
+    }
+    buffer = new ERTIntWriteBuffer(buffer_logs);
+    buffer->recover();
+}
+
+void ERTInt::FlushWriteBuffer() {
+    if (buffer != NULL) {
+        buffer->flush(this);
+    }
+}
+
+void ERTInt::lockWriter() {
+    while (write_lock.exchange(true, std::memory_order_acquire)) {
+        asm volatile("pause");
+    }
+}
+
+void ERTInt::unlockWriter() {
+    write_lock.store(false, std::memory_order_release);
+}
+
+ERTIntSnapshot *ERTInt::Snapshot() {
+    // make buffered inserts part of the snapshot
+    FlushWriteBuffer();
+    lockWriter();
+    if (snapshots == NULL) {
+        snapshots = new ERTIntSnapshotList;
+    }
+    ERTIntSnapshot *snapshot = new ERTIntSnapshot;
+    snapshot->tree = this;
+    snapshot->root = root;
+    // objects created from now on get a version above the snapshot epoch
+    snapshot->epoch = ert_write_epoch.fetch_add(1);
+    snapshots->live.push_back(snapshot);
+    cow_epoch = snapshot->epoch;
+    unlockWriter();
+    return snapshot;
+}
+
+void ERTInt::ReleaseSnapshot(ERTIntSnapshot *snapshot) {
+    lockWriter();
+    auto &live = snapshots->live;
+    for (auto it = live.begin(); it != live.end(); ++it) {
+        if (*it == snapshot) {
+            live.erase(it);
+            break;
+        }
+    }
+    cow_epoch = snapshots->newestEpoch();
+    snapshots->reclaim();
+    unlockWriter();
+    delete snapshot;
+}
+
+void ERTInt::retire(void *ptr, uint64_t size, int tag) {
+    if (snapshots == NULL) {
+        snapshots = new ERTIntSnapshotList;
+    }
+    snapshots->retire(ptr, size, ert_write_epoch.load(std::memory_order_relaxed), tag);
+}
+
+void ERTInt::Reclaim() {
+    if (snapshots == NULL || snapshots->retired.empty()) {
+        return;
+    }
+    lockWriter();
+    snapshots->reclaim();
+    unlockWriter();
+}
+
 // 创建扩展hash的基数树，并初始化
 ERTInt *NewExtendibleRadixTreeInt() {
     // 创建tree
-    ERTInt *_new_hash_tree = static_cast<ERTInt *>(concurrency_fast_alloc(sizeof(ERTInt)));
+    ERTInt *_new_hash_tree = static_cast<ERTInt *>(concurrency_fast_alloc(sizeof(ERTInt), true, ert_tag_tree));
     // 初始化创建根节点，root指向根节点
     _new_hash_tree->init();
     return _new_hash_tree;
 }
 
+// a new tree is reserved and published into the root, so a crash leaves the root empty or
+// pointing at a complete tree. Its nodes hold raw pointers, valid while the pool maps at its
+// fixed addresses
+ERTInt *OpenExtendibleRadixTreeInt() {
+    persistent_ptr<ERTInt> *slot = static_cast<persistent_ptr<ERTInt> *>(
+            fast_alloc_pm_root(sizeof(persistent_ptr<ERTInt>)));
+    if (slot == NULL) {
+        return NewExtendibleRadixTreeInt();
+    }
+    if (*slot) {
+        // snapshots, the cache, the DRAM side of the write buffer and the lock died with the process
+        ERTInt *tree = slot->get();
+        tree->write_lock.store(false);
+        tree->cow_epoch = 0;
+        tree->snapshots = NULL;
+        tree->cache = NULL;
+        tree->buffer = NULL;
+        if (tree->buffer_logs != NULL) {
+            tree->EnableWriteBuffer();
+        }
+        return tree;
+    }
+    ERTInt *tree = static_cast<ERTInt *>(fast_alloc_pm_reserve(sizeof(ERTInt), ert_tag_tree));
+    tree->init();
+    clflush((char *) tree, sizeof(ERTInt));
+    fast_alloc_pm_publish(tree, sizeof(ERTInt), &slot->raw, persistent_ptr<ERTInt>(tree).raw);
+    return tree;
+}
+
 
 ERTInt::ERTInt() {
     root = NewERTIntNode(ERT_NODE_LENGTH);
@@ -603,4 +1003,11 @@ ERTInt::~ERTInt() {
 
 void ERTInt::init() {
     root = NewERTIntNode(ERT_NODE_LENGTH);
+    write_lock.store(false);
+    cow_epoch = 0;
+    snapshots = NULL;
+    cache = NULL;
+    buffer = NULL;
+    buffer_logs = NULL;
+    hybrid = false;
 }
\ No newline at end of file
@@ -2,11 +2,29 @@
 #define NVMKV_ERT_INT_H
 
 #include "ERT_node_int.h"
+#include "ERT_frozen_int.h"
+#include "ERT_snapshot_int.h"
+#include "ERT_cache_int.h"
+#include "ERT_buffer_int.h"
+#include "ERT_art_int.h"
 
 class ERTInt {
 public:
     int init_depth = 0; //represent extendible hash initial global depth
     ERTIntNode *root = NULL;
+    // serializes top-level inserts with each other and with Snapshot()
+    std::atomic<bool> write_lock;
+    // newest live snapshot epoch; nodes and segments with version <= cow_epoch are shared
+    uint64_t cow_epoch = 0;
+    ERTIntSnapshotList *snapshots = NULL;
+    // optional DRAM lookaside cache consulted by Search, NULL when disabled
+    ERTIntCache *cache = NULL;
+    // optional write buffer absorbing inserts, NULL when disabled
+    ERTIntWriteBuffer *buffer = NULL;
+    // ERT_BUFFER_SHARD_NUM shard logs of the write buffer, persisted so a reopened tree recovers them
+    ERTIntBufferLog *buffer_logs = NULL;
+    // hybrid mode: low-fanout subtrees start as ERTIntArtNode and are promoted when they grow
+    bool hybrid = false;
 
     ERTInt();
 
@@ -19,18 +37,87 @@ public:
     //support variable values, for convenience, we set v to 8 byte
     void Insert(uint64_t key, uint64_t value, ERTIntNode *_node = NULL, int len = 0);
 
-    uint64_t Search(uint64_t key);
+    void nodeInsert(uint64_t key, uint64_t value, ERTIntNode *_node, int len, uint64_t beforeAddress);
 
-    void scan(uint64_t left, uint64_t right);
+    // insert a batch sorted by key in one writer critical section, bypassing the write buffer
+    void BulkInsert(vector<ERTIntKeyValue> &kvs);
+
+    // top-level insert, the caller holds the write lock
+    void insertLocked(uint64_t key, uint64_t value);
+
+    uint64_t Search(uint64_t key, ERTIntNode *_node = NULL);
+
+    uint64_t nodeSearch(uint64_t key, ERTIntNode *_node, int pos = 0);
+
+    // delete key, false if it is absent; emptied nodes and segments are kept
+    bool Remove(uint64_t key);
+
+    bool nodeRemove(uint64_t key, ERTIntNode *_node, int pos = 0);
+
+    // number of keys in [left, right]
+    uint64_t scan(uint64_t left, uint64_t right);
 
     void nodeScan(ERTIntNode *tmp, uint64_t left, uint64_t right, vector<ERTIntKeyValue> &res, int pos = 0,
                   uint64_t prefix = 0);
 
     void getAllNodes(ERTIntNode *tmp, vector<ERTIntKeyValue> &res, int pos = 0, uint64_t prefix = 0);
 
+    void nodeValuesScan(ERTIntNode *tmp, uint64_t left, uint64_t right, vector<ERTIntKeyValue> &res);
+
     uint64_t memory_profile(ERTIntNode *tmp, int pos = 0);
+
+    void EnableHybrid();
+
+    void artInsert(uint64_t key, uint64_t value, ERTIntArtNode *node, int len, ERTIntBucketKeyValue *parentSlot);
+
+    uint64_t artSearch(uint64_t key, ERTIntArtNode *node, int pos);
+
+    bool artRemove(uint64_t key, ERTIntArtNode *node, int pos);
+
+    void artScan(ERTIntArtNode *tmp, uint64_t left, uint64_t right, vector<ERTIntKeyValue> &res, int pos,
+                 uint64_t prefix);
+
+    uint64_t artMemory(ERTIntArtNode *tmp, int pos);
+
+    ERTIntNode *artCowPath(uint64_t key, ERTIntBucketKeyValue *slot, int &pos, uint64_t &beforeAddress, uint64_t now);
+
+    // build a compact, immutable copy of the current tree for read-only use
+    ERTIntFrozen *Freeze();
+
+    // pin a point-in-time view of the tree; writers copy-on-write what it covers until released
+    ERTIntSnapshot *Snapshot();
+
+    void ReleaseSnapshot(ERTIntSnapshot *snapshot);
+
+    // hand a block a writer unlinked to the retired list instead of freeing it under a lock-free
+    // Search; the caller holds the write lock
+    void retire(void *ptr, uint64_t size, int tag);
+
+    // free the retired blocks no live snapshot can reach. The caller guarantees that no Search or
+    // scan of the live tree is still running from before the blocks were unlinked
+    void Reclaim();
+
+    // clone every shared node, segment and leaf on the insert path of key
+    void cowPath(uint64_t key);
+
+    // serve the hottest keys from a DRAM cache holding up to capacity keys
+    void EnableCache(uint64_t capacity);
+
+    // buffer inserts in sorted, durably logged shards that are merged into the tree in batches;
+    // inserts the logs hold from before a restart are pending again
+    void EnableWriteBuffer();
+
+    void FlushWriteBuffer();
+
+    void lockWriter();
+
+    void unlockWriter();
 };
 
 ERTInt *NewExtendibleRadixTreeInt();
 
+// the tree registered in the root of the open pm pool, published there when there is none yet.
+// Without a pool it is NewExtendibleRadixTreeInt
+ERTInt *OpenExtendibleRadixTreeInt();
+
 #endif //NVMKV_ERT_INT_H
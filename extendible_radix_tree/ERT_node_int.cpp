@@ -1,4 +1,4 @@
-#include "ERT_node_int.h"
+#include "ERT_int.h"
 
 // mfence(); 是一个内存屏障指令，确保前面的内存操作 在系统执行 接下来的操作 之前完全完成。避免乱序执行导致的潜在数据一致性问题。
 inline void mfence(void) {
@@ -12,11 +12,14 @@ inline void clflush(char *data, size_t len) {
     for (; ptr < data + len; ptr += CACHELINESIZE) {
         asm volatile("clflush %0" : "+m" (*(volatile char *) ptr));
     }
+    pm_emulate_flush(pm_flush_line_num(data, len));
     mfence();
 }
 
+std::atomic<uint64_t> ert_write_epoch(1);
+
 ERTIntKeyValue *NewERTIntKeyValue(uint64_t key, uint64_t value) {
-    ERTIntKeyValue *_new_key_value = static_cast<ERTIntKeyValue *>(concurrency_fast_alloc(sizeof(ERTIntKeyValue)));
+    ERTIntKeyValue *_new_key_value = static_cast<ERTIntKeyValue *>(concurrency_fast_alloc(sizeof(ERTIntKeyValue), true, ert_tag_kv));
     _new_key_value->key = key;
     _new_key_value->value = value;
     return _new_key_value;
@@ -24,12 +27,24 @@ ERTIntKeyValue *NewERTIntKeyValue(uint64_t key, uint64_t value) {
 
 
 // 从bucket中查询指定key，返回value和flag
+// a slot with value 0 is empty or was cleared by ERTInt::Remove and never matches, not even subkey 0
 uint64_t ERTIntBucket::get(uint64_t key, bool &keyValueFlag) {
     for (int i = 0; i < ERT_BUCKET_SIZE; ++i) {
         // 移除高8位flag后，低56位是key。
         // 判断是否是查询key，如果是查到了，返回value和flag
-        if (key == REMOVE_NODE_FLAG(counter[i].subkey)) {
+        if (key == REMOVE_NODE_FLAG(counter[i].subkey) && counter[i].value != 0) {
+            keyValueFlag = GET_NODE_FLAG(counter[i].subkey);
+            return counter[i].value;
+        }
+    }
+    return 0;
+}
+
+uint64_t ERTIntBucket::get(uint64_t key, bool &keyValueFlag, bool &artNodeFlag) {
+    for (int i = 0; i < ERT_BUCKET_SIZE; ++i) {
+        if (key == REMOVE_NODE_FLAG(counter[i].subkey) && counter[i].value != 0) {
             keyValueFlag = GET_NODE_FLAG(counter[i].subkey);
+            artNodeFlag = GET_ART_NODE_FLAG(counter[i].subkey);
             return counter[i].value;
         }
     }
@@ -42,7 +57,7 @@ int ERTIntBucket::findPlace(uint64_t _key, uint64_t _key_len, uint64_t _depth) {
     int res = -1;
     for (int i = 0; i < ERT_BUCKET_SIZE; ++i) {
         uint64_t removedFlagKey = REMOVE_NODE_FLAG(counter[i].subkey);
-        if (_key == removedFlagKey) {
+        if (_key == removedFlagKey && counter[i].value != 0) {
             // 存在对应key，返回key的idx
             return i;
         } else if ((res == -1) && removedFlagKey == 0 && counter[i].value == 0) {
@@ -60,20 +75,21 @@ int ERTIntBucket::findPlace(uint64_t _key, uint64_t _key_len, uint64_t _depth) {
 
 ERTIntSegment::ERTIntSegment() {
     depth = 0;
-    bucket = static_cast<ERTIntBucket *>(concurrency_fast_alloc(sizeof(ERTIntBucket) * ERT_MAX_BUCKET_NUM));
+    bucket = static_cast<ERTIntBucket *>(concurrency_fast_alloc(sizeof(ERTIntBucket) * ERT_MAX_BUCKET_NUM, true, ert_tag_bucket));
 }
 
 ERTIntSegment::~ERTIntSegment() {}
 
 void ERTIntSegment::init(uint64_t _depth) {
     depth = _depth;
-    bucket = static_cast<ERTIntBucket *>(concurrency_fast_alloc(sizeof(ERTIntBucket) * ERT_MAX_BUCKET_NUM));
+    version = ert_write_epoch.load(std::memory_order_relaxed);
+    bucket = static_cast<ERTIntBucket *>(concurrency_fast_alloc(sizeof(ERTIntBucket) * ERT_MAX_BUCKET_NUM, true, ert_tag_bucket));
 }
 
 
 ERTIntSegment *NewERTIntSegment(uint64_t _depth) {
     // 申请segment结构
-    ERTIntSegment *_new_ht_segment = static_cast<ERTIntSegment *>(concurrency_fast_alloc(sizeof(ERTIntSegment)));
+    ERTIntSegment *_new_ht_segment = static_cast<ERTIntSegment *>(concurrency_fast_alloc(sizeof(ERTIntSegment), true, ert_tag_segment));
     // segment中存数据的bucket数组结构
     _new_ht_segment->init(_depth);
     return _new_ht_segment;
@@ -141,16 +157,17 @@ void ERTIntNode::init(unsigned char headerDepth, unsigned char global_depth) {
     this->global_depth = global_depth;
     this->dir_size = pow(2, global_depth);
     header.depth = headerDepth;
+    version = ert_write_epoch.load(std::memory_order_relaxed);
     // 这个节点存储的数据应该是与header.len一样，应该是前缀从只匹配到一个字符到完全都匹配。
     treeNodeValues = static_cast<ERTIntKeyValue *>(concurrency_fast_alloc(
         // TODO（chen）这里不应该除以 ERT_NODE_LENGTH，而应该是 SIZE_OF_CHAR，最大应该是6个才对？
-            sizeof(ERTIntKeyValue) * (1 + ERT_NODE_PREFIX_MAX_BITS / ERT_NODE_LENGTH)));
+            sizeof(ERTIntKeyValue) * ERT_TREE_NODE_VALUES_NUM, true, ert_tag_values));
     for (int i = 0; i < this->dir_size; ++i) {
         *(ERTIntSegment **) GET_SEG_POS(this, i) = NewERTIntSegment(global_depth);
     }
 }
 
-void ERTIntNode::put(uint64_t subkey, uint64_t value, uint64_t beforeAddress) {
+void ERTIntNode::put(uint64_t subkey, uint64_t value, uint64_t beforeAddress, uint64_t flag, ERTInt *tree) {
     // subkey 中取 后 ERT_NODE_LENGTH 位，然后取高 global_depth 位，即为segment索引
     uint64_t dir_index = GET_SEG_NUM(subkey, ERT_NODE_LENGTH, global_depth);
     // 根据segment索引找到对应段
@@ -161,12 +178,12 @@ void ERTIntNode::put(uint64_t subkey, uint64_t value, uint64_t beforeAddress) {
     ERTIntBucket *tmp_bucket = &(tmp_seg->bucket[seg_index]);
     // 往bucket中写入kv。三种情况：
     // 1、有空位直接插入；2、没有空位，段split，但dir不需要扩容；3、没有空位，段split，同时需要dir扩容。
-    put(subkey, value, tmp_seg, tmp_bucket, dir_index, seg_index, beforeAddress);
+    put(subkey, value, tmp_seg, tmp_bucket, dir_index, seg_index, beforeAddress, flag, tree);
 }
 
 void
 ERTIntNode::put(uint64_t subkey, uint64_t value, ERTIntSegment *tmp_seg, ERTIntBucket *tmp_bucket, uint64_t dir_index,
-                uint64_t seg_index, uint64_t beforeAddress) {
+                uint64_t seg_index, uint64_t beforeAddress, uint64_t flag, ERTInt *tree) {
     // bucket找位置，如果有空位则返回对应idx，没有则返回-1
     int bucket_index = tmp_bucket->findPlace(subkey, ERT_NODE_LENGTH, tmp_seg->depth);
     if (bucket_index == -1) {
@@ -222,17 +239,18 @@ ERTIntNode::put(uint64_t subkey, uint64_t value, ERTIntSegment *tmp_seg, ERTIntB
             tmp_seg->depth = tmp_seg->depth + 1;
             clflush((char *) &(tmp_seg->depth), sizeof(tmp_seg->depth));
             // segment split完成，重新调用put走流程3插入kv
-            this->put(subkey, value, beforeAddress);
+            this->put(subkey, value, beforeAddress, flag, tree);
             return;
         } else {
             //condition: tmp_bucket->depth == global_depth
             // 2、bucket满了，且local depth == global depth时，需要扩容dir，然后segment split。
             // 首先dir扩容分配新的Node空间，global_depth+1，dir_size翻倍，header拷贝原来的
             ERTIntNode *newNode = static_cast<ERTIntNode *>(concurrency_fast_alloc(
-                    sizeof(ERTIntNode) + sizeof(ERTIntNode *) * dir_size * 2));
+                    sizeof(ERTIntNode) + sizeof(ERTIntNode *) * dir_size * 2, true, ert_tag_node));
             newNode->global_depth = global_depth + 1;
             newNode->dir_size = dir_size * 2;
             newNode->header.init(&this->header, this->header.len, this->header.depth);
+            newNode->version = ert_write_epoch.load(std::memory_order_relaxed);
             //set dir
             // 设置新节点的dir，因为新节点的dir翻倍了，所以新节点的i和i+1都指向老节点的i/2。
             for (int i = 0; i < newNode->dir_size; ++i) {
@@ -243,8 +261,13 @@ ERTIntNode::put(uint64_t subkey, uint64_t value, ERTIntSegment *tmp_seg, ERTIntB
             // 原来某个位置指向老节点持久化的，这里需要把那个地方设置指向新节点并持久化。
             *(ERTIntNode **) beforeAddress = newNode;
             clflush((char *) beforeAddress, sizeof(ERTIntNode *));
+            // the old directory is unlinked now, but a lock-free Search may still be reading it; cowPath
+            // already cloned it if a snapshot shares it
+            if (tree != NULL) {
+                tree->retire(this, sizeof(ERTIntNode) + sizeof(ERTIntSegment *) * dir_size, ert_tag_node);
+            }
             // 处理完了扩容，调用节点的put函数，后面走处理1中segment split的流程。
-            newNode->put(subkey, value, beforeAddress);
+            newNode->put(subkey, value, beforeAddress, flag, tree);
             return;
         }
     } else {
@@ -260,7 +283,7 @@ ERTIntNode::put(uint64_t subkey, uint64_t value, ERTIntSegment *tmp_seg, ERTIntB
             // key不存在，先写value持久化后再写key，防止中间失败value失效
             tmp_bucket->counter[bucket_index].value = value;
             mfence();
-            tmp_bucket->counter[bucket_index].subkey = PUT_KEY_VALUE_FLAG(subkey);
+            tmp_bucket->counter[bucket_index].subkey = subkey | flag;
             // Here we clflush 16bytes rather than two 8 bytes because all counter are set to 0.
             // If crash after key flushed, then the value is 0. When we return the value, we would find that the key is not inserted.
             // 持久化kv
@@ -285,10 +308,18 @@ uint64_t ERTIntNode::get(uint64_t subkey, bool &keyValueFlag) {
     return tmp_bucket->get(subkey, keyValueFlag);
 }
 
+uint64_t ERTIntNode::get(uint64_t subkey, bool &keyValueFlag, bool &artNodeFlag) {
+    uint64_t dir_index = GET_SEG_NUM(subkey, ERT_NODE_LENGTH, global_depth);
+    ERTIntSegment *tmp_seg = *(ERTIntSegment **) GET_SEG_POS(this, dir_index);
+    uint64_t seg_index = GET_BUCKET_NUM(subkey, ERT_BUCKET_MASK_LEN);
+    ERTIntBucket *tmp_bucket = &(tmp_seg->bucket[seg_index]);
+    return tmp_bucket->get(subkey, keyValueFlag, artNodeFlag);
+}
+
 
 ERTIntNode *NewERTIntNode(int _key_len, unsigned char headerDepth, unsigned char globalDepth) {
     ERTIntNode *_new_node = static_cast<ERTIntNode *>(concurrency_fast_alloc(
-            sizeof(ERTIntNode) + sizeof(ERTIntSegment *) * pow(2, globalDepth)));
+            sizeof(ERTIntNode) + sizeof(ERTIntSegment *) * pow(2, globalDepth), true, ert_tag_node));
     _new_node->init(headerDepth, globalDepth);
     return _new_node;
 }
\ No newline at end of file
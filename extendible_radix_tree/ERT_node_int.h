@@ -26,8 +26,13 @@
 #define REMOVE_NODE_FLAG(key) (key & (((uint64_t)1<<56)-1) )
 // 只设置第56位，该标识表示value中存储的是kv值（可以是一个，也可以是多个），而不是指向下一个节点。
 #define PUT_KEY_VALUE_FLAG(key) (key | ((uint64_t)1<<56))
-// 节点的前8位为flag位
-#define GET_NODE_FLAG(key) (key>>56)
+// 节点的前8位为flag位, bit 56 is the kv flag
+#define GET_NODE_FLAG(key) ((key>>56)&1)
+#define ERT_KEY_VALUE_FLAG ((uint64_t)1<<56)
+// hybrid mode: the value points to a small ERTIntArtNode instead of an ERTIntNode
+#define ERT_ART_NODE_FLAG ((uint64_t)1<<57)
+#define PUT_ART_NODE_FLAG(key) (key | ERT_ART_NODE_FLAG)
+#define GET_ART_NODE_FLAG(key) ((key>>57)&1)
 // 全局depth默认为0
 #define ERT_INIT_GLOBAL_DEPTH 0
 // bucket内默认4个key
@@ -42,6 +47,22 @@
 #define ERT_NODE_PREFIX_MAX_BYTES 6
 #define ERT_NODE_PREFIX_MAX_BITS 48
 #define ERT_KEY_LENGTH 64
+#define ERT_TREE_NODE_VALUES_NUM (1 + ERT_NODE_PREFIX_MAX_BITS / ERT_NODE_LENGTH)
+
+// write epoch stamped on every new node and segment, advanced by each snapshot (see ERT_snapshot_int.h)
+extern std::atomic<uint64_t> ert_write_epoch;
+
+// allocation tags of the ERT object types
+inline const int ert_tag_tree = fast_alloc_tag("ert.tree");
+inline const int ert_tag_node = fast_alloc_tag("ert.node");
+inline const int ert_tag_segment = fast_alloc_tag("ert.segment");
+inline const int ert_tag_bucket = fast_alloc_tag("ert.bucket");
+inline const int ert_tag_values = fast_alloc_tag("ert.node_values");
+inline const int ert_tag_kv = fast_alloc_tag("ert.kv");
+inline const int ert_tag_art = fast_alloc_tag("ert.art_node");
+inline const int ert_tag_frozen = fast_alloc_tag("ert.frozen");
+inline const int ert_tag_cache = fast_alloc_tag("ert.cache");
+inline const int ert_tag_buffer = fast_alloc_tag("ert.buffer");
 
 class ERTIntKeyValue {
 public:
@@ -69,6 +90,8 @@ public:
 
     uint64_t get(uint64_t key, bool& keyValueFlag);
 
+    uint64_t get(uint64_t key, bool& keyValueFlag, bool& artNodeFlag);
+
     int findPlace(uint64_t _key, uint64_t _key_len, uint64_t _depth);
 };
 
@@ -77,6 +100,7 @@ public:
     // local depth，决定bucket idx
     uint64_t depth = 0;
     ERTIntBucket *bucket;
+    uint64_t version = 0;
 //    ERTIntBucket bucket[ERT_MAX_BUCKET_NUM];
 
     ERTIntSegment();
@@ -106,6 +130,8 @@ public:
     void assign(unsigned char* key, unsigned char assignedLength = ERT_NODE_PREFIX_MAX_BYTES);
 };
 
+class ERTInt;
+
 class ERTIntNode {
 public:
     ERTIntHeader header;
@@ -118,6 +144,7 @@ public:
     // TODO（chen）这里为什么不正向放呢，假如最终匹配到header.array的长度为 m，则value放在这个数组的 m-1 下标位置。
     ERTIntKeyValue* treeNodeValues;
     // used to represent the elements in the treenode prefix, but not in CCEH
+    uint64_t version = 0;
 
     ERTIntNode();
 
@@ -125,14 +152,19 @@ public:
 
     void init( unsigned char headerDepth = 0, unsigned char global_depth = 0);
 
-    void put(uint64_t subkey, uint64_t value, uint64_t beforeAddress);
+    // flag is or-ed into the subkey of a new entry; a directory replaced by doubling is retired to
+    // tree, or kept allocated without one
+    void put(uint64_t subkey, uint64_t value, uint64_t beforeAddress, uint64_t flag = ERT_KEY_VALUE_FLAG,
+             ERTInt *tree = NULL);
 
-    void put(uint64_t subkey, uint64_t value, ERTIntSegment* tmp_seg, ERTIntBucket* tmp_bucket, uint64_t dir_index, uint64_t seg_index, uint64_t beforeAddress);
+    void put(uint64_t subkey, uint64_t value, ERTIntSegment* tmp_seg, ERTIntBucket* tmp_bucket, uint64_t dir_index, uint64_t seg_index, uint64_t beforeAddress, uint64_t flag = ERT_KEY_VALUE_FLAG, ERTInt *tree = NULL);
 
     void nodePut(int pos, ERTIntKeyValue *kv);
 
     uint64_t get(uint64_t subkey, bool& keyValueFlag);
 
+    uint64_t get(uint64_t subkey, bool& keyValueFlag, bool& artNodeFlag);
+
 };
 
 ERTIntNode *NewERTIntNode(int _key_len, unsigned char headerDepth = 1,
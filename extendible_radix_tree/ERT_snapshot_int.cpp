@@ -0,0 +1,55 @@
+#include "ERT_int.h"
+
+uint64_t ERTIntSnapshot::Search(uint64_t key) {
+    return tree->Search(key, root);
+}
+
+uint64_t ERTIntSnapshot::scan(uint64_t left, uint64_t right) {
+    vector<ERTIntKeyValue> res;
+    nodeScan(left, right, res);
+    return res.size();
+}
+
+void ERTIntSnapshot::nodeScan(uint64_t left, uint64_t right, vector<ERTIntKeyValue> &res) {
+    tree->nodeScan(root, left, right, res, 0);
+}
+
+uint64_t ERTIntSnapshotList::newestEpoch() {
+    uint64_t res = 0;
+    for (auto snapshot : live) {
+        res = max(res, snapshot->epoch);
+    }
+    return res;
+}
+
+uint64_t ERTIntSnapshotList::oldestEpoch() {
+    uint64_t res = UINT64_MAX;
+    for (auto snapshot : live) {
+        res = min(res, snapshot->epoch);
+    }
+    return res;
+}
+
+void ERTIntSnapshotList::retire(void *ptr, uint64_t size, uint64_t epoch, int tag) {
+    ERTIntRetired tmp;
+    tmp.epoch = epoch;
+    tmp.ptr = ptr;
+    tmp.size = size;
+    tmp.tag = tag;
+    retired.push_back(tmp);
+}
+
+// an object retired in epoch R can only be reached from snapshots taken before R
+void ERTIntSnapshotList::reclaim() {
+    uint64_t oldest = oldestEpoch();
+    uint64_t j = 0;
+    for (uint64_t i = 0; i < retired.size(); ++i) {
+        if (retired[i].epoch <= oldest) {
+            concurrency_fast_dealloc(retired[i].ptr, retired[i].size, true, retired[i].tag);
+            reclaimed_bytes += retired[i].size;
+        } else {
+            retired[j++] = retired[i];
+        }
+    }
+    retired.resize(j);
+}
@@ -0,0 +1,61 @@
+#ifndef NVMKV_ERT_SNAPSHOT_INT_H
+#define NVMKV_ERT_SNAPSHOT_INT_H
+
+#include "ERT_node_int.h"
+
+/*
+ * Copy-on-write snapshots of an ERTInt.
+ *
+ * A snapshot pins the root at the time it is taken. Every node and segment carries the
+ * write epoch it was created in; while a snapshot with epoch E is live, a writer clones
+ * each node, segment and leaf with version <= E on its insert path before touching it
+ * (ERTInt::cowPath), so the pinned tree never changes. Replaced objects are retired with
+ * the epoch they were unlinked in and reclaimed once every older snapshot is released.
+ * Blocks a writer unlinks outside copy-on-write (a directory replaced by doubling, a leaf
+ * replaced by a collision, a removed leaf, a grown ART node) are retired the same way, since
+ * Search takes no lock; they are freed by ERTInt::Reclaim or the next ReleaseSnapshot.
+ * Snapshot bookkeeping is protected by the tree's write lock.
+ */
+
+class ERTInt;
+
+class ERTIntSnapshot {
+public:
+    ERTInt *tree;
+    ERTIntNode *root;
+    uint64_t epoch;
+
+    uint64_t Search(uint64_t key);
+
+    // number of keys in [left, right]
+    uint64_t scan(uint64_t left, uint64_t right);
+
+    void nodeScan(uint64_t left, uint64_t right, vector<ERTIntKeyValue> &res);
+};
+
+class ERTIntRetired {
+public:
+    uint64_t epoch;
+    void *ptr;
+    uint64_t size;
+    int tag;
+};
+
+class ERTIntSnapshotList {
+public:
+    vector<ERTIntSnapshot *> live;
+    vector<ERTIntRetired> retired;
+    uint64_t reclaimed_bytes = 0;
+
+    // newest live snapshot epoch, 0 if there is none
+    uint64_t newestEpoch();
+
+    // oldest live snapshot epoch, UINT64_MAX if there is none
+    uint64_t oldestEpoch();
+
+    void retire(void *ptr, uint64_t size, uint64_t epoch, int tag);
+
+    void reclaim();
+};
+
+#endif //NVMKV_ERT_SNAPSHOT_INT_H
@@ -2,146 +2,700 @@
 
 fastalloc *myallocator;
 thread_local concurrency_fastalloc *concurrency_myallocator;
+// pool generation concurrency_myallocator was made in, kept here since fast_free deletes the arena
+thread_local uint64_t concurrency_mygeneration;
+fastalloc_chunk_pool fastalloc_pool;
 
 fastalloc::fastalloc() {}
 
-void fastalloc::init() {
-    dram[dram_cnt] = new char[ALLOC_SIZE];
-    dram_curr = dram[dram_cnt];
-    dram_left = ALLOC_SIZE;
-    dram_cnt++;
-
-#ifdef __linux__
-    if (onPM) {
-        string nvm_filename = filePath + to_string(nvm_cnt);
-        int nvm_fd = open(nvm_filename.c_str(), O_CREAT | O_RDWR, 0644);
-        if (posix_fallocate(nvm_fd, 0, ALLOC_SIZE) < 0)
-            puts("fallocate fail\n");
-        nvm[nvm_cnt] = (char *) mmap(NULL, ALLOC_SIZE, PROT_READ | PROT_WRITE, MAP_SYNC | MAP_SHARED_VALIDATE, nvm_fd, 0);
-    } else {
-        nvm[nvm_cnt] = new char[ALLOC_SIZE];
+void fastalloc_tag_stats::add(const fastalloc_tag_stats &other) {
+    alloc_cnt += other.alloc_cnt;
+    free_cnt += other.free_cnt;
+    requested_bytes += other.requested_bytes;
+    rounded_bytes += other.rounded_bytes;
+}
+
+void fastalloc_stats::add(const fastalloc_stats &other) {
+    chunk_bytes += other.chunk_bytes;
+    bump_bytes += other.bump_bytes;
+    requested_bytes += other.requested_bytes;
+    freed_bytes += other.freed_bytes;
+    reused_bytes += other.reused_bytes;
+    for (int i = 0; i < FASTALLOC_MAX_TAGS; i++) {
+        tags[i].add(other.tags[i]);
+    }
+}
+
+// registered tag names, written once at registration and read by reporters
+static std::atomic<const char *> tag_names[FASTALLOC_MAX_TAGS];
+static std::atomic<int> tag_cnt{1};
+static std::atomic<bool> tag_lock{false};
+
+int fast_alloc_tag(const char *name) {
+    while (tag_lock.exchange(true, std::memory_order_acquire)) {
+        __builtin_ia32_pause();
+    }
+    tag_names[FASTALLOC_TAG_UNTAGGED] = "untagged";
+    int res = 1;
+    while (res < tag_cnt && strcmp(tag_names[res], name) != 0) {
+        res++;
+    }
+    if (res == tag_cnt) {
+        if (res == FASTALLOC_MAX_TAGS) {
+            res = FASTALLOC_TAG_UNTAGGED;
+        } else {
+            tag_names[res] = name;
+            tag_cnt++;
+        }
+    }
+    tag_lock.store(false, std::memory_order_release);
+    return res;
+}
+
+const char *fast_alloc_tag_name(int tag) {
+    return tag == FASTALLOC_TAG_UNTAGGED ? "untagged" : tag_names[tag].load();
+}
+
+int fast_alloc_tag_num() {
+    return tag_cnt;
+}
+
+static fastalloc_page_mode page_mode = FASTALLOC_PAGE_DEFAULT;
+// DRAM bytes mapped per backing, reported through fast_alloc_stats
+static std::atomic<uint64_t> page_bytes[FASTALLOC_PAGE_MODE_NUM];
+
+void set_fast_alloc_page_mode(fastalloc_page_mode mode) {
+    page_mode = mode;
+}
+
+const char *fast_alloc_page_mode_name(fastalloc_page_mode mode) {
+    switch (mode) {
+        case FASTALLOC_PAGE_THP:
+            return "thp";
+        case FASTALLOC_PAGE_HUGETLB:
+            return "hugetlb";
+        case FASTALLOC_PAGE_HUGETLB_1G:
+            return "hugetlb1g";
+        default:
+            return "default";
+    }
+}
+
+static fastalloc_small_mode small_mode = FASTALLOC_SMALL_PACKED;
+static const uint64_t small_class_size[FASTALLOC_SMALL_CLASS_NUM] = {16, 24, 32, 48};
+
+void set_fast_alloc_small_mode(fastalloc_small_mode mode) {
+    small_mode = mode;
+}
+
+const char *fast_alloc_small_mode_name(fastalloc_small_mode mode) {
+    switch (mode) {
+        case FASTALLOC_SMALL_PACKED:
+            return "packed";
+        case FASTALLOC_SMALL_ALIGNED:
+            return "aligned";
+        default:
+            return "off";
     }
+}
+
+bool fast_alloc_is_small(uint64_t size) {
+    return small_mode != FASTALLOC_SMALL_OFF && size != 0 && size <= FASTALLOC_SMALL_MAX_SIZE;
+}
+
+// chunk bytes bound to each node, reported through fast_alloc_stats
+static std::atomic<uint64_t> numa_bytes[FASTALLOC_MAX_NUMA_NODES];
+
+void set_fast_alloc_numa_mode(fastalloc_numa_mode mode) {
+    fastalloc_pool.numa_mode = mode;
+}
+
+const char *fast_alloc_numa_mode_name(fastalloc_numa_mode mode) {
+    switch (mode) {
+        case FASTALLOC_NUMA_LOCAL:
+            return "local";
+        case FASTALLOC_NUMA_INTERLEAVE:
+            return "interleave";
+        default:
+            return "none";
+    }
+}
+
+// online nodes from sysfs, e.g. "0-1" or "0,2-3"; node 0 only when unavailable
+static uint64_t online_nodes_mask() {
+    static uint64_t mask = 0;
+    if (mask != 0) {
+        return mask;
+    }
+    uint64_t res = 0;
+    FILE *f = fopen("/sys/devices/system/node/online", "r");
+    if (f != NULL) {
+        int lo, hi;
+        char sep;
+        while (fscanf(f, "%d", &lo) == 1) {
+            hi = lo;
+            sep = fgetc(f);
+            if (sep == '-') {
+                if (fscanf(f, "%d", &hi) != 1)
+                    break;
+                sep = fgetc(f);
+            }
+            for (int i = lo; i <= hi && i < FASTALLOC_MAX_NUMA_NODES; i++) {
+                res |= (uint64_t) 1 << i;
+            }
+            if (sep != ',')
+                break;
+        }
+        fclose(f);
+    }
+    mask = res ? res : 1;
+    return mask;
+}
+
+int fast_alloc_numa_nodes() {
+    return 64 - __builtin_clzll(online_nodes_mask());
+}
+
+int fast_alloc_current_node() {
+#ifdef SYS_getcpu
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0 && node < FASTALLOC_MAX_NUMA_NODES) {
+        return node;
+    }
+#endif
+    return 0;
+}
+
+// set the memory policy of a not yet touched range, false if the kernel refused
+static bool numa_bind(void *addr, uint64_t size, int policy, uint64_t mask) {
+#ifdef SYS_mbind
+    return syscall(SYS_mbind, addr, size, policy, &mask, FASTALLOC_MAX_NUMA_NODES + 1, 0) == 0;
 #else
-    nvm[nvm_cnt] = new char[ALLOC_SIZE];
+    return false;
+#endif
+}
+
+#ifdef MAP_HUGETLB
+static void *map_hugetlb(uint64_t size, uint64_t page_size, int page_flag) {
+    return mmap(NULL, FASTALLOC_ALIGN(size, page_size), PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | page_flag, -1, 0);
+}
 #endif
-    nvm_curr = nvm[nvm_cnt];
-    nvm_left = ALLOC_SIZE;
-    nvm_cnt++;
+
+// reserve size bytes aligned to align, trimming the slack around the aligned range
+static void *map_aligned(uint64_t size, uint64_t align) {
+    char *addr = (char *) mmap(NULL, size + align, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+    char *start = (char *) FASTALLOC_ALIGN((uint64_t) addr, align);
+    if (start > addr) {
+        munmap(addr, start - addr);
+    }
+    munmap(start + size, addr + align - start);
+    return start;
+}
+
+// reserve a chunk; anonymous chunks are committed page by page on first touch, pm chunks come from fastalloc_pm
+static fastalloc_chunk map_chunk(bool _on_pm, uint64_t size) {
+    fastalloc_chunk chunk;
+    chunk.on_pm = _on_pm;
+    chunk.size = FASTALLOC_ALIGN(size, FASTALLOC_PAGE_SIZE);
+    void *addr = MAP_FAILED;
+    if (_on_pm) {
+        chunk.addr = fastalloc_pm.newChunk(chunk.size);
+        return chunk;
+    }
+#ifdef MAP_HUGETLB
+    if (page_mode == FASTALLOC_PAGE_HUGETLB_1G) {
+        addr = map_hugetlb(size, FASTALLOC_GIANT_PAGE_SIZE, MAP_HUGE_1GB);
+        if (addr != MAP_FAILED) {
+            chunk.size = FASTALLOC_ALIGN(size, FASTALLOC_GIANT_PAGE_SIZE);
+            chunk.backing = FASTALLOC_PAGE_HUGETLB_1G;
+        }
+    }
+    if (addr == MAP_FAILED && page_mode >= FASTALLOC_PAGE_HUGETLB) {
+        addr = map_hugetlb(size, FASTALLOC_HUGE_PAGE_SIZE, MAP_HUGE_2MB);
+        if (addr != MAP_FAILED) {
+            chunk.size = FASTALLOC_ALIGN(size, FASTALLOC_HUGE_PAGE_SIZE);
+            chunk.backing = FASTALLOC_PAGE_HUGETLB;
+        }
+    }
+#endif
+    if (addr == MAP_FAILED && page_mode != FASTALLOC_PAGE_DEFAULT) {
+        chunk.size = FASTALLOC_ALIGN(size, FASTALLOC_HUGE_PAGE_SIZE);
+        addr = map_aligned(chunk.size, FASTALLOC_HUGE_PAGE_SIZE);
+#ifdef MADV_HUGEPAGE
+        if (addr != MAP_FAILED && madvise(addr, chunk.size, MADV_HUGEPAGE) == 0) {
+            chunk.backing = FASTALLOC_PAGE_THP;
+        }
+#endif
+    }
+    if (addr == MAP_FAILED) {
+        chunk.size = FASTALLOC_ALIGN(size, FASTALLOC_PAGE_SIZE);
+        addr = mmap(NULL, chunk.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    }
+    if (addr == MAP_FAILED) {
+        perror("fastalloc: mmap");
+        exit(1);
+    }
+    chunk.addr = (char *) addr;
+    page_bytes[chunk.backing] += chunk.size;
+    return chunk;
+}
+
+// pm chunks stay mapped until fastalloc_pm is closed
+void fastalloc_chunk::unmap() {
+    if (!on_pm) {
+        munmap(addr, size);
+        page_bytes[backing] -= size;
+    }
+    if (numa_node >= 0) {
+        numa_bytes[numa_node] -= size;
+    }
+    addr = NULL;
+}
+
+char *fastalloc::newChunk(bool _on_nvm, uint64_t size) {
+    if (_on_nvm) {
+        nvm.push_back(map_chunk(onPM, size));
+        return nvm.back().addr;
+    }
+    dram.push_back(map_chunk(false, size));
+    return dram.back().addr;
+}
+
+// chunks are reserved on the first allocation that needs them
+void fastalloc::init() {
+    dram_curr = NULL;
+    dram_left = 0;
+    nvm_curr = NULL;
+    nvm_left = 0;
 }
 
 void concurrency_fastalloc::init(bool _onPM, string _filePath) {
     onPM = _onPM;
     filePath = _filePath;
+    chunk_size = CONCURRENCY_ALLOC_SIZE;
+    fastalloc::init();
+}
 
-    dram[dram_cnt] = new char[CONCURRENCY_ALLOC_SIZE];
-    dram_curr = dram[dram_cnt];
-    dram_left = CONCURRENCY_ALLOC_SIZE;
-    dram_cnt++;
-
-#ifdef __linux__
-    if (onPM) {
-        string nvm_filename = filePath + to_string(nvm_cnt);
-        int nvm_fd = open(nvm_filename.c_str(), O_CREAT | O_RDWR, 0644);
-        if (posix_fallocate(nvm_fd, 0, ALLOC_SIZE) < 0)
-            puts("fallocate fail\n");
-        nvm[nvm_cnt] = (char *) mmap(NULL, ALLOC_SIZE, PROT_READ | PROT_WRITE, MAP_SYNC | MAP_SHARED_VALIDATE, nvm_fd, 0);
-    } else {
-        nvm[nvm_cnt] = new char[ALLOC_SIZE];
+char *concurrency_fastalloc::newChunk(bool _on_nvm, uint64_t size) {
+    return fastalloc_pool.newChunk(_on_nvm && onPM, size, numa_node);
+}
+
+void *fastalloc::alloc(uint64_t size, bool _on_nvm, int tag) {
+    void *res = reserve(size, _on_nvm, tag);
+    if (_on_nvm && onPM) {
+        fastalloc_pm.mark(res, size, true);
     }
-#else
-    nvm[nvm_cnt] = new char[CONCURRENCY_ALLOC_SIZE];
-#endif
-    nvm_curr = nvm[nvm_cnt];
-    nvm_left = CONCURRENCY_ALLOC_SIZE;
-    nvm_cnt++;
+    return res;
+}
+
+void *fastalloc::reserve(uint64_t size, bool _on_nvm, int tag) {
+    stats.requested_bytes += size;
+    stats.tags[tag].alloc_cnt++;
+    stats.tags[tag].requested_bytes += size;
+    if (isSmall(size, _on_nvm)) {
+        int cls = FASTALLOC_SMALL_CLASS(size);
+        stats.tags[tag].rounded_bytes += small_class_size[cls];
+        return takeSmall(cls, _on_nvm);
+    }
+    size = FASTALLOC_ROUND(size);
+    stats.tags[tag].rounded_bytes += size;
+    return take(size, _on_nvm);
 }
 
-void *fastalloc::alloc(uint64_t size, bool _on_nvm) {
-    size = size / 64 * 64 + (!!(size % 64)) * 64;
+bool fastalloc::isSmall(uint64_t size, bool _on_nvm) {
+    return fast_alloc_is_small(size) && !(_on_nvm && onPM);
+}
+
+void *fastalloc::takeSmall(int cls, bool _on_nvm) {
+    uint64_t size = small_class_size[cls];
+    fastalloc_free_block *block = small_free[_on_nvm][cls];
+    if (block != NULL) {
+        small_free[_on_nvm][cls] = block->next;
+        stats.reused_bytes += size;
+        memset(block, 0, size);
+        return block;
+    }
+    char *curr = slab_curr[_on_nvm][cls];
+    uint64_t left = slab_left[_on_nvm][cls];
+    if (small_mode == FASTALLOC_SMALL_ALIGNED && (uint64_t) curr % CACHELINESIZE + size > CACHELINESIZE) {
+        // skip the tail of the line
+        uint64_t skip = CACHELINESIZE - (uint64_t) curr % CACHELINESIZE;
+        curr += skip;
+        left = left > skip ? left - skip : 0;
+    }
+    if (left < size) {
+        curr = (char *) take(FASTALLOC_SLAB_SIZE, _on_nvm);
+        left = FASTALLOC_SLAB_SIZE;
+    }
+    slab_curr[_on_nvm][cls] = curr + size;
+    slab_left[_on_nvm][cls] = left - size;
+    return curr;
+}
+
+void *fastalloc::take(uint64_t size, bool _on_nvm) {
+    void *reused = NULL;
+    if (size > FASTALLOC_MAX_CLASS_SIZE) {
+        reused = reuseLarge(size, _on_nvm);
+    } else if (size != 0) {
+        int cls = FASTALLOC_CLASS(size);
+        if (free_list[_on_nvm][cls] != NULL || refillClass(_on_nvm, cls)) {
+            fastalloc_free_block *block = free_list[_on_nvm][cls];
+            free_list[_on_nvm][cls] = block->next;
+            free_cnt[_on_nvm][cls]--;
+            reused = block;
+        }
+    }
+    if (reused != NULL) {
+        stats.reused_bytes += size;
+        memset(reused, 0, size);
+        return reused;
+    }
+    stats.bump_bytes += size;
+    if (unlikely(size > chunk_size)) {
+        // larger than a chunk: map it on its own and keep bumping the current chunk
+        stats.chunk_bytes += size;
+        return newChunk(_on_nvm, size);
+    }
     if (_on_nvm) {
         if (unlikely(size > nvm_left)) {
-#ifdef __linux__
-            if (onPM) {
-                string nvm_filename = filePath + to_string(nvm_cnt);
-                int nvm_fd = open(nvm_filename.c_str(), O_CREAT | O_RDWR, 0644);
-                if (posix_fallocate(nvm_fd, 0, ALLOC_SIZE) < 0)
-                    puts("fallocate fail\n");
-                nvm[nvm_cnt] = (char *) mmap(NULL, ALLOC_SIZE, PROT_READ | PROT_WRITE, MAP_SYNC | MAP_SHARED_VALIDATE, nvm_fd, 0);
-            } else {
-                nvm[nvm_cnt] = new char[ALLOC_SIZE];
-            }
-#else
-            nvm[nvm_cnt] = new char[ALLOC_SIZE];
-#endif
-            nvm_curr = nvm[nvm_cnt];
-            nvm_left = ALLOC_SIZE;
-            nvm_cnt++;
-            nvm_left -= size;
-            void *tmp = nvm_curr;
-            nvm_curr = nvm_curr + size;
-            return tmp;
-        } else {
-            nvm_left -= size;
-            void *tmp = nvm_curr;
-            nvm_curr = nvm_curr + size;
-            return tmp;
+            nvm_curr = newChunk(true, chunk_size);
+            nvm_left = chunk_size;
+            stats.chunk_bytes += chunk_size;
         }
+        nvm_left -= size;
+        void *tmp = nvm_curr;
+        nvm_curr = nvm_curr + size;
+        return tmp;
     } else {
         if (unlikely(size > dram_left)) {
-            dram[dram_cnt] = new char[ALLOC_SIZE];
-            dram_curr = dram[dram_cnt];
-            dram_left = ALLOC_SIZE;
-            dram_cnt++;
-            dram_left -= size;
-            void *tmp = dram_curr;
-            dram_curr = dram_curr + size;
-            return tmp;
-        } else {
-            dram_left -= size;
-            void *tmp = dram_curr;
-            dram_curr = dram_curr + size;
-            return tmp;
+            dram_curr = newChunk(false, chunk_size);
+            dram_left = chunk_size;
+            stats.chunk_bytes += chunk_size;
         }
+        dram_left -= size;
+        void *tmp = dram_curr;
+        dram_curr = dram_curr + size;
+        return tmp;
     }
 }
 
+void fastalloc::dealloc(void *ptr, uint64_t size, bool _on_nvm, int tag) {
+    if (ptr == NULL || size == 0) {
+        return;
+    }
+    if (_on_nvm && onPM) {
+        fastalloc_pm.mark(ptr, size, false);
+    }
+    recycle(ptr, size, _on_nvm, tag);
+}
+
+void fastalloc::recycle(void *ptr, uint64_t size, bool _on_nvm, int tag) {
+    stats.tags[tag].free_cnt++;
+    stats.tags[tag].requested_bytes -= size;
+    if (isSmall(size, _on_nvm)) {
+        int cls = FASTALLOC_SMALL_CLASS(size);
+        stats.tags[tag].rounded_bytes -= small_class_size[cls];
+        stats.freed_bytes += small_class_size[cls];
+        fastalloc_free_block *block = (fastalloc_free_block *) ptr;
+        block->next = small_free[_on_nvm][cls];
+        small_free[_on_nvm][cls] = block;
+        return;
+    }
+    size = FASTALLOC_ROUND(size);
+    stats.tags[tag].rounded_bytes -= size;
+    stats.freed_bytes += size;
+    if (size > FASTALLOC_MAX_CLASS_SIZE) {
+        releaseLarge(ptr, size, _on_nvm);
+        return;
+    }
+    int cls = FASTALLOC_CLASS(size);
+    fastalloc_free_block *block = (fastalloc_free_block *) ptr;
+    block->next = free_list[_on_nvm][cls];
+    free_list[_on_nvm][cls] = block;
+    if (++free_cnt[_on_nvm][cls] > FASTALLOC_CACHE_LIMIT) {
+        spillClass(_on_nvm, cls);
+    }
+}
+
+void *fastalloc::reuseLarge(uint64_t size, bool _on_nvm) {
+    auto it = large_free[_on_nvm].find(size);
+    if (it == large_free[_on_nvm].end() || it->second.empty()) {
+        return NULL;
+    }
+    void *res = it->second.back();
+    it->second.pop_back();
+    return res;
+}
+
+void fastalloc::releaseLarge(void *ptr, uint64_t size, bool _on_nvm) {
+    large_free[_on_nvm][size].push_back(ptr);
+}
 
 void fastalloc::free() {
-    if (dram != NULL) {
-        dram_left = 0;
-        for (int i = 0; i < dram_cnt; ++i) {
-            delete[]dram[i];
+    for (auto &chunk : dram) {
+        chunk.unmap();
+    }
+    for (auto &chunk : nvm) {
+        chunk.unmap();
+    }
+    dram.clear();
+    nvm.clear();
+    init();
+    memset(free_list, 0, sizeof(free_list));
+    memset(free_cnt, 0, sizeof(free_cnt));
+    large_free[0].clear();
+    large_free[1].clear();
+    memset(small_free, 0, sizeof(small_free));
+    memset(slab_curr, 0, sizeof(slab_curr));
+    memset(slab_left, 0, sizeof(slab_left));
+}
+
+// take half a cache worth of blocks from the global list
+bool concurrency_fastalloc::refillClass(int kind, int cls) {
+    fastalloc_pool.lockFree();
+    for (int i = 0; i < FASTALLOC_CACHE_LIMIT / 2 && fastalloc_pool.free_list[numa_node][kind][cls] != NULL; i++) {
+        fastalloc_free_block *block = fastalloc_pool.free_list[numa_node][kind][cls];
+        fastalloc_pool.free_list[numa_node][kind][cls] = block->next;
+        fastalloc_pool.free_cnt[numa_node][kind][cls]--;
+        block->next = free_list[kind][cls];
+        free_list[kind][cls] = block;
+        free_cnt[kind][cls]++;
+    }
+    fastalloc_pool.unlockFree();
+    return free_list[kind][cls] != NULL;
+}
+
+void concurrency_fastalloc::spillClass(int kind, int cls) {
+    fastalloc_pool.lockFree();
+    for (int i = 0; i < FASTALLOC_CACHE_LIMIT / 2; i++) {
+        fastalloc_free_block *block = free_list[kind][cls];
+        free_list[kind][cls] = block->next;
+        free_cnt[kind][cls]--;
+        block->next = fastalloc_pool.free_list[numa_node][kind][cls];
+        fastalloc_pool.free_list[numa_node][kind][cls] = block;
+        fastalloc_pool.free_cnt[numa_node][kind][cls]++;
+    }
+    fastalloc_pool.unlockFree();
+}
+
+void *concurrency_fastalloc::reuseLarge(uint64_t size, bool _on_nvm) {
+    fastalloc_pool.lockFree();
+    void *res = NULL;
+    auto it = fastalloc_pool.large_free[numa_node][_on_nvm].find(size);
+    if (it != fastalloc_pool.large_free[numa_node][_on_nvm].end() && !it->second.empty()) {
+        res = it->second.back();
+        it->second.pop_back();
+    }
+    fastalloc_pool.unlockFree();
+    return res;
+}
+
+void concurrency_fastalloc::releaseLarge(void *ptr, uint64_t size, bool _on_nvm) {
+    fastalloc_pool.lockFree();
+    fastalloc_pool.large_free[numa_node][_on_nvm][size].push_back(ptr);
+    fastalloc_pool.unlockFree();
+}
+
+void concurrency_fastalloc::free() {
+    dram_left = 0;
+    nvm_left = 0;
+    dram_curr = NULL;
+    nvm_curr = NULL;
+    memset(free_list, 0, sizeof(free_list));
+    memset(free_cnt, 0, sizeof(free_cnt));
+    memset(small_free, 0, sizeof(small_free));
+    memset(slab_curr, 0, sizeof(slab_curr));
+    memset(slab_left, 0, sizeof(slab_left));
+}
+
+char *fastalloc_chunk_pool::newChunk(bool _on_pm, uint64_t size, int node) {
+    chunk_cnt.fetch_add(1);
+    fastalloc_chunk *chunk = new fastalloc_chunk(map_chunk(_on_pm, size));
+    if (!_on_pm && numa_mode == FASTALLOC_NUMA_LOCAL) {
+        uint64_t mask = (uint64_t) 1 << node;
+        if (numa_bind(chunk->addr, chunk->size, FASTALLOC_MPOL_PREFERRED, mask)) {
+            numa_bytes[node] += chunk->size;
+            chunk->numa_node = node;
         }
-        dram_curr = NULL;
+    } else if (!_on_pm && numa_mode == FASTALLOC_NUMA_INTERLEAVE) {
+        numa_bind(chunk->addr, chunk->size, FASTALLOC_MPOL_INTERLEAVE, online_nodes_mask());
+    }
+    chunk->next = chunks.load(std::memory_order_relaxed);
+    while (!chunks.compare_exchange_weak(chunk->next, chunk, std::memory_order_release, std::memory_order_relaxed));
+    return chunk->addr;
+}
+
+void fastalloc_chunk_pool::lockFree() {
+    while (free_lock.exchange(true, std::memory_order_acquire)) {
+        __builtin_ia32_pause();
     }
 }
 
+void fastalloc_chunk_pool::unlockFree() {
+    free_lock.store(false, std::memory_order_release);
+}
+
+void fastalloc_chunk_pool::registerArena(concurrency_fastalloc *arena) {
+    concurrency_fastalloc *head = arenas.load(std::memory_order_relaxed);
+    do {
+        arena->next_arena = head;
+    } while (!arenas.compare_exchange_weak(head, arena, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void fastalloc_chunk_pool::free() {
+    concurrency_fastalloc *arena = arenas.exchange(NULL);
+    while (arena != NULL) {
+        concurrency_fastalloc *next = arena->next_arena;
+        arena->free();
+        delete arena;
+        arena = next;
+    }
+    fastalloc_chunk *chunk = chunks.exchange(NULL);
+    while (chunk != NULL) {
+        fastalloc_chunk *next = chunk->next;
+        chunk->unmap();
+        delete chunk;
+        chunk = next;
+    }
+    chunk_cnt.store(0);
+    lockFree();
+    memset(free_list, 0, sizeof(free_list));
+    memset(free_cnt, 0, sizeof(free_cnt));
+    for (auto &node_free : large_free) {
+        node_free[0].clear();
+        node_free[1].clear();
+    }
+    unlockFree();
+    generation.fetch_add(1);
+}
+
+// first allocation of a thread: give it its own arena
+static concurrency_fastalloc *new_thread_allocator() {
+    concurrency_mygeneration = fastalloc_pool.generation.load(std::memory_order_relaxed);
+    concurrency_fastalloc *arena = new concurrency_fastalloc;
+    arena->init(fastalloc_pool.onPM, fastalloc_pool.filePath);
+    if (fastalloc_pool.numa_mode == FASTALLOC_NUMA_LOCAL) {
+        arena->numa_node = fast_alloc_current_node();
+    }
+    fastalloc_pool.registerArena(arena);
+    return arena;
+}
+
+// hand the gaps found by pm recovery to the global free lists, in class sized pieces
+static void add_recovered(vector<pair<char *, uint64_t>> &free_ranges) {
+    fastalloc_pool.lockFree();
+    for (auto &range : free_ranges) {
+        char *ptr = range.first;
+        uint64_t left = range.second;
+        while (left != 0) {
+            uint64_t size = min<uint64_t>(left, FASTALLOC_MAX_CLASS_SIZE);
+            int cls = FASTALLOC_CLASS(size);
+            fastalloc_free_block *block = (fastalloc_free_block *) ptr;
+            block->next = fastalloc_pool.free_list[0][1][cls];
+            fastalloc_pool.free_list[0][1][cls] = block;
+            fastalloc_pool.free_cnt[0][1][cls]++;
+            ptr += size;
+            left -= size;
+        }
+    }
+    fastalloc_pool.unlockFree();
+}
+
 void init_fast_allocator(bool isMultiThread, bool _onPM, string filePath) {
+    if (_onPM) {
+        vector<pair<char *, uint64_t>> free_ranges;
+        fastalloc_pm.open(filePath, free_ranges);
+        add_recovered(free_ranges);
+    }
     if (isMultiThread) {
-        concurrency_myallocator = new concurrency_fastalloc;
-        concurrency_myallocator->init(_onPM, filePath);
+        fastalloc_pool.onPM = _onPM;
+        fastalloc_pool.filePath = filePath;
+        concurrency_myallocator = new_thread_allocator();
     } else {
         myallocator = new fastalloc;
         myallocator->init();
     }
 }
 
-void *fast_alloc(uint64_t size, bool _on_nvm) {
-    return myallocator->alloc(size, _on_nvm);
+void *fast_alloc(uint64_t size, bool _on_nvm, int tag) {
+    return myallocator->alloc(size, _on_nvm, tag);
 }
 
-void *concurrency_fast_alloc(uint64_t size, bool _on_nvm) {
-    return concurrency_myallocator->alloc(size, _on_nvm);
+// the calling thread's arena, replaced if fast_free released it
+static concurrency_fastalloc *thread_allocator() {
+    if (unlikely(concurrency_myallocator == NULL ||
+                 concurrency_mygeneration != fastalloc_pool.generation.load(std::memory_order_relaxed))) {
+        concurrency_myallocator = new_thread_allocator();
+    }
+    return concurrency_myallocator;
+}
+
+void *concurrency_fast_alloc(uint64_t size, bool _on_nvm, int tag) {
+    return thread_allocator()->alloc(size, _on_nvm, tag);
+}
+
+void fast_dealloc(void *ptr, uint64_t size, bool _on_nvm, int tag) {
+    myallocator->dealloc(ptr, size, _on_nvm, tag);
+}
+
+void concurrency_fast_dealloc(void *ptr, uint64_t size, bool _on_nvm, int tag) {
+    thread_allocator()->dealloc(ptr, size, _on_nvm, tag);
+}
+
+void *fast_alloc_pm_reserve(uint64_t size, int tag) {
+    return thread_allocator()->reserve(size, true, tag);
+}
+
+void fast_alloc_pm_publish(void *ptr, uint64_t size, uint64_t *link, uint64_t value) {
+    fastalloc_pm.logged(FASTALLOC_PM_LOG_PUBLISH, ptr, size, link, value);
+}
+
+void fast_alloc_pm_release(void *ptr, uint64_t size, uint64_t *link, uint64_t value, int tag) {
+    fastalloc_pm.logged(FASTALLOC_PM_LOG_RELEASE, ptr, size, link, value);
+    thread_allocator()->recycle(ptr, size, true, tag);
+}
+
+fastalloc_stats fast_alloc_stats() {
+    fastalloc_stats res;
+    if (myallocator != NULL) {
+        res.add(myallocator->stats);
+    }
+    for (concurrency_fastalloc *arena = fastalloc_pool.arenas.load(std::memory_order_acquire);
+         arena != NULL; arena = arena->next_arena) {
+        res.add(arena->stats);
+    }
+    for (int i = 0; i < FASTALLOC_PAGE_MODE_NUM; i++) {
+        res.page_bytes[i] = page_bytes[i].load(std::memory_order_relaxed);
+    }
+    for (int i = 0; i < FASTALLOC_MAX_NUMA_NODES; i++) {
+        res.numa_bytes[i] = numa_bytes[i].load(std::memory_order_relaxed);
+    }
+    return res;
+}
+
+vector<fastalloc_stats> fast_alloc_arena_stats() {
+    vector<fastalloc_stats> res;
+    for (concurrency_fastalloc *arena = fastalloc_pool.arenas.load(std::memory_order_acquire);
+         arena != NULL; arena = arena->next_arena) {
+        res.push_back(arena->stats);
+    }
+    return res;
 }
 
 void fast_free() {
     if (myallocator != NULL) {
         myallocator->free();
         delete myallocator;
+        myallocator = NULL;
     }
 
-    if (concurrency_myallocator != NULL) {
-        concurrency_myallocator->free();
-        delete concurrency_myallocator;
-    }
+    // every thread arena and every pool chunk
+    fastalloc_pool.free();
+    concurrency_myallocator = NULL;
+    fastalloc_pm.close();
 }
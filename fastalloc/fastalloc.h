@@ -6,7 +6,12 @@
 #include <atomic>
 #include <thread>
 #include <sys/mman.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 #include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
 
 #ifndef NVMKV_FASTALLOC_H
 #define NVMKV_FASTALLOC_H
@@ -14,9 +19,22 @@
 #define ALLOC_SIZE ((size_t)4<<30)
 #define CONCURRENCY_ALLOC_SIZE ((size_t)4<<28)
 #define CACHELINESIZE (64)
+#define FASTALLOC_PAGE_SIZE ((size_t)4<<10)
+#define FASTALLOC_HUGE_PAGE_SIZE ((size_t)2<<20)
+#define FASTALLOC_GIANT_PAGE_SIZE ((size_t)1<<30)
+#define FASTALLOC_ALIGN(size, align) (((size) + (align) - 1) / (align) * (align))
 
 #define MAP_SYNC 0x080000
 #define MAP_SHARED_VALIDATE 0x03
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
 
 #define likely(x)   (__builtin_expect(!!(x), 1))
 #define unlikely(x) (__builtin_expect(!!(x), 0))
@@ -24,43 +42,346 @@
 
 using namespace std;
 
+/*
+ * Chunks only reserve address space: DRAM (and emulated nvm) chunks are anonymous
+ * MAP_NORESERVE mappings whose pages are committed by the kernel on first touch, so a
+ * 4 GB chunk costs nothing until it is used. Chunks are recorded in unbounded lists and
+ * an allocation larger than a chunk gets a dedicated mapping of its own.
+ *
+ * Huge page backing for DRAM chunks. Each mode falls back to the next weaker one when the
+ * kernel cannot provide it: 1 GB hugetlb -> 2 MB hugetlb -> THP -> regular pages. hugetlb
+ * chunks are reserved up front (no MAP_NORESERVE), so a short huge page pool is detected
+ * when the chunk is mapped rather than by a SIGBUS later. THP chunks are 2 MB aligned so
+ * the whole chunk is eligible.
+ */
+enum fastalloc_page_mode {
+    FASTALLOC_PAGE_DEFAULT,
+    // madvise(MADV_HUGEPAGE), 2 MB transparent huge pages
+    FASTALLOC_PAGE_THP,
+    // MAP_HUGETLB with 2 MB pages
+    FASTALLOC_PAGE_HUGETLB,
+    // MAP_HUGETLB with 1 GB pages
+    FASTALLOC_PAGE_HUGETLB_1G,
+    FASTALLOC_PAGE_MODE_NUM
+};
+
+// takes effect for chunks mapped afterwards, call it before init_fast_allocator
+void set_fast_alloc_page_mode(fastalloc_page_mode mode);
+
+// "default", "thp", "hugetlb" or "hugetlb1g"
+const char *fast_alloc_page_mode_name(fastalloc_page_mode mode);
+
+/*
+ * NUMA placement of the concurrent arenas, applied with mbind(2) to each chunk before it is
+ * touched, so no libnuma is needed. In FASTALLOC_NUMA_LOCAL mode an arena belongs to the node
+ * its thread runs on when the arena is created: its chunks prefer that node and it spills to
+ * and refills from that node's global free lists, so pin threads before their first
+ * allocation. FASTALLOC_NUMA_INTERLEAVE spreads every chunk over all online nodes, for trees
+ * whose upper levels are read by threads on every socket.
+ */
+
+#define FASTALLOC_MAX_NUMA_NODES 8
+// mempolicy modes of linux/mempolicy.h
+#define FASTALLOC_MPOL_PREFERRED 1
+#define FASTALLOC_MPOL_INTERLEAVE 3
+
+enum fastalloc_numa_mode {
+    FASTALLOC_NUMA_NONE,
+    FASTALLOC_NUMA_LOCAL,
+    FASTALLOC_NUMA_INTERLEAVE,
+    FASTALLOC_NUMA_MODE_NUM
+};
+
+// takes effect for arenas and chunks created afterwards
+void set_fast_alloc_numa_mode(fastalloc_numa_mode mode);
+
+// "none", "local" or "interleave"
+const char *fast_alloc_numa_mode_name(fastalloc_numa_mode mode);
+
+// number of online nodes, capped at FASTALLOC_MAX_NUMA_NODES
+int fast_alloc_numa_nodes();
+
+// node of the cpu the calling thread runs on
+int fast_alloc_current_node();
+
+/*
+ * Freed blocks are kept on size-class free lists: one class per 64 B multiple up to
+ * FASTALLOC_MAX_CLASS_SIZE, and an exact-size list per larger size (directories, segments).
+ * Each allocator keeps its own lists as a per-thread cache; a concurrent arena spills half of
+ * a class list to the global pool once it exceeds FASTALLOC_CACHE_LIMIT blocks and refills
+ * from the pool before bumping. Large blocks always go through the pool.
+ * Reused blocks are zeroed, since callers rely on fresh memory reading as zero.
+ */
+
+#define FASTALLOC_CLASS_NUM 64
+#define FASTALLOC_MAX_CLASS_SIZE (FASTALLOC_CLASS_NUM * CACHELINESIZE)
+#define FASTALLOC_CACHE_LIMIT 512
+#define FASTALLOC_ROUND(size) ((size) / CACHELINESIZE * CACHELINESIZE + (!!((size) % CACHELINESIZE)) * CACHELINESIZE)
+#define FASTALLOC_CLASS(size) ((size) / CACHELINESIZE - 1)
+
+/*
+ * Objects of at most FASTALLOC_SMALL_MAX_SIZE bytes (16 B leaves, 8 B values and keys) come
+ * from small size classes of 16, 24, 32 and 48 bytes instead of a whole cache line. Each
+ * class carves its blocks from FASTALLOC_SLAB_SIZE slabs taken from the regular classes, and
+ * its freed blocks stay on the arena's own free list. FASTALLOC_SMALL_PACKED places blocks
+ * back to back, so a 24 or 48 B block may straddle two cache lines; FASTALLOC_SMALL_ALIGNED
+ * never lets a block cross a line, so it is persisted by a single flush, at the cost of the
+ * line tail. A pm pool does not use the small classes: its allocation bitmaps have one bit per
+ * 64 B granule, so a small object there takes a whole line and is allocated and freed through
+ * the bitmaps like any other block.
+ */
+
+#define FASTALLOC_SMALL_CLASS_NUM 4
+#define FASTALLOC_SMALL_MAX_SIZE 48
+#define FASTALLOC_SLAB_SIZE ((size_t)4<<10)
+#define FASTALLOC_SMALL_CLASS(size) ((size) <= 16 ? 0 : (size) <= 24 ? 1 : (size) <= 32 ? 2 : 3)
+
+enum fastalloc_small_mode {
+    FASTALLOC_SMALL_OFF,
+    FASTALLOC_SMALL_PACKED,
+    FASTALLOC_SMALL_ALIGNED,
+    FASTALLOC_SMALL_MODE_NUM
+};
+
+// the mode must not change while blocks are allocated, call it before init_fast_allocator
+void set_fast_alloc_small_mode(fastalloc_small_mode mode);
+
+// "off", "packed" or "aligned"
+const char *fast_alloc_small_mode_name(fastalloc_small_mode mode);
+
+// true if size falls in a small class under the current mode; fastalloc::isSmall also keeps pm pools out
+bool fast_alloc_is_small(uint64_t size);
+
+class fastalloc_free_block {
+public:
+    fastalloc_free_block *next;
+};
+
+/*
+ * Allocation tags. Call sites pass the tag of the object type they allocate, registered once
+ * by name with fast_alloc_tag, and every allocator keeps live counts and bytes per tag.
+ * Tag 0 collects untagged allocations. The per tag counters are plain per-arena counters;
+ * an object freed by another thread than the one that allocated it is subtracted from that
+ * thread's arena, so only the sums over all arenas are meaningful per tag.
+ */
+
+#define FASTALLOC_MAX_TAGS 64
+#define FASTALLOC_TAG_UNTAGGED 0
+
+// id of the tag called name, registered on first use; tags past FASTALLOC_MAX_TAGS fall back to 0
+int fast_alloc_tag(const char *name);
+
+const char *fast_alloc_tag_name(int tag);
+
+// number of registered tags, including FASTALLOC_TAG_UNTAGGED
+int fast_alloc_tag_num();
+
+class fastalloc_tag_stats {
+public:
+    uint64_t alloc_cnt = 0;
+    uint64_t free_cnt = 0;
+    // live bytes as asked for by callers
+    uint64_t requested_bytes = 0;
+    // live bytes after size class rounding
+    uint64_t rounded_bytes = 0;
+
+    uint64_t live_cnt() { return alloc_cnt - free_cnt; }
+
+    void add(const fastalloc_tag_stats &other);
+};
+
+class fastalloc_stats {
+public:
+    // bytes mapped for chunks
+    uint64_t chunk_bytes = 0;
+    // bytes ever carved from chunks by bumping
+    uint64_t bump_bytes = 0;
+    // bytes asked for by callers, before rounding
+    uint64_t requested_bytes = 0;
+    uint64_t freed_bytes = 0;
+    uint64_t reused_bytes = 0;
+    // DRAM bytes mapped per backing actually obtained, indexed by fastalloc_page_mode
+    uint64_t page_bytes[FASTALLOC_PAGE_MODE_NUM] = {};
+    // chunk bytes preferring each node in FASTALLOC_NUMA_LOCAL mode
+    uint64_t numa_bytes[FASTALLOC_MAX_NUMA_NODES] = {};
+    fastalloc_tag_stats tags[FASTALLOC_MAX_TAGS];
+
+    // bytes sitting on free lists
+    uint64_t free_bytes() { return freed_bytes - reused_bytes; }
+
+    uint64_t live_bytes() { return bump_bytes - free_bytes(); }
+
+    // share of carved memory that is free but not returned to the chunks
+    double fragmentation() { return bump_bytes ? (double) free_bytes() / bump_bytes : 0; }
+
+    void add(const fastalloc_stats &other);
+};
+
+class fastalloc_chunk {
+public:
+    char *addr = NULL;
+    uint64_t size = 0;
+    bool on_pm = false;
+    // backing actually obtained, see fastalloc_page_mode
+    fastalloc_page_mode backing = FASTALLOC_PAGE_DEFAULT;
+    // node the chunk was bound to in FASTALLOC_NUMA_LOCAL mode, -1 otherwise
+    int numa_node = -1;
+    // next chunk in fastalloc_chunk_pool::chunks
+    fastalloc_chunk *next = NULL;
+
+    void unmap();
+};
+
 class fastalloc {
 
 public:
     bool is_used = false;
-    char *dram[100];
+    vector<fastalloc_chunk> dram;
     char *dram_curr = NULL;
     uint64_t dram_left = 0;
-    uint64_t dram_cnt = 0;
 
-    char *nvm[100];
+    vector<fastalloc_chunk> nvm;
     char *nvm_curr = NULL;
     uint64_t nvm_left = 0;
-    uint64_t nvm_cnt = 0;
     bool onPM = false;
     string filePath;
+    uint64_t chunk_size = ALLOC_SIZE;
+
+    // [_on_nvm][size class]
+    fastalloc_free_block *free_list[2][FASTALLOC_CLASS_NUM] = {};
+    uint64_t free_cnt[2][FASTALLOC_CLASS_NUM] = {};
+    map<uint64_t, vector<void *>> large_free[2];
+    // [_on_nvm][small class]
+    fastalloc_free_block *small_free[2][FASTALLOC_SMALL_CLASS_NUM] = {};
+    char *slab_curr[2][FASTALLOC_SMALL_CLASS_NUM] = {};
+    uint64_t slab_left[2][FASTALLOC_SMALL_CLASS_NUM] = {};
+    fastalloc_stats stats;
 
     fastalloc();
 
     virtual void init();
 
-    virtual void *alloc(uint64_t size, bool _on_nvm = true);
+    // reserve a block and, on a pm pool, mark it allocated
+    virtual void *alloc(uint64_t size, bool _on_nvm = true, int tag = FASTALLOC_TAG_UNTAGGED);
+
+    // a block that is not marked in the pm allocation bitmaps
+    void *reserve(uint64_t size, bool _on_nvm = true, int tag = FASTALLOC_TAG_UNTAGGED);
+
+    // give back a block of the size and tag it was allocated with
+    virtual void dealloc(void *ptr, uint64_t size, bool _on_nvm = true, int tag = FASTALLOC_TAG_UNTAGGED);
+
+    // put a block on the free lists without touching the pm allocation bitmaps
+    void recycle(void *ptr, uint64_t size, bool _on_nvm = true, int tag = FASTALLOC_TAG_UNTAGGED);
+
+    // a block of a regular class, size already rounded
+    void *take(uint64_t size, bool _on_nvm);
+
+    // true if size comes from a small class, never on a pm pool
+    bool isSmall(uint64_t size, bool _on_nvm);
+
+    // a block of small class cls
+    void *takeSmall(int cls, bool _on_nvm);
 
     virtual void free();
+
+    // reserve a chunk of at least size bytes
+    virtual char *newChunk(bool _on_nvm, uint64_t size);
+
+    // refill an empty class list, false if nothing is available
+    virtual bool refillClass(int kind, int cls) { return false; }
+
+    virtual void spillClass(int kind, int cls) {}
+
+    virtual void *reuseLarge(uint64_t size, bool _on_nvm);
+
+    virtual void releaseLarge(void *ptr, uint64_t size, bool _on_nvm);
+};
+
+/*
+ * Chunks for the per-thread arenas of the concurrent allocator.
+ *
+ * Arenas are created lazily on the first concurrency_fast_alloc of each thread and take
+ * CONCURRENCY_ALLOC_SIZE chunks from this pool. A chunk is handed out with one fetch_add on
+ * chunk_cnt and recorded by a CAS push onto the chunk list, so threads never block each
+ * other here; the chunk list and the arena list are what fast_free walks to release everything.
+ */
+
+class concurrency_fastalloc;
+
+class fastalloc_chunk_pool {
+
+public:
+    bool onPM = false;
+    string filePath;
+    std::atomic<uint64_t> chunk_cnt{0};
+    std::atomic<fastalloc_chunk *> chunks{NULL};
+    // registered arenas, pushed lock-free by their owner threads
+    std::atomic<concurrency_fastalloc *> arenas{NULL};
+    // bumped by fast_free so threads drop arenas that were already released
+    std::atomic<uint64_t> generation{1};
+
+    fastalloc_numa_mode numa_mode = FASTALLOC_NUMA_NONE;
+
+    // global free lists behind the per-thread caches, one set per node, guarded by free_lock
+    std::atomic<bool> free_lock{false};
+    fastalloc_free_block *free_list[FASTALLOC_MAX_NUMA_NODES][2][FASTALLOC_CLASS_NUM] = {};
+    uint64_t free_cnt[FASTALLOC_MAX_NUMA_NODES][2][FASTALLOC_CLASS_NUM] = {};
+    map<uint64_t, vector<void *>> large_free[FASTALLOC_MAX_NUMA_NODES][2];
+
+    // map a chunk and apply the numa policy for node
+    char *newChunk(bool _on_pm, uint64_t size, int node);
+
+    void lockFree();
+
+    void unlockFree();
+
+    void registerArena(concurrency_fastalloc *arena);
+
+    void free();
 };
 
 class concurrency_fastalloc : public fastalloc {
 
 public:
+    concurrency_fastalloc *next_arena = NULL;
+    // node whose chunks and global free lists this arena uses
+    int numa_node = 0;
+
     void init(bool _onPM, string _filePath);
+
+    char *newChunk(bool _on_nvm, uint64_t size) override;
+
+    bool refillClass(int kind, int cls) override;
+
+    void spillClass(int kind, int cls) override;
+
+    void *reuseLarge(uint64_t size, bool _on_nvm) override;
+
+    void releaseLarge(void *ptr, uint64_t size, bool _on_nvm) override;
+
+    // chunks belong to the pool and are released by fastalloc_chunk_pool::free
+    void free() override;
 };
 
 void init_fast_allocator(bool isMultiThread, bool _onPM = false, string filePath = NULL);
 
-void *fast_alloc(uint64_t size, bool _on_nvm = true);
+void *fast_alloc(uint64_t size, bool _on_nvm = true, int tag = FASTALLOC_TAG_UNTAGGED);
 
-void *concurrency_fast_alloc(uint64_t size, bool _on_nvm = true);
+void *concurrency_fast_alloc(uint64_t size, bool _on_nvm = true, int tag = FASTALLOC_TAG_UNTAGGED);
+
+void fast_dealloc(void *ptr, uint64_t size, bool _on_nvm = true, int tag = FASTALLOC_TAG_UNTAGGED);
+
+void concurrency_fast_dealloc(void *ptr, uint64_t size, bool _on_nvm = true, int tag = FASTALLOC_TAG_UNTAGGED);
+
+// counters summed over every allocator and arena; approximate while other threads allocate
+fastalloc_stats fast_alloc_stats();
+
+// counters of each concurrent arena, newest first
+vector<fastalloc_stats> fast_alloc_arena_stats();
 
 void fast_free();
 
+#include "fastalloc_pm.h"
+#include "fastalloc_emu.h"
+
 #endif
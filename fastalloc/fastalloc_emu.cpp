@@ -0,0 +1,46 @@
+#include "fastalloc_emu.h"
+#include <chrono>
+
+// TSC deadline by which every line flushed so far has drained at the bandwidth cap
+static std::atomic<uint64_t> bandwidth_next{0};
+
+// TSC cycles per microsecond, measured once
+static uint64_t tsc_per_us() {
+    static uint64_t res = 0;
+    if (res == 0) {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t tsc = __rdtsc();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(20));
+        uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        res = max<uint64_t>((__rdtsc() - tsc) / us, 1);
+    }
+    return res;
+}
+
+void set_fast_alloc_pm_emulation(uint64_t latency_ns, uint64_t bandwidth_mb) {
+    pm_emu_line_cycles = latency_ns * tsc_per_us() / 1000;
+    // MB/s is bytes per microsecond
+    pm_emu_bandwidth_cycles = bandwidth_mb == 0 ? 0 : max<uint64_t>(CACHELINESIZE * tsc_per_us() / bandwidth_mb, 1);
+    bandwidth_next.store(0);
+}
+
+bool fast_alloc_pm_emulated() {
+    return pm_emulated;
+}
+
+void pm_emulate_wait(uint64_t lines) {
+    uint64_t now = __rdtsc();
+    uint64_t deadline = now + lines * pm_emu_line_cycles;
+    if (pm_emu_bandwidth_cycles != 0) {
+        uint64_t cost = lines * pm_emu_bandwidth_cycles;
+        uint64_t prev = bandwidth_next.load(std::memory_order_relaxed);
+        uint64_t start;
+        do {
+            start = max(prev, now);
+        } while (!bandwidth_next.compare_exchange_weak(prev, start + cost, std::memory_order_relaxed));
+        deadline = max(deadline, start + cost);
+    }
+    while (__rdtsc() < deadline) {
+        _mm_pause();
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef NVMKV_FASTALLOC_EMU_H
+#define NVMKV_FASTALLOC_EMU_H
+
+#include "fastalloc.h"
+#include <x86intrin.h>
+
+/*
+ * PM emulation for machines without Optane.
+ *
+ * Pool files are mapped with MAP_SHARED when the filesystem has no DAX support for MAP_SYNC,
+ * and the clflush helpers of every index report the lines they flushed through
+ * pm_emulate_flush. With set_fast_alloc_pm_emulation each flushed line costs an extra
+ * write-back latency, and all threads together cannot flush faster than the bandwidth cap.
+ * Both are busy-waits on the TSC. The per-thread flush counter is always maintained.
+ */
+
+// TSC cycles added per flushed line, 0 when the latency is off
+inline uint64_t pm_emu_line_cycles = 0;
+// TSC cycles one line takes at the bandwidth cap, 0 when the cap is off
+inline uint64_t pm_emu_bandwidth_cycles = 0;
+// cache lines flushed by this thread
+inline thread_local uint64_t pm_flush_lines = 0;
+// set when a pool file had to be mapped with MAP_SHARED
+inline bool pm_emulated = false;
+
+// latency_ns per flushed line and at most bandwidth_mb MB/s over all threads, 0 disables either
+void set_fast_alloc_pm_emulation(uint64_t latency_ns, uint64_t bandwidth_mb);
+
+// true if a pool file was mapped with MAP_SHARED because MAP_SYNC is not supported
+bool fast_alloc_pm_emulated();
+
+void pm_emulate_wait(uint64_t lines);
+
+// call after flushing lines cache lines
+inline void pm_emulate_flush(uint64_t lines) {
+    pm_flush_lines += lines;
+    if (unlikely(pm_emu_line_cycles | pm_emu_bandwidth_cycles)) {
+        pm_emulate_wait(lines);
+    }
+}
+
+// cache lines covered by [data, data + len)
+inline uint64_t pm_flush_line_num(const void *data, uint64_t len) {
+    uint64_t first = (uint64_t) data / CACHELINESIZE;
+    return len == 0 ? 0 : ((uint64_t) data + len - 1) / CACHELINESIZE - first + 1;
+}
+
+#endif //NVMKV_FASTALLOC_EMU_H
@@ -0,0 +1,363 @@
+#include "fastalloc_pm.h"
+#include <sys/stat.h>
+#include <errno.h>
+
+fastalloc_pm_pool fastalloc_pm;
+
+static inline void mfence(void) {
+    asm volatile("mfence":: :"memory");
+}
+
+static inline void clflush(char *data, size_t len) {
+    volatile char *ptr = (char *) ((unsigned long) data & (~(CACHELINESIZE - 1)));
+    mfence();
+    for (; ptr < data + len; ptr += CACHELINESIZE) {
+        asm volatile("clflush %0" : "+m" (*(volatile char *) ptr));
+    }
+    pm_emulate_flush(pm_flush_line_num(data, len));
+    mfence();
+}
+
+// MAP_SYNC needs a DAX filesystem; without one fall back to MAP_SHARED and emulate PM
+static void *map_pm_fd(int fd, uint64_t size, char *fixed) {
+    int fixed_flag = fixed != NULL ? MAP_FIXED_NOREPLACE : 0;
+    if (!pm_emulated) {
+        void *addr = mmap(fixed, size, PROT_READ | PROT_WRITE, MAP_SYNC | MAP_SHARED_VALIDATE | fixed_flag, fd, 0);
+        if (addr != MAP_FAILED || (errno != EOPNOTSUPP && errno != EINVAL)) {
+            return addr;
+        }
+        pm_emulated = true;
+        puts("fastalloc: MAP_SYNC is not supported, emulating PM with MAP_SHARED");
+    }
+    return mmap(fixed, size, PROT_READ | PROT_WRITE, MAP_SHARED | fixed_flag, fd, 0);
+}
+
+// map size bytes of a pm file, at fixed if it is free and anywhere otherwise; create starts from a zeroed file
+static char *map_pm_file(string filename, uint64_t size, bool create, char *fixed) {
+    int fd = ::open(filename.c_str(), create ? O_CREAT | O_RDWR : O_RDWR, 0644);
+    if (fd < 0) {
+        perror(("fastalloc: open " + filename).c_str());
+        exit(1);
+    }
+    // a file left behind by an older pool may hold stale bitmaps
+    if (create && (ftruncate(fd, 0) != 0 || posix_fallocate(fd, 0, size) != 0))
+        puts("fallocate fail\n");
+    void *addr = MAP_FAILED;
+    if (fixed != NULL) {
+        addr = map_pm_fd(fd, size, fixed);
+        if (addr != MAP_FAILED && addr != fixed) {
+            // a kernel without MAP_FIXED_NOREPLACE took it as a hint
+            munmap(addr, size);
+            addr = MAP_FAILED;
+        }
+    }
+    if (addr == MAP_FAILED) {
+        addr = map_pm_fd(fd, size, NULL);
+    }
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        perror("fastalloc: mmap");
+        exit(1);
+    }
+    return (char *) addr;
+}
+
+static char *fixed_addr(uint64_t index) {
+    return (char *) (FASTALLOC_PM_BASE + index * FASTALLOC_PM_STRIDE);
+}
+
+// 64-bit words of one bitmap of a chunk with size usable bytes
+static uint64_t bitmap_words(uint64_t size) {
+    return (size / CACHELINESIZE + 63) / 64;
+}
+
+// bytes behind the usable part of a chunk: the start bitmap, then the used bitmap
+static uint64_t meta_size(uint64_t size) {
+    return FASTALLOC_ALIGN(2 * bitmap_words(size) * sizeof(uint64_t), FASTALLOC_PAGE_SIZE);
+}
+
+static inline bool test_bit(uint64_t *bits, uint64_t i) {
+    return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+// set or clear bits [first, first + n) and persist them
+static void update_bits(uint64_t *bits, uint64_t first, uint64_t n, bool set) {
+    for (uint64_t i = first; i < first + n;) {
+        uint64_t len = min<uint64_t>(64 - i % 64, first + n - i);
+        uint64_t mask = (len == 64 ? ~0ULL : ((1ULL << len) - 1)) << (i % 64);
+        if (set) {
+            __atomic_fetch_or(&bits[i / 64], mask, __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_and(&bits[i / 64], ~mask, __ATOMIC_RELAXED);
+        }
+        i += len;
+    }
+    clflush((char *) &bits[first / 64], (first + n - 1) / 64 * 8 - first / 64 * 8 + 8);
+}
+
+void fastalloc_pm_pool::open(string _path, vector<pair<char *, uint64_t>> &free_ranges) {
+    if (header != NULL) {
+        close();
+    }
+    path = _path;
+    string header_file = path + "pool";
+    uint64_t header_size = FASTALLOC_ALIGN(sizeof(fastalloc_pm_header), FASTALLOC_PAGE_SIZE);
+    struct stat st;
+    reopened = reopen && stat(header_file.c_str(), &st) == 0 && (uint64_t) st.st_size >= header_size;
+    header = (fastalloc_pm_header *) map_pm_file(header_file, header_size, !reopened, NULL);
+    if (reopened && header->magic != FASTALLOC_PM_MAGIC) {
+        // torn creation, nothing was published yet
+        reopened = false;
+    }
+    if (!reopened) {
+        // chunks are numbered from 0 again, drop the files of the old pool
+        for (int i = 0; ::remove((path + to_string(i)).c_str()) == 0; i++) {
+        }
+        memset(header, 0, sizeof(fastalloc_pm_header));
+        header->pool_id = ((uint64_t) time(NULL) ^ ((uint64_t) getpid() << 8)) % 0xffff + 1;
+        clflush((char *) header, sizeof(fastalloc_pm_header));
+        header->magic = FASTALLOC_PM_MAGIC;
+        clflush((char *) &header->magic, sizeof(uint64_t));
+        return;
+    }
+    relocated = 0;
+    for (uint64_t i = 0; i < header->chunk_cnt; i++) {
+        uint64_t size = header->chunks[i].size;
+        chunk_addr[i] = map_pm_file(path + to_string(i), size + meta_size(size), false, fixed_addr(i));
+        if (chunk_addr[i] != fixed_addr(i)) {
+            relocated++;
+        }
+    }
+    recover(free_ranges);
+}
+
+void fastalloc_pm_pool::recover(vector<pair<char *, uint64_t>> &free_ranges) {
+    recovery = fastalloc_pm_recovery();
+    for (auto &log : header->logs) {
+        if (log.op != 0 && log.checksum == log.sum()) {
+            // redo: marking and storing the link are idempotent
+            mark(addr(log.block), log.size, log.op == FASTALLOC_PM_LOG_PUBLISH);
+            // a link outside the pool died with the process
+            uint64_t *link = (uint64_t *) addr(log.link);
+            if (link != NULL) {
+                *link = log.value;
+                clflush((char *) link, sizeof(uint64_t));
+            }
+            recovery.replayed++;
+        }
+        log.op = 0;
+        clflush((char *) &log.op, sizeof(uint64_t));
+    }
+    for (uint64_t i = 0; i < header->chunk_cnt; i++) {
+        uint64_t n = header->chunks[i].size / CACHELINESIZE;
+        uint64_t *start = bitmap(i);
+        uint64_t *used = start + bitmap_words(header->chunks[i].size);
+        // end of the last live block
+        uint64_t live_end = 0;
+        uint64_t g = 0;
+        while (g < n) {
+            if (start[g / 64] >> (g % 64) == 0) {
+                g = (g / 64 + 1) * 64;
+                continue;
+            }
+            g += __builtin_ctzll(start[g / 64] >> (g % 64));
+            if (g >= n) {
+                break;
+            }
+            if (g > live_end) {
+                // torn marks in the gap read as free, clear them
+                update_bits(used, live_end, g - live_end, false);
+                free_ranges.push_back({chunk_addr[i] + live_end * CACHELINESIZE, (g - live_end) * CACHELINESIZE});
+                recovery.reclaimed_bytes += (g - live_end) * CACHELINESIZE;
+            }
+            uint64_t e = g + 1;
+            while (e < n) {
+                if (e % 64 == 0 && used[e / 64] == ~0ULL && start[e / 64] == 0) {
+                    e += 64;
+                    continue;
+                }
+                if (!test_bit(used, e) || test_bit(start, e)) {
+                    break;
+                }
+                e++;
+            }
+            recovery.live_blocks++;
+            recovery.live_bytes += (e - g) * CACHELINESIZE;
+            live_end = e;
+            g = e;
+        }
+        if (live_end < n) {
+            update_bits(used, live_end, n - live_end, false);
+        }
+        recovery.unused_bytes += (n - live_end) * CACHELINESIZE;
+    }
+}
+
+char *fastalloc_pm_pool::newChunk(uint64_t size) {
+    if (size > FASTALLOC_PM_STRIDE) {
+        printf("fastalloc: pm chunk of %lu bytes exceeds the pool stride\n", size);
+        exit(1);
+    }
+    while (lock.exchange(true, std::memory_order_acquire)) {
+        __builtin_ia32_pause();
+    }
+    uint64_t index = header->chunk_cnt;
+    if (index == FASTALLOC_PM_MAX_CHUNKS) {
+        puts("fastalloc: pm chunk table full");
+        exit(1);
+    }
+    char *addr = map_pm_file(path + to_string(index), size + meta_size(size), true, fixed_addr(index));
+    if (addr != fixed_addr(index)) {
+        relocated++;
+    }
+    chunk_addr[index] = addr;
+    header->chunks[index].size = size;
+    header->chunks[index].addr = (uint64_t) addr;
+    clflush((char *) &header->chunks[index], sizeof(fastalloc_pm_chunk_entry));
+    header->chunk_cnt = index + 1;
+    clflush((char *) &header->chunk_cnt, sizeof(uint64_t));
+    lock.store(false, std::memory_order_release);
+    return addr;
+}
+
+uint64_t fastalloc_pm_pool::offset(void *ptr) {
+    if (ptr == NULL) {
+        return 0;
+    }
+    uint64_t id = header->pool_id << FASTALLOC_PM_ID_SHIFT;
+    uint64_t p = (uint64_t) ptr;
+    uint64_t index = (p - FASTALLOC_PM_BASE) / FASTALLOC_PM_STRIDE;
+    if (p >= FASTALLOC_PM_BASE && index < FASTALLOC_PM_MAX_CHUNKS && chunk_addr[index] == fixed_addr(index)) {
+        return id | (p - FASTALLOC_PM_BASE);
+    }
+    if (relocated != 0) {
+        for (uint64_t i = 0; i < header->chunk_cnt; i++) {
+            if (p >= (uint64_t) chunk_addr[i] && p < (uint64_t) chunk_addr[i] + header->chunks[i].size) {
+                return id | (i * FASTALLOC_PM_STRIDE + p - (uint64_t) chunk_addr[i]);
+            }
+        }
+    }
+    return p;
+}
+
+void *fastalloc_pm_pool::addr(uint64_t offset) {
+    if (header == NULL || (offset >> FASTALLOC_PM_ID_SHIFT) != header->pool_id) {
+        return NULL;
+    }
+    offset &= FASTALLOC_PM_OFFSET_MASK;
+    return chunk_addr[offset / FASTALLOC_PM_STRIDE] + offset % FASTALLOC_PM_STRIDE;
+}
+
+void *fastalloc_pm_pool::root(uint64_t size) {
+    while (lock.exchange(true, std::memory_order_acquire)) {
+        __builtin_ia32_pause();
+    }
+    void *res;
+    if (header->root_offset != 0 && header->root_size >= size) {
+        res = addr(header->root_offset);
+    } else {
+        // allocation takes the lock again when it needs a chunk
+        lock.store(false, std::memory_order_release);
+        res = concurrency_fast_alloc(size);
+        while (lock.exchange(true, std::memory_order_acquire)) {
+            __builtin_ia32_pause();
+        }
+        header->root_size = size;
+        clflush((char *) &header->root_size, sizeof(uint64_t));
+        header->root_offset = offset(res);
+        clflush((char *) &header->root_offset, sizeof(uint64_t));
+    }
+    lock.store(false, std::memory_order_release);
+    return res;
+}
+
+int fastalloc_pm_pool::chunkOf(void *ptr) {
+    uint64_t p = (uint64_t) ptr;
+    uint64_t index = (p - FASTALLOC_PM_BASE) / FASTALLOC_PM_STRIDE;
+    if (p >= FASTALLOC_PM_BASE && index < FASTALLOC_PM_MAX_CHUNKS && chunk_addr[index] == fixed_addr(index)) {
+        return index;
+    }
+    if (relocated != 0) {
+        for (uint64_t i = 0; i < header->chunk_cnt; i++) {
+            if (p >= (uint64_t) chunk_addr[i] && p < (uint64_t) chunk_addr[i] + header->chunks[i].size) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+uint64_t *fastalloc_pm_pool::bitmap(int index) {
+    return (uint64_t *) (chunk_addr[index] + header->chunks[index].size);
+}
+
+void fastalloc_pm_pool::mark(void *ptr, uint64_t size, bool allocated) {
+    int index = chunkOf(ptr);
+    if (index < 0 || size == 0) {
+        return;
+    }
+    uint64_t *start = bitmap(index);
+    uint64_t *used = start + bitmap_words(header->chunks[index].size);
+    uint64_t first = ((char *) ptr - chunk_addr[index]) / CACHELINESIZE;
+    uint64_t n = FASTALLOC_ROUND(size) / CACHELINESIZE;
+    if (allocated) {
+        update_bits(used, first, n, true);
+        update_bits(start, first, 1, true);
+    } else {
+        update_bits(start, first, 1, false);
+        update_bits(used, first, n, false);
+    }
+}
+
+void fastalloc_pm_pool::logged(uint64_t op, void *ptr, uint64_t size, uint64_t *link, uint64_t value) {
+    static thread_local uint64_t slot = log_next.fetch_add(1) % FASTALLOC_PM_LOG_NUM;
+    while (log_lock[slot].exchange(true, std::memory_order_acquire)) {
+        __builtin_ia32_pause();
+    }
+    fastalloc_pm_log &log = header->logs[slot];
+    log.block = offset(ptr);
+    log.size = size;
+    log.link = offset(link);
+    log.value = value;
+    log.op = op;
+    log.checksum = log.sum();
+    clflush((char *) &log, sizeof(fastalloc_pm_log));
+    if (op == FASTALLOC_PM_LOG_PUBLISH) {
+        mark(ptr, size, true);
+    }
+    *link = value;
+    clflush((char *) link, sizeof(uint64_t));
+    if (op == FASTALLOC_PM_LOG_RELEASE) {
+        mark(ptr, size, false);
+    }
+    log.op = 0;
+    clflush((char *) &log.op, sizeof(uint64_t));
+    log_lock[slot].store(false, std::memory_order_release);
+}
+
+void fastalloc_pm_pool::close() {
+    if (header == NULL) {
+        return;
+    }
+    for (uint64_t i = 0; i < header->chunk_cnt; i++) {
+        munmap(chunk_addr[i], header->chunks[i].size + meta_size(header->chunks[i].size));
+        chunk_addr[i] = NULL;
+    }
+    munmap(header, FASTALLOC_ALIGN(sizeof(fastalloc_pm_header), FASTALLOC_PAGE_SIZE));
+    header = NULL;
+    relocated = 0;
+    reopened = false;
+    recovery = fastalloc_pm_recovery();
+}
+
+void *fast_alloc_pm_root(uint64_t size) {
+    return fastalloc_pm.header == NULL ? NULL : fastalloc_pm.root(size);
+}
+
+void set_fast_alloc_pm_reopen(bool reopen) {
+    fastalloc_pm.reopen = reopen;
+}
+
+bool fast_alloc_pm_reopened() {
+    return fastalloc_pm.header != NULL && fastalloc_pm.reopened;
+}
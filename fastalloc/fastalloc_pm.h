@@ -0,0 +1,201 @@
+#ifndef NVMKV_FASTALLOC_PM_H
+#define NVMKV_FASTALLOC_PM_H
+
+#include "fastalloc.h"
+
+/*
+ * Persistent pool behind the on-PM chunks.
+ *
+ * A pool is the chunk files <path>0, <path>1, ... plus a header file <path>pool holding the
+ * pool id, the chunk table and the root object. Chunk i is mapped at the fixed address
+ * FASTALLOC_PM_BASE + i * FASTALLOC_PM_STRIDE, so the raw pointers the indexes store are
+ * still valid when the pool is opened again. If that range is taken the chunk is mapped
+ * anywhere and counted as relocated: raw pointers into it are stale, but a persistent_ptr
+ * still translates through the chunk table.
+ *
+ * A pool offset is chunk index * FASTALLOC_PM_STRIDE + offset in the chunk, and a persistent
+ * pointer is pool id << FASTALLOC_PM_ID_SHIFT | pool offset. A value whose pool id is zero is
+ * a plain address, so the same type also holds DRAM pointers.
+ *
+ * Allocation state is persistent at cache line granularity. Behind each chunk lie two
+ * bitmaps with one bit per 64 B granule: "used" for every granule of a live block and "start"
+ * for its first granule. A block is set used first and start last, and cleared in the reverse
+ * order, so a set start bit is the commit point and a torn update reads as free.
+ *
+ * concurrency_fast_alloc on PM marks a block as soon as it is handed out, so a crash before
+ * the caller links it leaks the block. fast_alloc_pm_reserve / fast_alloc_pm_publish avoid the
+ * leak: a reserved block stays free until it is published, and publishing writes a redo record
+ * {block, size, link, value} to a log slot in the pool header, marks the block, stores value to
+ * *link and then clears the record. fast_alloc_pm_release does the same for unlink + free.
+ *
+ * A pool is only reopened after set_fast_alloc_pm_reopen(true); otherwise opening recreates it
+ * empty, so blocks left live by an earlier run do not pile up. Reopening replays every complete
+ * log record and scans the bitmaps: the gaps between live blocks go back to the free lists, the
+ * space after the last live block of a chunk is not reused and new allocations go to new chunks.
+ */
+
+#define FASTALLOC_PM_MAGIC 0x314c4f4f504d564bULL
+// 32 TB, far above the heap and below the mmap area
+#define FASTALLOC_PM_BASE ((uint64_t)1 << 45)
+#define FASTALLOC_PM_STRIDE ((uint64_t)1 << 36)
+#define FASTALLOC_PM_MAX_CHUNKS 1024
+#define FASTALLOC_PM_ID_SHIFT 48
+#define FASTALLOC_PM_OFFSET_MASK (((uint64_t)1 << FASTALLOC_PM_ID_SHIFT) - 1)
+#define FASTALLOC_PM_LOG_NUM 64
+#define FASTALLOC_PM_LOG_PUBLISH 1
+#define FASTALLOC_PM_LOG_RELEASE 2
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+// redo record of one publish or release, valid while op != 0 and the checksum matches
+class alignas(CACHELINESIZE) fastalloc_pm_log {
+public:
+    uint64_t op;
+    // pool offsets of the block and of the link word
+    uint64_t block;
+    uint64_t size;
+    uint64_t link;
+    uint64_t value;
+    uint64_t checksum;
+
+    uint64_t sum() { return (op * 0x9e3779b97f4a7c15ULL) ^ block ^ (size << 1) ^ (link << 2) ^ (value * 31) ^ 1; }
+};
+
+class fastalloc_pm_chunk_entry {
+public:
+    // usable bytes, the allocation bitmaps follow them in the chunk file
+    uint64_t size;
+    // address the chunk was mapped at when it was created
+    uint64_t addr;
+};
+
+class fastalloc_pm_header {
+public:
+    uint64_t magic;
+    uint64_t pool_id;
+    // an entry is persisted before chunk_cnt covers it
+    uint64_t chunk_cnt;
+    // pool offset of the root object, 0 if there is none
+    uint64_t root_offset;
+    uint64_t root_size;
+    fastalloc_pm_log logs[FASTALLOC_PM_LOG_NUM];
+    fastalloc_pm_chunk_entry chunks[FASTALLOC_PM_MAX_CHUNKS];
+};
+
+// what the recovery scan of a reopened pool found
+class fastalloc_pm_recovery {
+public:
+    uint64_t replayed = 0;
+    uint64_t live_blocks = 0;
+    uint64_t live_bytes = 0;
+    // gaps between live blocks handed back to the free lists
+    uint64_t reclaimed_bytes = 0;
+    // space after the last live block of each chunk
+    uint64_t unused_bytes = 0;
+};
+
+class fastalloc_pm_pool {
+
+public:
+    string path;
+    fastalloc_pm_header *header = NULL;
+    // current mapping of each chunk in header->chunks
+    char *chunk_addr[FASTALLOC_PM_MAX_CHUNKS] = {};
+    // chunks that could not be mapped at their fixed address
+    uint64_t relocated = 0;
+    // open an existing pool instead of recreating it
+    bool reopen = false;
+    // the header existed and was kept when the pool was opened
+    bool reopened = false;
+    fastalloc_pm_recovery recovery;
+    // guards chunk creation and the root
+    std::atomic<bool> lock{false};
+    std::atomic<bool> log_lock[FASTALLOC_PM_LOG_NUM] = {};
+    std::atomic<uint64_t> log_next{0};
+
+    // open the pool at _path, created anew unless reopen is set and it exists; free_ranges gets the
+    // gaps found by recovery
+    void open(string _path, vector<pair<char *, uint64_t>> &free_ranges);
+
+    // replay the log and rebuild free space from the bitmaps
+    void recover(vector<pair<char *, uint64_t>> &free_ranges);
+
+    // create, map and publish a chunk of size bytes
+    char *newChunk(uint64_t size);
+
+    // pool offset of ptr, ptr itself if it is not in the pool
+    uint64_t offset(void *ptr);
+
+    void *addr(uint64_t offset);
+
+    void *root(uint64_t size);
+
+    // persistently mark [ptr, ptr + size) allocated or free, no-op outside the pool
+    void mark(void *ptr, uint64_t size, bool allocated);
+
+    // failure-atomic publish or release through a log slot
+    void logged(uint64_t op, void *ptr, uint64_t size, uint64_t *link, uint64_t value);
+
+    int chunkOf(void *ptr);
+
+    uint64_t *bitmap(int index);
+
+    // unmap the header and every chunk
+    void close();
+};
+
+extern fastalloc_pm_pool fastalloc_pm;
+
+// pool id << FASTALLOC_PM_ID_SHIFT | pool offset of ptr, or ptr if it is not in the open pool
+inline uint64_t fast_alloc_pm_offset(void *ptr) {
+    return fastalloc_pm.header == NULL ? (uint64_t) ptr : fastalloc_pm.offset(ptr);
+}
+
+// inverse of fast_alloc_pm_offset, NULL for a pointer into a pool that is not open
+inline void *fast_alloc_pm_addr(uint64_t raw) {
+    return likely((raw >> FASTALLOC_PM_ID_SHIFT) == 0) ? (void *) raw : fastalloc_pm.addr(raw);
+}
+
+// root object of the open pool, allocated zeroed with concurrency_fast_alloc on first use
+void *fast_alloc_pm_root(uint64_t size);
+
+// keep the data of an existing pool instead of recreating it, call it before init_fast_allocator
+void set_fast_alloc_pm_reopen(bool reopen);
+
+// true if the open pool already existed, i.e. its chunks and root hold a previous run's data
+bool fast_alloc_pm_reopened();
+
+// zeroed pm block that stays free across a crash until it is published
+void *fast_alloc_pm_reserve(uint64_t size, int tag = FASTALLOC_TAG_UNTAGGED);
+
+// mark a reserved block allocated and store value to *link as one failure-atomic step
+void fast_alloc_pm_publish(void *ptr, uint64_t size, uint64_t *link, uint64_t value);
+
+// store value to *link and free ptr as one failure-atomic step
+void fast_alloc_pm_release(void *ptr, uint64_t size, uint64_t *link, uint64_t value,
+                           int tag = FASTALLOC_TAG_UNTAGGED);
+
+template<class T>
+class persistent_ptr {
+public:
+    uint64_t raw = 0;
+
+    persistent_ptr() {}
+
+    persistent_ptr(T *ptr) : raw(fast_alloc_pm_offset(ptr)) {}
+
+    T *get() const { return (T *) fast_alloc_pm_addr(raw); }
+
+    T *operator->() const { return get(); }
+
+    T &operator*() const { return *get(); }
+
+    explicit operator bool() const { return raw != 0; }
+
+    bool operator==(const persistent_ptr &other) const { return raw == other.raw; }
+
+    bool operator!=(const persistent_ptr &other) const { return raw != other.raw; }
+};
+
+#endif //NVMKV_FASTALLOC_PM_H
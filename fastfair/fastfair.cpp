@@ -13,7 +13,7 @@ ff_key_value::ff_key_value(uint64_t _key, uint64_t _value) : key(_key), value(_v
 }
 
 fastfair *new_fastfair() {
-    fastfair *new_ff = static_cast<fastfair *>(concurrency_fast_alloc(sizeof(fastfair)));
+    fastfair *new_ff = static_cast<fastfair *>(concurrency_fast_alloc(sizeof(fastfair), true, fastfair_tag_tree));
     new_ff->init();
     return new_ff;
 }
@@ -62,7 +62,7 @@ char *fastfair::get(uint64_t key) {
 
 // insert the key in the leaf node
 void fastfair::put(uint64_t key, char *value, int value_len) { // need to be string
-    char *value_allocated = static_cast<char *>(concurrency_fast_alloc(value_len));
+    char *value_allocated = static_cast<char *>(concurrency_fast_alloc(value_len, true, fastfair_tag_value));
     memcpy(value_allocated, value, value_len);
     clflush(value_allocated, value_len);
     page *p = (page *) root;
@@ -7,6 +7,12 @@
 
 #include "../fastalloc/fastalloc.h"
 
+// allocation tags
+inline const int fastfair_tag_tree = fast_alloc_tag("fastfair.tree");
+inline const int fastfair_tag_page = fast_alloc_tag("fastfair.page");
+inline const int fastfair_tag_value = fast_alloc_tag("fastfair.value");
+
+#include <algorithm>
 #include <cassert>
 #include <climits>
 #include <fstream>
@@ -39,6 +45,7 @@ inline void clflush(char *data, int len) {
         asm volatile("clflush %0" : "+m"(*(volatile char *) ptr));
         //++clflush_cnt;
     }
+    pm_emulate_flush(pm_flush_line_num(data, len));
     mfence();
 }
 
@@ -165,7 +172,7 @@ public:
     }
 
     void *operator new(size_t size) {
-        void *ret = concurrency_fast_alloc(size);
+        void *ret = concurrency_fast_alloc(size, true, fastfair_tag_page);
 //        posix_memalign(&ret, 64, size);
         return ret;
     }
@@ -572,85 +579,50 @@ public:
         }
     }
 
-    // Search keys with linear search
+    // Search keys in [min, max] with linear search, from this leaf to the right
     void linear_search_range(uint64_t min, uint64_t max,
                              vector<ff_key_value> &buf) {
-        int i, off = 0;
+        int i;
         uint8_t previous_switch_counter;
         page *current = this;
+        bool done = false;
 
-        while (current) {
-            int old_off = off;
+        while (current && !done) {
+            size_t old_size = buf.size();
             do {
                 previous_switch_counter = current->hdr.switch_counter;
-                off = old_off;
+                // a shift during the read restarts the page
+                buf.resize(old_size);
+                done = false;
 
                 uint64_t tmp_key;
                 char *tmp_ptr;
 
                 if (IS_FORWARD(previous_switch_counter)) {
-                    if ((tmp_key = current->records[0].key) > min) {
-                        if (tmp_key < max) {
-                            if ((tmp_ptr = current->records[0].ptr) != NULL) {
-                                if (tmp_key == current->records[0].key) {
-                                    if (tmp_ptr) {
-//                                        buf[off++] = (unsigned long) tmp_ptr;
-                                        ff_key_value tmp(tmp_key, (uint64_t)tmp_ptr);
-                                        buf.push_back(tmp);
-                                    }
-                                }
-                            }
-                        } else
-                            return;
-                    }
-
-                    for (i = 1; current->records[i].ptr != NULL; ++i) {
-                        if ((tmp_key = current->records[i].key) > min) {
-                            if (tmp_key < max) {
-                                if ((tmp_ptr = current->records[i].ptr) !=
-                                    current->records[i - 1].ptr) {
-                                    if (tmp_key == current->records[i].key) {
-                                        if (tmp_ptr) {
-                                            ff_key_value tmp(tmp_key, (uint64_t) tmp_ptr);
-                                            buf.push_back(tmp);
-                                        }
-                                    }
-                                }
-                            } else
-                                return;
+                    for (i = 0; (tmp_ptr = current->records[i].ptr) != NULL; ++i) {
+                        if ((tmp_key = current->records[i].key) > max) {
+                            done = true;
+                            break;
+                        }
+                        if (tmp_key >= min && (i == 0 || tmp_ptr != current->records[i - 1].ptr) &&
+                            tmp_key == current->records[i].key) {
+                            buf.push_back(ff_key_value(tmp_key, (uint64_t) tmp_ptr));
                         }
                     }
                 } else {
-                    for (i = count() - 1; i > 0; --i) {
-                        if ((tmp_key = current->records[i].key) > min) {
-                            if (tmp_key < max) {
-                                if ((tmp_ptr = current->records[i].ptr) !=
-                                    current->records[i - 1].ptr) {
-                                    if (tmp_key == current->records[i].key) {
-                                        if (tmp_ptr) {
-                                            ff_key_value tmp(tmp_key, (uint64_t) tmp_ptr);
-                                            buf.push_back(tmp);
-                                        }
-                                    }
-                                }
-                            } else
-                                return;
+                    // the keys come largest first: skip those above max instead of stopping at them
+                    for (i = current->count() - 1; i >= 0; --i) {
+                        if ((tmp_key = current->records[i].key) > max) {
+                            done = true;
+                            continue;
+                        }
+                        if ((tmp_ptr = current->records[i].ptr) != NULL && tmp_key >= min &&
+                            (i == 0 || tmp_ptr != current->records[i - 1].ptr) &&
+                            tmp_key == current->records[i].key) {
+                            buf.push_back(ff_key_value(tmp_key, (uint64_t) tmp_ptr));
                         }
                     }
-
-                    if ((tmp_key = current->records[0].key) > min) {
-                        if (tmp_key < max) {
-                            if ((tmp_ptr = current->records[0].ptr) != NULL) {
-                                if (tmp_key == current->records[0].key) {
-                                    if (tmp_ptr) {
-                                        ff_key_value tmp(tmp_key, (uint64_t) tmp_ptr);
-                                        buf.push_back(tmp);
-                                    }
-                                }
-                            }
-                        } else
-                            return;
-                    }
+                    std::reverse(buf.begin() + old_size, buf.end());
                 }
             } while (previous_switch_counter != current->hdr.switch_counter);
 
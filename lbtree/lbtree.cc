@@ -26,6 +26,7 @@ inline void clflush(char *data, size_t len) {
     for (; ptr < data + len; ptr += CACHELINESIZE) {
         asm volatile("clflush %0" : "+m" (*(volatile char *) ptr));
     }
+    pm_emulate_flush(pm_flush_line_num(data, len));
     mfence();
 }
 
@@ -113,9 +114,9 @@ void *lbtree::lookup(key_type key, int *pos) {
         t = p->num();
         while (b + 7 <= t) {
             m = (b + t) >> 1;
-            r = key - p->k(m);
-            if (r > 0) b = m + 1;
-            else if (r < 0) t = m - 1;
+            r = p->k(m);
+            if (key > r) b = m + 1;
+            else if (key < r) t = m - 1;
             else {
                 p = p->ch(m);
                 goto inner_done;
@@ -210,7 +211,7 @@ void lbtree::insert(key_type key, void *_ptr) {
 #ifdef LB_PROFILE_TIME
     gettimeofday(&start_time, NULL);
 #endif
-    void *ptr = (void *)(concurrency_fast_alloc(sizeof(uint64_t)));
+    void *ptr = (void *)(concurrency_fast_alloc(sizeof(uint64_t), true, lbtree_tag_value));
     memory_usage += sizeof(uint64_t);
     *(uint64_t *)ptr = *(uint64_t *)_ptr;
     Pointer8B parray[32];  // 0 .. root_level will be used
@@ -251,9 +252,9 @@ void lbtree::insert(key_type key, void *_ptr) {
             t = p->num();
             while (b + 7 <= t) {
                 m = (b + t) >> 1;
-                r = key - p->k(m);
-                if (r > 0) b = m + 1;
-                else if (r < 0) t = m - 1;
+                r = p->k(m);
+                if (key > r) b = m + 1;
+                else if (key < r) t = m - 1;
                 else {
                     p = p->ch(m);
                     ppos[i] = m;
@@ -414,7 +415,7 @@ void lbtree::insert(key_type key, void *_ptr) {
         key_type split_key = lp->k(sorted_pos[split]);
 
         // 2.3 create new node
-        bleaf *newp = (bleaf *) concurrency_fast_alloc(LEAF_SIZE);
+        bleaf *newp = (bleaf *) concurrency_fast_alloc(LEAF_SIZE, true, lbtree_tag_leaf);
         memory_usage += LEAF_SIZE;
 
         // 2.4 move entries sorted_pos[split .. LEAF_KEY_NUM-1]
@@ -554,7 +555,7 @@ void lbtree::insert(key_type key, void *_ptr) {
             }
 
             /* otherwise allocate a new non-leaf and redistribute the keys */
-            newp = (bnode *) concurrency_fast_alloc(NONLEAF_SIZE);
+            newp = (bnode *) concurrency_fast_alloc(NONLEAF_SIZE, true, lbtree_tag_inner);
             memory_usage += NONLEAF_SIZE;
 
             /* if key should be in the left node */
@@ -593,7 +594,7 @@ void lbtree::insert(key_type key, void *_ptr) {
         } /* end of while loop */
 
         /* root was splitted !! add another level */
-        newp = (bnode *) concurrency_fast_alloc(NONLEAF_SIZE);
+        newp = (bnode *) concurrency_fast_alloc(NONLEAF_SIZE, true, lbtree_tag_inner);
         memory_usage += NONLEAF_SIZE;
 
         newp->num() = 1;
@@ -689,9 +690,9 @@ void lbtree::del(key_type key) {
             t = p->num();
             while (b + 7 <= t) {
                 m = (b + t) >> 1;
-                r = key - p->k(m);
-                if (r > 0) b = m + 1;
-                else if (r < 0) t = m - 1;
+                r = p->k(m);
+                if (key > r) b = m + 1;
+                else if (key < r) t = m - 1;
                 else {
                     p = p->ch(m);
                     ppos[i] = m;
@@ -884,8 +885,8 @@ void lbtree::del(key_type key) {
 }
 
 void lbtree::init() {
-    this->tree_meta = static_cast<treeMeta *>(concurrency_fast_alloc(sizeof(treeMeta)));
-    auto nvm_address = concurrency_fast_alloc(4 * KB);
+    this->tree_meta = static_cast<treeMeta *>(concurrency_fast_alloc(sizeof(treeMeta), true, lbtree_tag_meta));
+    auto nvm_address = concurrency_fast_alloc(4 * KB, true, lbtree_tag_meta);
     tree_meta->init(nvm_address);
     memory_usage += 4 * KB + sizeof(treeMeta);
 }
@@ -925,10 +926,10 @@ int lbtree::bulkloadSubtree(key_type input, int start_key, int num_key, float bf
 
 
     // 3. allocate nodes
-    pfirst[0] = concurrency_fast_alloc(sizeof(bleaf) * n_nodes[0]);
+    pfirst[0] = concurrency_fast_alloc(sizeof(bleaf) * n_nodes[0], true, lbtree_tag_leaf);
     memory_usage += sizeof(bleaf) * n_nodes[0];
     for (int i = 1; i <= top_level; i++) {
-        pfirst[i] = concurrency_fast_alloc(sizeof(bnode) * n_nodes[i]);
+        pfirst[i] = concurrency_fast_alloc(sizeof(bnode) * n_nodes[i], true, lbtree_tag_inner);
         memory_usage += sizeof(bleaf) * n_nodes[i];
     }
 
@@ -972,7 +973,11 @@ int lbtree::bulkloadSubtree(key_type input, int start_key, int num_key, float bf
 
             // entry
             lp->k(j) = mykey;
-            lp->ch(j) = (void *) mykey;
+            // values live out of line as in insert, so ch() is always a value pointer
+            uint64_t *myvalue = (uint64_t *) concurrency_fast_alloc(sizeof(uint64_t), true, lbtree_tag_value);
+            *myvalue = mykey;
+            memory_usage += sizeof(uint64_t);
+            lp->ch(j) = (void *) myvalue;
 
             // hash
             leaf_meta.v.fgpt[j] = hashcode1B(mykey);
@@ -1033,7 +1038,8 @@ vector<lbtree::kv> lbtree::rangeQuery(key_type start , key_type end){
 #ifdef LB_SCAN_PROFILE_TIME
     gettimeofday(&start_time, NULL);
 #endif
-    for(auto i = startPointer; ;){
+    // a range past the largest key ends in the last leaf
+    for(auto i = startPointer; i != NULL;){
         for(int j=0;j<LEAF_KEY_NUM;j++){
             if(i->bitmap&(1<<j) && i->ent[j].k>=start && i->ent[j].k<=end){
                 kv tmp;
@@ -1065,7 +1071,7 @@ uint64_t lbtree::memory_profile(){
 
 
 lbtree *new_lbtree() {
-    lbtree *mytree = static_cast<lbtree *>(concurrency_fast_alloc(sizeof(lbtree)));
+    lbtree *mytree = static_cast<lbtree *>(concurrency_fast_alloc(sizeof(lbtree), true, lbtree_tag_tree));
     mytree->memory_usage += sizeof(lbtree);
     mytree->init();
     mytree->bulkload(1, 1);
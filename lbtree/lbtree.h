@@ -18,6 +18,13 @@
 #include "nodeprof.h"
 #include "../fastalloc/fastalloc.h"
 
+// allocation tags
+inline const int lbtree_tag_tree = fast_alloc_tag("lbtree.tree");
+inline const int lbtree_tag_meta = fast_alloc_tag("lbtree.meta");
+inline const int lbtree_tag_leaf = fast_alloc_tag("lbtree.leaf");
+inline const int lbtree_tag_inner = fast_alloc_tag("lbtree.inner");
+inline const int lbtree_tag_value = fast_alloc_tag("lbtree.value");
+
 //#define LB_PROFILE_TIME 1
 
 #ifdef LB_PROFILE_TIME
@@ -51,7 +58,8 @@ extern uint64_t _random, _sequential;
 
 #define LEAF_KEY_NUM        (14)
 
-typedef long long key_type;
+// unsigned, so keys of 2^63 and above sort after the others
+typedef unsigned long long key_type;
 #define KEY_SIZE             8   /* size of a key in tree node */
 #define POINTER_SIZE         8   /* size of a pointer/value in node */
 
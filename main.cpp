@@ -1,44 +1,96 @@
+#include <algorithm>
 #include <atomic>
 #include <iostream>
 #include <fstream>
 #include <unistd.h>
 #include <map>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/time.h>
 #include "rng/rng.h"
+#include "fastalloc/fastalloc.h"
+#include "benchmark/index_adapter.h"
+#include "benchmark/bench_threads.h"
+#include "benchmark/ycsb.h"
+#include "benchmark/latency.h"
+#include "benchmark/dataset.h"
+#include "benchmark/perf_counters.h"
+#include "benchmark/harness.h"
 #include "extendible_radix_tree/ERT_int.h"
-#include "fastfair/fastfair.h"
-#include "lbtree/lbtree.h"
-#include "wort/wort.h"
-#include "woart/woart.h"
-#include "roart/roart.h"
 
 using namespace std;
 
 int testNum = 100000;
 string filePath;
 bool onPM = false;
-ofstream out1, out2;
+// keep the pool of an earlier run and the ERT tree registered in it
+bool reopenPool = false;
+fastalloc_page_mode pageMode = FASTALLOC_PAGE_DEFAULT;
+fastalloc_numa_mode numaMode = FASTALLOC_NUMA_NONE;
+bool pinThreads = false;
+fastalloc_small_mode smallMode = FASTALLOC_SMALL_PACKED;
+// emulated PM write-back cost, 0 is off
+uint64_t pmLatency = 0;
+uint64_t pmBandwidth = 0;
+// largest thread count of the multi-threaded sweep, 0 skips it
+int maxThreads = 0;
+// threads take their keys from one shared stream instead of a fixed slice each
+bool sharedKeys = false;
+// YCSB workloads to run, empty skips them
+vector<YCSBWorkload> ycsbWorkloads;
+double ycsbTheta = 0.99;
+// overrides the distribution of every workload unless it is YCSB_DISTRIBUTION_NUM
+ycsb_distribution ycsbDistribution = YCSB_DISTRIBUTION_NUM;
+// time every operation into latency histograms
+bool recordLatency = false;
+// count hardware events of every phase, mainCounters are those of the main thread
+bool recordPerf = false;
+PerfCounters *mainCounters;
+// timed passes of each single-threaded phase after harnessWarmup untimed ones, 0 times a single pass
+int harnessReps = 0;
+int harnessWarmup = 1;
+// range lengths of the scan test, empty to skip it
+vector<int> scanLengths;
+ycsb_distribution scanDistribution = YCSB_UNIFORM;
+// source of the sparse keys: a key file if datasetPath is set, keyGenerator otherwise
+string datasetPath;
+dataset_format datasetFormat = DATASET_SOSD;
+key_generator keyGenerator = KEYGEN_RANDOM;
+// take a uniform sample of the file instead of its first keyNum keys
+bool sampleKeys = false;
+bool shuffleKeys = false;
+Dataset dataset;
+vector<uint64_t> generatedKeys;
+// key counts of the footprint test, empty to skip it
+vector<int> footprintSizes;
+ofstream out1, out2, out3, out4, out5, out6, out7, out8, out9;
 
-ERTInt *ert1, *ert2;
-fastfair *ff1, *ff2;
-lbtree *lb1, *lb2;
-wort_tree *wort1, *wort2;
-woart_tree *woart1, *woart2;
-ROART *roart1, *roart2;
-
-uint64_t *keys_sparse;
+const uint64_t *keys_sparse;
 uint64_t *keys_dense;
 
 
-#define Time_BODY(condition, name, func, out)                                                        \
+#define Time_BODY(condition, name, func, out, hist, perf)                                            \
     if(condition) {                                                                             \
         sleep(1);                                                                               \
         timeval start, ends;                                                                    \
+        if (recordPerf) {                                                                       \
+            mainCounters->start();                                                              \
+        }                                                                                       \
         gettimeofday(&start, NULL);                                                             \
         for (int i = 0; i < testNum; ++i) {                                                     \
-            func                                                                                \
+            if (recordLatency) {                                                                \
+                uint64_t opStart = tsc_now();                                                   \
+                func                                                                            \
+                hist.record(tsc_now() - opStart);                                               \
+            } else {                                                                            \
+                func                                                                            \
+            }                                                                                   \
         }                                                                                       \
         gettimeofday(&ends, NULL);                                                              \
+        if (recordPerf) {                                                                       \
+            perf = mainCounters->stop();                                                        \
+        }                                                                                       \
         double timeCost = (ends.tv_sec - start.tv_sec) * 1000000 + ends.tv_usec - start.tv_usec;\
         double throughPut = (double) testNum / timeCost;                                        \
         cout << name << testNum << " kv pais in " << timeCost / 1000000 << " s" << endl;        \
@@ -47,127 +99,793 @@ uint64_t *keys_dense;
     }
 
 
-void keys_init() {
+// one row of latency.csv: the percentiles of op in a test on index
+void latency_report(const string &index, const string &test, const string &keys, int threads, const char *op,
+                    const LatencyHistogram &hist) {
+    if (!recordLatency || hist.count() == 0) {
+        return;
+    }
+    double scale = tsc_per_ns();
+    cout << index << " " << test << " " << keys << " " << op << " latency: p50 " << hist.percentile(50) / scale
+         << " ns, p99 " << hist.percentile(99) / scale << " ns, p99.99 " << hist.percentile(99.99) / scale
+         << " ns, max " << hist.max() / scale << " ns" << endl;
+    out5 << index << "," << test << "," << keys << "," << threads << "," << op << "," << hist.count() << ",";
+    latency_csv_row(out5, hist);
+    out5 << endl;
+}
+
+// one row of perf.csv: the counters of op in a test on index per operation
+void perf_report(const string &index, const string &test, const string &keys, int threads, const char *op,
+                 const PerfSample &perf, uint64_t ops) {
+    if (!recordPerf) {
+        return;
+    }
+    cout << index << " " << test << " " << keys << " " << op << ": ";
+    perf_print(cout, perf, ops);
+    cout << endl;
+    out8 << index << "," << test << "," << keys << "," << threads << "," << op << "," << ops << ",";
+    perf_csv_row(out8, perf, ops);
+    out8 << endl;
+}
+
+// false if the key file cannot be read
+bool keys_init() {
 //     init test case
-    cout << "Start Preparing dataset: " << testNum << " keys" << endl;
+    if (!datasetPath.empty()) {
+        if (!dataset.open(datasetPath, datasetFormat)) {
+            return false;
+        }
+        if (dataset.size() == 0) {
+            cout << datasetPath << ": no keys" << endl;
+            return false;
+        }
+        dataset.truncate(testNum, sampleKeys, 1);
+        if (shuffleKeys) {
+            dataset.shuffle(1);
+        }
+        testNum = dataset.size();
+        keys_sparse = dataset.keys();
+        cout << "Start Preparing dataset: " << testNum << " keys from " << datasetPath << " ("
+             << dataset_format_name(datasetFormat) << (dataset.mapped() ? ", mapped" : "") << ")" << endl;
+    } else {
+        cout << "Start Preparing dataset: " << testNum << " keys (" << key_generator_name(keyGenerator) << ")"
+             << endl;
+    }
     rng r;
     rng_init(&r, 1, 2);
-    keys_sparse = new uint64_t[testNum];
+    uint64_t *random = datasetPath.empty() && keyGenerator == KEYGEN_RANDOM ? new uint64_t[testNum] : NULL;
     keys_dense = new uint64_t[testNum];
     for (int i = 0; i < testNum; i++) {
-        keys_sparse[i] = rng_next(&r);
+        uint64_t key = rng_next(&r);
+        if (random != NULL) {
+            random[i] = key;
+        }
         keys_dense[i] = rng_next(&r) % testNum;
     }
+    if (random != NULL) {
+        keys_sparse = random;
+    } else if (datasetPath.empty()) {
+        generatedKeys = generate_keys(keyGenerator, testNum, 1);
+        if (shuffleKeys) {
+            shuffle_keys(generatedKeys.data(), testNum, 1);
+        }
+        keys_sparse = generatedKeys.data();
+    }
     cout << "Finish dataset preparing." << endl;
+    return true;
 }
 
-void data_structure_init() {
-    // init a new ExtendibleRadixTree
-    ert1 = NewExtendibleRadixTreeInt();
-    ert2 = NewExtendibleRadixTreeInt();
-
-    // init a new Fast&Fair
-    ff1 = new_fastfair();
-    ff2 = new_fastfair();
-
-    // init a Lb+Tree
-    lb1 = new_lbtree();
-    lb2 = new_lbtree();
-
-    // init a WORT
-    wort1 = new_wort_tree();
-    wort2 = new_wort_tree();
-
-    // init a WOART
-    woart1 = new_woart_tree();
-    woart2 = new_woart_tree();
+void speed_test() {
+    out1.open("../Result/insert.csv", ios::out);
+    out2.open("../Result/query.csv", ios::out);
+    out1 << " ,Dense,Sparse," << endl;
+    out2 << " ,Dense,Sparse," << endl;
 
-    // init a ROART
-    roart1 = new_roart();
-    roart2 = new_roart();
+    for (auto &name : index_adapter_names()) {
+        IndexAdapter *dense = new_index_adapter(name);
+        IndexAdapter *sparse = new_index_adapter(name);
+        // insert and search of dense and sparse keys
+        LatencyHistogram *hist = new LatencyHistogram[4];
+        PerfSample perf[4];
+        out1 << name << ",";
+        out2 << name << ",";
+        Time_BODY(true, name + " insert dense keys: ", { dense->insert(keys_dense[i], i + 1); }, out1, hist[0],
+                  perf[0])
+        Time_BODY(true, name + " search dense keys: ", { harness_sink(dense->lookup(keys_dense[i])); }, out2, hist[1], perf[1])
+        Time_BODY(true, name + " insert sparse keys: ", { sparse->insert(keys_sparse[i], i + 1); }, out1, hist[2],
+                  perf[2])
+        Time_BODY(true, name + " search sparse keys: ", { harness_sink(sparse->lookup(keys_sparse[i])); }, out2, hist[3],
+                  perf[3])
+        out1 << endl;
+        out2 << endl;
+        latency_report(name, "single", "dense", 1, "insert", hist[0]);
+        latency_report(name, "single", "dense", 1, "search", hist[1]);
+        latency_report(name, "single", "sparse", 1, "insert", hist[2]);
+        latency_report(name, "single", "sparse", 1, "search", hist[3]);
+        perf_report(name, "single", "dense", 1, "insert", perf[0], testNum);
+        perf_report(name, "single", "dense", 1, "search", perf[1], testNum);
+        perf_report(name, "single", "sparse", 1, "insert", perf[2], testNum);
+        perf_report(name, "single", "sparse", 1, "search", perf[3], testNum);
+        delete[] hist;
+        delete dense;
+        delete sparse;
+    }
+    cout << "Saved result to ./Result" << endl;
 }
 
-void speed_test() {
+// speed_test with harnessReps passes of each phase: every insert pass loads a fresh index and the
+// search passes run on the index of the last one. Means go to insert.csv and query.csv, the spread
+// and the lookups that found nothing to harness.csv
+void harness_test() {
     out1.open("../Result/insert.csv", ios::out);
     out2.open("../Result/query.csv", ios::out);
+    out9.open("../Result/harness.csv", ios::out);
     out1 << " ,Dense,Sparse," << endl;
     out2 << " ,Dense,Sparse," << endl;
-    int value = 1;
-
-    out1 << "FAST&FAIR,";
-    out2 << "FAST&FAIR,";
-    Time_BODY(true, "FAST&FAIR insert dense keys: ", { ff1->put(keys_dense[i], (char *) &value); }, out1)
-    Time_BODY(true, "FAST&FAIR search dense keys: ", { ff1->get(keys_dense[i]); }, out2)
-    Time_BODY(true, "FAST&FAIR insert sparse keys: ", { ff2->put(keys_sparse[i], (char *) &value); }, out1)
-    Time_BODY(true, "FAST&FAIR search sparse keys: ", { ff2->get(keys_sparse[i]); }, out2)
-    out1 << endl;
-    out2 << endl;
-
-    out1 << "LB+Trees,";
-    out2 << "LB+Trees,";
-    Time_BODY(true, "LB+Trees insert dense keys: ", { lb1->insert(keys_dense[i], (char *) &value); }, out1)
-    Time_BODY(true, "LB+Trees search dense keys: ", { lb1->lookup(keys_dense[i]); }, out2)
-    Time_BODY(true, "LB+Trees insert sparse keys: ", { lb2->insert(keys_sparse[i], (char *) &value); }, out1)
-    Time_BODY(true, "LB+Trees search sparse keys: ", { lb2->lookup(keys_sparse[i]); }, out2)
-    out1 << endl;
-    out2 << endl;
-
-    out1 << "WORT,";
-    out2 << "WORT,";
-    Time_BODY(true, "WORT insert dense keys: ", { wort_put(wort1, keys_dense[i], 8, (char *) &value); }, out1)
-    Time_BODY(true, "WORT search dense keys: ", { wort_get(wort1, (keys_dense[i]), 8); }, out2)
-    Time_BODY(true, "WORT insert sparse keys: ", { wort_put(wort2, keys_sparse[i], 8, (char *) &value); }, out1)
-    Time_BODY(true, "WORT search sparse keys: ", { wort_get(wort2, (keys_sparse[i]), 8); }, out2)
-    out1 << endl;
-    out2 << endl;
-
-    out1 << "WOART, ";
-    out2 << "WOART, ";
-    Time_BODY(true, "WOART insert dense keys: ", { woart_put(woart1, keys_dense[i], 8, (char *) &value); }, out1)
-    Time_BODY(true, "WOART search dense keys: ", { woart_get(woart1, (keys_dense[i]), 8); }, out2)
-    Time_BODY(true, "WOART insert sparse keys: ", { woart_put(woart2, keys_sparse[i], 8, (char *) &value); }, out1)
-    Time_BODY(true, "WOART search sparse keys: ", { woart_get(woart2, (keys_sparse[i]), 8); }, out2)
-    out1 << endl;
-    out2 << endl;
-
-    out1 << "ROART,";
-    out2 << "ROART,";
-    Time_BODY(true, "ROART insert dense keys: ", { roart1->put(keys_dense[i], value); }, out1)
-    Time_BODY(true, "ROART search dense keys: ", { roart1->get(keys_dense[i]); }, out2)
-    Time_BODY(true, "ROART insert sparse keys: ", { roart2->put(keys_sparse[i], value); }, out1)
-    Time_BODY(true, "ROART search sparse keys: ", { roart2->get(keys_sparse[i]); }, out2)
-    out1 << endl;
-    out2 << endl;
-
-    out1 << "ERT,";
-    out2 << "ERT,";
-    Time_BODY(true, "ERT insert dense keys: ", { ert1->Insert(keys_dense[i], i); }, out1)
-    Time_BODY(true, "ERT search dense keys: ", { ert1->Search(keys_dense[i]); }, out2)
-    Time_BODY(true, "ERT insert sparse keys: ", { ert2->Insert(keys_sparse[i], i); }, out1)
-    Time_BODY(true, "ERT search sparse keys: ", { ert2->Search(keys_sparse[i]); }, out2)
-    out1 << endl;
-    out2 << endl;
+    out9 << "index,keys,op,reps,mean Mops,stddev Mops,ci95 Mops,min Mops,max Mops,misses" << endl;
+    for (auto &name : index_adapter_names()) {
+        RunStats stats[2][2];
+        for (int sparse = 0; sparse < 2; ++sparse) {
+            const uint64_t *keys = sparse ? keys_sparse : keys_dense;
+            const char *keyName = sparse ? "sparse" : "dense";
+            IndexAdapter *index = NULL;
+            uint64_t misses[2];
+            stats[0][sparse] = harness_run(harnessWarmup, harnessReps, testNum, [&]() {
+                delete index;
+                index = new_index_adapter(name);
+            }, [&](int i) {
+                index->insert(keys[i], i + 1);
+                return 1;
+            }, misses[0]);
+            stats[1][sparse] = harness_run(harnessWarmup, harnessReps, testNum, NULL, [&](int i) {
+                return index->lookup(keys[i]);
+            }, misses[1]);
+            delete index;
+            for (int op = 0; op < 2; ++op) {
+                RunStats &run = stats[op][sparse];
+                const char *opName = op == 0 ? "insert" : "search";
+                cout << name << " " << opName << " " << keyName << " keys: " << run.mean() << " +- " << run.ci95()
+                     << " Mops (stddev " << run.stddev() << ", " << harnessReps << " reps), " << misses[op]
+                     << " misses" << endl;
+                out9 << name << "," << keyName << "," << opName << "," << harnessReps << "," << run.mean() << ","
+                     << run.stddev() << "," << run.ci95() << "," << run.min() << "," << run.max() << ","
+                     << misses[op] << endl;
+            }
+        }
+        out1 << name << "," << stats[0][0].mean() << "," << stats[0][1].mean() << "," << endl;
+        out2 << name << "," << stats[1][0].mean() << "," << stats[1][1].mean() << "," << endl;
+    }
     cout << "Saved result to ./Result" << endl;
 }
 
+// scan ranges of scanLengths keys over the sparse keys and check how many keys each returns
+void scan_test() {
+    if (scanLengths.empty()) {
+        return;
+    }
+    vector<uint64_t> sorted(keys_sparse, keys_sparse + testNum);
+    sort(sorted.begin(), sorted.end());
+    sorted.erase(unique(sorted.begin(), sorted.end()), sorted.end());
+    const char *dist = ycsb_distribution_name(scanDistribution);
+    out6.open("../Result/scan.csv", ios::out);
+    out6 << "index,length,distribution,scans,Kscans/s,Mkeys/s,errors" << endl;
+    for (auto &name : index_adapter_names()) {
+        IndexAdapter *index = new_index_adapter(name);
+        for (int i = 0; i < testNum; ++i) {
+            index->insert(keys_sparse[i], i + 1);
+        }
+        for (int length : scanLengths) {
+            uint64_t len = min<uint64_t>(length, sorted.size());
+            int scans = max(testNum / length, 100);
+            // start ranks, so every range holds exactly len keys
+            vector<uint64_t> starts = ycsb_ids(scanDistribution, sorted.size() - len + 1, scans, ycsbTheta, 1);
+            LatencyHistogram *hist = new LatencyHistogram;
+            uint64_t found = 0, errors = 0;
+            PerfSample perf;
+            timeval start, ends;
+            if (recordPerf) {
+                mainCounters->start();
+            }
+            gettimeofday(&start, NULL);
+            for (uint64_t s : starts) {
+                uint64_t opStart = recordLatency ? tsc_now() : 0;
+                uint64_t count = index->scan(sorted[s], sorted[s + len - 1]);
+                if (recordLatency) {
+                    hist->record(tsc_now() - opStart);
+                }
+                found += count;
+                errors += count != len;
+            }
+            gettimeofday(&ends, NULL);
+            if (recordPerf) {
+                perf = mainCounters->stop();
+            }
+            double timeCost = (ends.tv_sec - start.tv_sec) * 1000000 + ends.tv_usec - start.tv_usec;
+            cout << name << " scan " << length << " keys (" << dist << "): " << scans / timeCost * 1000
+                 << " Kscans/s, " << found / timeCost << " Mkeys/s, " << errors << " wrong counts" << endl;
+            out6 << name << "," << length << "," << dist << "," << scans << "," << scans / timeCost * 1000 << ","
+                 << found / timeCost << "," << errors << endl;
+            latency_report(name, "scan", dist, 1, ("scan " + to_string(length)).c_str(), *hist);
+            perf_report(name, "scan", dist, 1, ("scan " + to_string(length)).c_str(), perf, scans);
+            delete hist;
+        }
+        delete index;
+    }
+    cout << "Saved scan results to ./Result/scan.csv" << endl;
+}
+
+// resident set of the process from /proc/self/statm, 0 if it cannot be read
+uint64_t rss_bytes() {
+    ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// live bytes as asked for by callers, summed over the allocation tags
+uint64_t requested_bytes(fastalloc_stats &stats) {
+    uint64_t res = 0;
+    for (int i = 0; i < fast_alloc_tag_num(); ++i) {
+        res += stats.tags[i].requested_bytes;
+    }
+    return res;
+}
+
+// bytes per key of each index after loading footprintSizes dense and sparse keys, as counted by
+// the index's own profiler, by the allocator and by the process RSS. The indexes are never freed
+// back to the allocator, so each load is measured as the growth since just before it.
+void footprint_test() {
+    if (footprintSizes.empty()) {
+        return;
+    }
+    out7.open("../Result/memory.csv", ios::out);
+    out7 << "index,keys,count,profiler B/key,requested B/key,allocated B/key,RSS B/key" << endl;
+    for (int n : footprintSizes) {
+        // dense: a shuffle of 0 .. n - 1, sparse: the first keys of the file or n generated keys
+        vector<uint64_t> dense(n), sparse;
+        for (int i = 0; i < n; ++i) {
+            dense[i] = i;
+        }
+        shuffle_keys(dense.data(), n, 3);
+        if (!datasetPath.empty()) {
+            sparse.assign(keys_sparse, keys_sparse + min(n, testNum));
+        } else {
+            sparse = generate_keys(keyGenerator, n, 3);
+            if (shuffleKeys) {
+                shuffle_keys(sparse.data(), n, 3);
+            }
+        }
+        for (auto &name : index_adapter_names()) {
+            for (int isSparse = 0; isSparse < 2; ++isSparse) {
+                vector<uint64_t> &keys = isSparse ? sparse : dense;
+                const char *keyName = isSparse ? "sparse" : "dense";
+                int count = keys.size();
+                fastalloc_stats before = fast_alloc_stats();
+                uint64_t rss = rss_bytes();
+                IndexAdapter *index = new_index_adapter(name);
+                for (int i = 0; i < count; ++i) {
+                    index->insert(keys[i], i + 1);
+                }
+                fastalloc_stats after = fast_alloc_stats();
+                double profiler = (double) index->memory() / count;
+                double requested = ((double) requested_bytes(after) - requested_bytes(before)) / count;
+                double allocated = ((double) after.live_bytes() - before.live_bytes()) / count;
+                double resident = ((double) rss_bytes() - rss) / count;
+                printf("%s %d %s keys: %.1f B/key profiler, %.1f requested, %.1f allocated, %.1f RSS\n",
+                       name.c_str(), count, keyName, profiler, requested, allocated, resident);
+                out7 << name << "," << keyName << "," << count << "," << profiler << "," << requested << ","
+                     << allocated << "," << resident << endl;
+                delete index;
+            }
+        }
+    }
+    cout << "Saved memory footprint to ./Result/memory.csv" << endl;
+}
+
+// run op(i) for every key index on threads workers, return the aggregate Mops and the imbalance.
+// op returns the type of the operation; with recordLatency, latency[type] gets its latency merged
+// over the threads, with recordPerf perf gets the counters of all threads
+template<class F>
+pair<double, double> parallel_phase(BenchmarkThreads &workers, int threads, F op, vector<LatencyHistogram> &latency,
+                                    PerfSample &perf) {
+    std::atomic<int> next{0};
+    vector<uint64_t> ops(threads);
+    // per thread, so recording needs no synchronization
+    vector<vector<LatencyHistogram>> hist(recordLatency ? threads : 0, vector<LatencyHistogram>(latency.size()));
+    vector<PerfSample> samples(threads);
+    vector<double> seconds = workers.run(threads, [&](int tid) {
+        // counters count the thread that opens them
+        PerfCounters *counters = recordPerf ? new PerfCounters : NULL;
+        if (counters != NULL) {
+            counters->start();
+        }
+        auto timed = [&](int i) {
+            if (!recordLatency) {
+                op(i);
+                return;
+            }
+            uint64_t start = tsc_now();
+            int type = op(i);
+            hist[tid][type].record(tsc_now() - start);
+        };
+        if (sharedKeys) {
+            // batches keep the shared counter off the critical path
+            const int batch = 1024;
+            int begin;
+            while ((begin = next.fetch_add(batch)) < testNum) {
+                int end = min(begin + batch, testNum);
+                for (int i = begin; i < end; ++i) {
+                    timed(i);
+                }
+                ops[tid] += end - begin;
+            }
+        } else {
+            int begin = (int64_t) testNum * tid / threads, end = (int64_t) testNum * (tid + 1) / threads;
+            for (int i = begin; i < end; ++i) {
+                timed(i);
+            }
+            ops[tid] = end - begin;
+        }
+        if (counters != NULL) {
+            samples[tid] = counters->stop();
+            delete counters;
+        }
+    });
+    // aggregate over the first start to the last finish; imbalance is the largest share of the work over
+    // the mean share, time with a fixed slice per thread and keys done with the shared stream
+    for (auto &thread : hist) {
+        for (size_t type = 0; type < latency.size(); ++type) {
+            latency[type].merge(thread[type]);
+        }
+    }
+    for (auto &sample : samples) {
+        perf.add(sample);
+    }
+    double maxWork = 0, sumWork = 0;
+    for (int i = 0; i < threads; ++i) {
+        double work = sharedKeys ? ops[i] : seconds[i];
+        maxWork = max(maxWork, work);
+        sumWork += work;
+    }
+    return {testNum / workers.wall() / 1000000, maxWork * threads / sumWork};
+}
+
+void thread_test() {
+    if (maxThreads == 0) {
+        return;
+    }
+    BenchmarkThreads workers(maxThreads, pinThreads);
+    out3.open("../Result/threads.csv", ios::out);
+    out3 << "index,threads,keys,phase,Mops,imbalance" << endl;
+    for (auto &name : index_adapter_names()) {
+        for (int threads : thread_sweep(maxThreads)) {
+            for (int sparse = 0; sparse < 2; ++sparse) {
+                const uint64_t *keys = sparse ? keys_sparse : keys_dense;
+                const char *keyName = sparse ? "sparse" : "dense";
+                IndexAdapter *index = new_concurrent_index_adapter(name);
+                vector<LatencyHistogram> insertLatency(1), searchLatency(1);
+                PerfSample insertPerf, searchPerf;
+                auto insert = parallel_phase(workers, threads, [&](int i) {
+                    index->insert(keys[i], i + 1);
+                    return 0;
+                }, insertLatency, insertPerf);
+                auto search = parallel_phase(workers, threads, [&](int i) {
+                    index->lookup(keys[i]);
+                    return 0;
+                }, searchLatency, searchPerf);
+                cout << name << " " << threads << " threads " << keyName << " keys: insert " << insert.first
+                     << " Mops (imbalance " << insert.second << "), search " << search.first << " Mops (imbalance "
+                     << search.second << ")" << endl;
+                out3 << name << "," << threads << "," << keyName << ",insert," << insert.first << ","
+                     << insert.second << endl;
+                out3 << name << "," << threads << "," << keyName << ",search," << search.first << ","
+                     << search.second << endl;
+                latency_report(name, "threads", keyName, threads, "insert", insertLatency[0]);
+                latency_report(name, "threads", keyName, threads, "search", searchLatency[0]);
+                perf_report(name, "threads", keyName, threads, "insert", insertPerf, testNum);
+                perf_report(name, "threads", keyName, threads, "search", searchPerf, testNum);
+                delete index;
+            }
+        }
+    }
+    cout << "Saved thread sweep to ./Result/threads.csv" << endl;
+}
+
+// load testNum records, then run testNum operations of each workload
+void ycsb_test() {
+    if (ycsbWorkloads.empty()) {
+        return;
+    }
+    BenchmarkThreads workers(max(maxThreads, 1), pinThreads);
+    out4.open("../Result/ycsb.csv", ios::out);
+    out4 << "index,workload,distribution,threads,load Mops,run Mops,imbalance" << endl;
+    for (auto &workload : ycsbWorkloads) {
+        if (ycsbDistribution != YCSB_DISTRIBUTION_NUM) {
+            workload.distribution = ycsbDistribution;
+        }
+        vector<YCSBOp> ops = ycsb_generate(workload, testNum, testNum, ycsbTheta, 1);
+        for (auto &name : index_adapter_names()) {
+            for (int threads : thread_sweep(max(maxThreads, 1))) {
+                IndexAdapter *index = new_concurrent_index_adapter(name);
+                vector<LatencyHistogram> loadLatency(1), runLatency(YCSB_OP_NUM);
+                PerfSample loadPerf, runPerf;
+                auto load = parallel_phase(workers, threads, [&](int i) {
+                    index->insert(ycsb_key(i), i + 1);
+                    return 0;
+                }, loadLatency, loadPerf);
+                auto run = parallel_phase(workers, threads, [&](int i) {
+                    ycsb_run(index, ops[i], i + 1, testNum);
+                    return (int) ops[i].type;
+                }, runLatency, runPerf);
+                cout << name << " YCSB " << workload.name << " (" << ycsb_distribution_name(workload.distribution)
+                     << ") " << threads << " threads: load " << load.first << " Mops, run " << run.first
+                     << " Mops (imbalance " << run.second << ")" << endl;
+                out4 << name << "," << workload.name << "," << ycsb_distribution_name(workload.distribution) << ","
+                     << threads << "," << load.first << "," << run.first << "," << run.second << endl;
+                string test = "YCSB " + workload.name;
+                const char *dist = ycsb_distribution_name(workload.distribution);
+                latency_report(name, test, dist, threads, "load", loadLatency[0]);
+                perf_report(name, test, dist, threads, "load", loadPerf, testNum);
+                perf_report(name, test, dist, threads, "run", runPerf, testNum);
+                for (int type = 0; type < YCSB_OP_NUM; ++type) {
+                    latency_report(name, test, dist, threads, ycsb_op_name(type), runLatency[type]);
+                }
+                delete index;
+            }
+        }
+    }
+    cout << "Saved YCSB results to ./Result/ycsb.csv" << endl;
+}
+
+// "read:update:insert:scan:rmw" proportions of a custom workload
+bool parse_mix(const char *mix, YCSBWorkload &workload) {
+    workload = YCSBWorkload();
+    workload.name = "custom";
+    double *p = workload.proportion;
+    if (sscanf(mix, "%lf:%lf:%lf:%lf:%lf", &p[YCSB_READ], &p[YCSB_UPDATE], &p[YCSB_INSERT], &p[YCSB_SCAN],
+               &p[YCSB_RMW]) < 2) {
+        return false;
+    }
+    double sum = 0;
+    for (int i = 0; i < YCSB_OP_NUM; ++i) {
+        sum += p[i];
+    }
+    if (sum <= 0) {
+        return false;
+    }
+    for (int i = 0; i < YCSB_OP_NUM; ++i) {
+        p[i] /= sum;
+    }
+    return true;
+}
+
+void usage(const char *prog) {
+    cout << "usage: " << prog << " <keyNum> [OptanePath] [options]" << endl;
+    cout << "  --pages=default|thp|hugetlb|hugetlb1g   page backing of DRAM arenas" << endl;
+    cout << "  --numa=none|local|interleave            NUMA placement of the arenas" << endl;
+    cout << "  --pin                                   pin benchmark threads to cores" << endl;
+    cout << "  --small=off|packed|aligned              sub-cache-line classes for objects up to 48 B" << endl;
+    cout << "  --reopen                                keep the PM pool of an earlier run and load its ERT tree" << endl;
+    cout << "  --pm-latency=<ns>                       emulated write-back latency per flushed cache line" << endl;
+    cout << "  --pm-bandwidth=<MB/s>                   emulated PM write bandwidth over all threads" << endl;
+    cout << "  --threads=<n>                           also run 1, 2, 4, ... n threads per index" << endl;
+    cout << "  --keys=partition|shared                 key stream of the threads: a slice each or one shared" << endl;
+    cout << "  --ycsb=<ABCDEF>                         run these YCSB core workloads" << endl;
+    cout << "  --mix=<read:update:insert:scan:rmw>     run a custom YCSB mix, e.g. 90:10" << endl;
+    cout << "  --dist=uniform|zipfian|latest|hotspot   request distribution of every YCSB workload" << endl;
+    cout << "  --theta=<t>                             zipfian constant in (0, 1), default 0.99" << endl;
+    cout << "  --latency                               record per-operation latency percentiles" << endl;
+    cout << "  --reps=<n>                              time n passes of each single-threaded phase" << endl;
+    cout << "  --warmup=<n>                            untimed passes before them, default 1" << endl;
+    cout << "  --perf                                  count cycles, instructions, cache, TLB and branch misses" << endl;
+    cout << "  --scan[=<len,len,...>]                  scan ranges of these lengths, default 10,100,1000,10000" << endl;
+    cout << "  --scan-dist=uniform|zipfian|latest|hotspot  distribution of the scan start keys" << endl;
+    cout << "  --dataset=<file>                        sparse keys from a key file, see --format" << endl;
+    cout << "  --format=sosd|binary|text               key file format, default sosd" << endl;
+    cout << "  --sample                                take a uniform sample of keyNum keys of the file" << endl;
+    cout << "  --keygen=random|sequential|clustered|normal  generator of the sparse keys" << endl;
+    cout << "  --shuffle                               shuffle the sparse keys before inserting" << endl;
+    cout << "  --footprint[=<n,n,...>]                 bytes per key after loading n keys, default keyNum/100,/10,/1" << endl;
+}
+
+// positional <keyNum> [OptanePath], options anywhere
+bool parse_args(int argc, char *argv[]) {
+    int positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.rfind("--pages=", 0) == 0) {
+            string name = arg.substr(strlen("--pages="));
+            int mode = 0;
+            while (mode < FASTALLOC_PAGE_MODE_NUM && name != fast_alloc_page_mode_name((fastalloc_page_mode) mode)) {
+                mode++;
+            }
+            if (mode == FASTALLOC_PAGE_MODE_NUM) {
+                return false;
+            }
+            pageMode = (fastalloc_page_mode) mode;
+        } else if (arg.rfind("--numa=", 0) == 0) {
+            string name = arg.substr(strlen("--numa="));
+            int mode = 0;
+            while (mode < FASTALLOC_NUMA_MODE_NUM && name != fast_alloc_numa_mode_name((fastalloc_numa_mode) mode)) {
+                mode++;
+            }
+            if (mode == FASTALLOC_NUMA_MODE_NUM) {
+                return false;
+            }
+            numaMode = (fastalloc_numa_mode) mode;
+        } else if (arg == "--pin") {
+            pinThreads = true;
+        } else if (arg.rfind("--small=", 0) == 0) {
+            string name = arg.substr(strlen("--small="));
+            int mode = 0;
+            while (mode < FASTALLOC_SMALL_MODE_NUM && name != fast_alloc_small_mode_name((fastalloc_small_mode) mode)) {
+                mode++;
+            }
+            if (mode == FASTALLOC_SMALL_MODE_NUM) {
+                return false;
+            }
+            smallMode = (fastalloc_small_mode) mode;
+        } else if (arg == "--reopen") {
+            reopenPool = true;
+        } else if (arg.rfind("--pm-latency=", 0) == 0) {
+            pmLatency = strtoull(arg.c_str() + strlen("--pm-latency="), NULL, 10);
+        } else if (arg.rfind("--pm-bandwidth=", 0) == 0) {
+            pmBandwidth = strtoull(arg.c_str() + strlen("--pm-bandwidth="), NULL, 10);
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            maxThreads = atoi(arg.c_str() + strlen("--threads="));
+            if (maxThreads <= 0) {
+                return false;
+            }
+        } else if (arg == "--keys=partition" || arg == "--keys=shared") {
+            sharedKeys = arg == "--keys=shared";
+        } else if (arg.rfind("--ycsb=", 0) == 0) {
+            for (char c : arg.substr(strlen("--ycsb="))) {
+                YCSBWorkload workload;
+                if (c == ',') {
+                    continue;
+                }
+                if (!ycsb_workload(toupper(c), workload)) {
+                    return false;
+                }
+                ycsbWorkloads.push_back(workload);
+            }
+        } else if (arg.rfind("--mix=", 0) == 0) {
+            YCSBWorkload workload;
+            if (!parse_mix(arg.c_str() + strlen("--mix="), workload)) {
+                return false;
+            }
+            ycsbWorkloads.push_back(workload);
+        } else if (arg.rfind("--dist=", 0) == 0) {
+            string name = arg.substr(strlen("--dist="));
+            int dist = 0;
+            while (dist < YCSB_DISTRIBUTION_NUM && name != ycsb_distribution_name((ycsb_distribution) dist)) {
+                dist++;
+            }
+            if (dist == YCSB_DISTRIBUTION_NUM) {
+                return false;
+            }
+            ycsbDistribution = (ycsb_distribution) dist;
+        } else if (arg.rfind("--theta=", 0) == 0) {
+            ycsbTheta = atof(arg.c_str() + strlen("--theta="));
+            if (ycsbTheta <= 0 || ycsbTheta >= 1) {
+                return false;
+            }
+        } else if (arg == "--latency") {
+            recordLatency = true;
+        } else if (arg.rfind("--reps=", 0) == 0) {
+            harnessReps = atoi(arg.c_str() + strlen("--reps="));
+            if (harnessReps <= 0) {
+                return false;
+            }
+        } else if (arg.rfind("--warmup=", 0) == 0) {
+            harnessWarmup = atoi(arg.c_str() + strlen("--warmup="));
+            if (harnessWarmup < 0) {
+                return false;
+            }
+        } else if (arg == "--perf") {
+            recordPerf = true;
+        } else if (arg == "--scan") {
+            scanLengths = {10, 100, 1000, 10000};
+        } else if (arg.rfind("--scan=", 0) == 0) {
+            scanLengths.clear();
+            for (const char *p = arg.c_str() + strlen("--scan="); *p != '\0'; p += *p == ',') {
+                char *end;
+                int length = strtol(p, &end, 10);
+                if (end == p || length <= 0) {
+                    return false;
+                }
+                scanLengths.push_back(length);
+                p = end;
+            }
+        } else if (arg.rfind("--scan-dist=", 0) == 0) {
+            string name = arg.substr(strlen("--scan-dist="));
+            int dist = 0;
+            while (dist < YCSB_DISTRIBUTION_NUM && name != ycsb_distribution_name((ycsb_distribution) dist)) {
+                dist++;
+            }
+            if (dist == YCSB_DISTRIBUTION_NUM) {
+                return false;
+            }
+            scanDistribution = (ycsb_distribution) dist;
+        } else if (arg.rfind("--dataset=", 0) == 0) {
+            datasetPath = arg.substr(strlen("--dataset="));
+        } else if (arg.rfind("--format=", 0) == 0) {
+            string name = arg.substr(strlen("--format="));
+            int format = 0;
+            while (format < DATASET_FORMAT_NUM && name != dataset_format_name((dataset_format) format)) {
+                format++;
+            }
+            if (format == DATASET_FORMAT_NUM) {
+                return false;
+            }
+            datasetFormat = (dataset_format) format;
+        } else if (arg == "--sample") {
+            sampleKeys = true;
+        } else if (arg.rfind("--keygen=", 0) == 0) {
+            string name = arg.substr(strlen("--keygen="));
+            int generator = 0;
+            while (generator < KEYGEN_NUM && name != key_generator_name((key_generator) generator)) {
+                generator++;
+            }
+            if (generator == KEYGEN_NUM) {
+                return false;
+            }
+            keyGenerator = (key_generator) generator;
+        } else if (arg == "--shuffle") {
+            shuffleKeys = true;
+        } else if (arg == "--footprint") {
+            // filled in from testNum once the positional arguments are parsed
+            footprintSizes = {0};
+        } else if (arg.rfind("--footprint=", 0) == 0) {
+            footprintSizes.clear();
+            for (const char *p = arg.c_str() + strlen("--footprint="); *p != '\0'; p += *p == ',') {
+                char *end;
+                int n = strtol(p, &end, 10);
+                if (end == p || n <= 0) {
+                    return false;
+                }
+                footprintSizes.push_back(n);
+                p = end;
+            }
+        } else if (arg.rfind("--", 0) == 0) {
+            return false;
+        } else if (positional == 0) {
+            sscanf(argv[i], "%d", &testNum);
+            positional++;
+        } else if (positional == 1) {
+            onPM = true;
+            filePath = arg;
+            positional++;
+        } else {
+            return false;
+        }
+    }
+    if (footprintSizes.size() == 1 && footprintSizes[0] == 0) {
+        footprintSizes.clear();
+        for (int n : {testNum / 100, testNum / 10, testNum}) {
+            if (n > 0) {
+                footprintSizes.push_back(n);
+            }
+        }
+    }
+    return positional > 0;
+}
+
+// the ERT tree registered in a reopened pool: count the keys earlier runs left in it, then load
+// the sparse keys of this run
+void pool_tree_test() {
+    if (!reopenPool || !onPM) {
+        return;
+    }
+    ERTInt *tree = OpenExtendibleRadixTreeInt();
+    cout << "ERT tree in the PM pool: " << tree->scan(0, UINT64_MAX) << " keys";
+    for (int i = 0; i < testNum; i++) {
+        tree->Insert(keys_sparse[i], i + 1);
+    }
+    cout << ", " << tree->scan(0, UINT64_MAX) << " after loading " << testNum << " keys" << endl;
+}
+
+void alloc_report() {
+    fastalloc_stats stats = fast_alloc_stats();
+    cout << "Page mode: " << fast_alloc_page_mode_name(pageMode) << ", DRAM mapped";
+    for (int i = 0; i < FASTALLOC_PAGE_MODE_NUM; ++i) {
+        cout << " " << fast_alloc_page_mode_name((fastalloc_page_mode) i) << ": "
+             << (stats.page_bytes[i] >> 20) << " MB";
+    }
+    cout << endl;
+    cout << "NUMA mode: " << fast_alloc_numa_mode_name(numaMode) << ", " << fast_alloc_numa_nodes() << " node(s)";
+    if (numaMode == FASTALLOC_NUMA_LOCAL) {
+        for (int i = 0; i < fast_alloc_numa_nodes(); ++i) {
+            cout << " node" << i << ": " << (stats.numa_bytes[i] >> 20) << " MB";
+        }
+    }
+    cout << endl;
+    cout << "Small classes: " << fast_alloc_small_mode_name(smallMode) << endl;
+    cout << "Allocations by tag (live objects, requested MB, rounded MB, rounding overhead):" << endl;
+    for (int i = 0; i < fast_alloc_tag_num(); ++i) {
+        fastalloc_tag_stats &tag = stats.tags[i];
+        if (tag.alloc_cnt == 0) {
+            continue;
+        }
+        printf("  %-20s %12lu %10.1f %10.1f %6.1f%%\n", fast_alloc_tag_name(i), tag.live_cnt(),
+               tag.requested_bytes / 1048576.0, tag.rounded_bytes / 1048576.0,
+               tag.requested_bytes ? 100.0 * (tag.rounded_bytes - tag.requested_bytes) / tag.requested_bytes : 0);
+    }
+    vector<fastalloc_stats> arenas = fast_alloc_arena_stats();
+    cout << "Arenas (chunk MB, carved MB, live MB):";
+    for (auto &arena : arenas) {
+        cout << " [" << (arena.chunk_bytes >> 20) << ", " << (arena.bump_bytes >> 20) << ", "
+             << (arena.live_bytes() >> 20) << "]";
+    }
+    cout << endl;
+    if (pmLatency != 0 || pmBandwidth != 0 || fast_alloc_pm_emulated()) {
+        cout << "PM emulation: " << (fast_alloc_pm_emulated() ? "MAP_SHARED" : "MAP_SYNC") << ", latency "
+             << pmLatency << " ns/line, bandwidth " << (pmBandwidth ? to_string(pmBandwidth) + " MB/s" : "unlimited")
+             << ", " << pm_flush_lines << " lines flushed by the main thread" << endl;
+    }
+}
+
 int main(int argc, char *argv[]) {
-    sscanf(argv[1], "%d", &testNum);
-    if (argc == 3) {
-        onPM = true;
-        filePath = argv[2];
+    if (!parse_args(argc, argv)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // pin before the first allocation so a local arena lands on this thread's node
+    if (pinThreads) {
+        pin_thread(0);
     }
 
     //initialize allocator
+    set_fast_alloc_page_mode(pageMode);
+    set_fast_alloc_numa_mode(numaMode);
+    set_fast_alloc_small_mode(smallMode);
+    if (pmLatency != 0 || pmBandwidth != 0) {
+        set_fast_alloc_pm_emulation(pmLatency, pmBandwidth);
+    }
+    set_fast_alloc_pm_reopen(reopenPool);
     init_fast_allocator(true, onPM, filePath);
+    if (fast_alloc_pm_reopened()) {
+        fastalloc_pm_recovery &rec = fastalloc_pm.recovery;
+        cout << "Reopened PM pool: " << rec.live_blocks << " live blocks (" << (rec.live_bytes >> 20) << " MB), "
+             << rec.replayed << " log records replayed, " << (rec.reclaimed_bytes >> 20) << " MB reclaimed" << endl;
+    }
 
     // prepare data set
-    keys_init();
+    if (!keys_init()) {
+        fast_free();
+        return 1;
+    }
 
-    // init data structure
-    data_structure_init();
+    if (recordLatency) {
+        out5.open("../Result/latency.csv", ios::out);
+        out5 << "index,test,keys,threads,op,count,";
+        latency_csv_header(out5);
+        out5 << endl;
+    }
+    if (recordPerf) {
+        mainCounters = new PerfCounters;
+        if (!mainCounters->available()) {
+            cout << "perf_event_open failed, see /proc/sys/kernel/perf_event_paranoid; counting flushes only" << endl;
+        }
+        out8.open("../Result/perf.csv", ios::out);
+        out8 << "index,test,keys,threads,op,ops,";
+        perf_csv_header(out8);
+        out8 << endl;
+    }
 
     // evaluate
-    speed_test();
+    if (harnessReps > 0) {
+        harness_test();
+    } else {
+        speed_test();
+    }
+    scan_test();
+    footprint_test();
+    thread_test();
+    ycsb_test();
+    pool_tree_test();
+    alloc_report();
 
     // free allocated DRAM/PM
     fast_free();
@@ -24,6 +24,7 @@ inline void clflush(char *data, size_t len) {
     for (; ptr < data + len; ptr += CACHELINESIZE) {
         asm volatile("clflush %0" : "+m" (*(volatile char *) ptr));
     }
+    pm_emulate_flush(pm_flush_line_num(data, len));
     mfence();
 }
 
@@ -55,7 +56,7 @@ ROART::ROART() {
 #else
 
     // first open
-    root = new(concurrency_fast_alloc(sizeof(N256))) N256(0, {});
+    root = new(concurrency_fast_alloc(sizeof(N256), true, roart_tag_n256)) N256(0, {});
     roart_memory_usage += sizeof(N256);
     clflush((char *) root, sizeof(N256));
     //        N::clflush((char *)root, sizeof(N256), true, true);
@@ -666,6 +667,13 @@ restart:
     while (true) {
         if (!(node = nextNode) || toContinue)
             break;
+        if (N::isLeaf(node)) {
+            // start and end share the path down to a single leaf
+            if (!N::leaf_key_lt(N::getLeaf(node), start, level) && N::leaf_key_lt(N::getLeaf(node), end, level)) {
+                copy(node);
+            }
+            break;
+        }
         PCEqualsResults prefixResult;
         prefixResult = checkPrefixEquals(node, level, start, end);
         switch (prefixResult) {
@@ -749,13 +757,29 @@ vector<ROART_KEY> ROART::scan(uint64_t min, uint64_t max, uint64_t size) {
     vector<ROART_KEY> res;
     ROART_KEY *start, *end, *continue_key;
     size_t res_cnt = 0;
-    size_t res_len = size ? size : max - min;
+    // max - min leaves would not fit in memory for a wide range: start small and grow until the range fits
+    size_t res_len = size ? size : 1024;
     start = new ROART_KEY(min, sizeof(uint64_t), 0);
     end = new ROART_KEY(max, sizeof(uint64_t), 0);
     continue_key = NULL;
     ROART_Leaf **result = new ROART_Leaf *[res_len];
-    lookupRange(start, end, continue_key, result, res_len, res_cnt);
-//    cout << res_cnt << endl;
+    while (lookupRange(start, end, continue_key, result, res_len, res_cnt) && !size) {
+        delete[] result;
+        res_len *= 2;
+        result = new ROART_Leaf *[res_len];
+    }
+    res.reserve(res_cnt);
+    for (size_t i = 0; i < res_cnt; ++i) {
+        uint8_t *fkey = (uint8_t *) result[i]->GetKey();
+        uint64_t key = 0;
+        for (int j = 0; j < 8; ++j) {
+            key = (key << 8) | fkey[j];
+        }
+        res.emplace_back(key, sizeof(uint64_t), *(uint64_t *) result[i]->GetValue());
+    }
+    delete[] result;
+    delete start;
+    delete end;
     return res;
 }
 
@@ -819,7 +843,7 @@ typename ROART::OperationResults ROART::put(uint64_t key, uint64_t value) {
 #ifdef ARTPMDK
                 N4 *newNode = new (allocate_size(sizeof(N4))) N4(nextLevel, prefi);
 #else
-                auto newNode = new(concurrency_fast_alloc(get_node_size(NTypes::N4)))
+                auto newNode = new(concurrency_fast_alloc(get_node_size(NTypes::N4), true, roart_tag_n4))
                         N4(nextLevel, prefi); // not persist
                 roart_memory_usage += get_node_size(NTypes::N4);
 #endif
@@ -830,7 +854,7 @@ typename ROART::OperationResults ROART::put(uint64_t key, uint64_t value) {
                 auto *newLeaf = allocLeaf(key, value, fkey);
 #ifdef LEAF_ARRAY
                 auto newLeafArray =
-                        new(concurrency_fast_alloc(get_node_size(NTypes::LeafArray))) LeafArray();
+                        new(concurrency_fast_alloc(get_node_size(NTypes::LeafArray), true, roart_tag_leaf_array)) LeafArray();
                 newLeafArray->insert(newLeaf, true);
                 newNode->insert(fkey[nextLevel], N::setLeafArray(newLeafArray),
                                 false);
@@ -902,7 +926,7 @@ typename ROART::OperationResults ROART::put(uint64_t key, uint64_t value) {
             gettimeofday(&start_time, NULL);
 #endif
             auto newLeafArray =
-                    new(concurrency_fast_alloc(get_node_size(NTypes::LeafArray))) LeafArray();
+                    new(concurrency_fast_alloc(get_node_size(NTypes::LeafArray), true, roart_tag_leaf_array)) LeafArray();
 #ifdef ROART_PROFILE_TIME
             gettimeofday(&end_time, NULL);
             _update += (end_time.tv_sec - start_time.tv_sec) * 1000000 + end_time.tv_usec - start_time.tv_usec;
@@ -1015,7 +1039,7 @@ typename ROART::OperationResults ROART::put(uint64_t key, uint64_t value) {
 #ifdef ROART_PROFILE_TIME
             gettimeofday(&start_time, NULL);
 #endif
-            auto n4 = new (concurrency_fast_alloc(get_node_size(NTypes::N4)))
+            auto n4 = new (concurrency_fast_alloc(get_node_size(NTypes::N4), true, roart_tag_n4))
                     N4(level + prefixLength, &fkey[level],
                        prefixLength); // not persist
 //            auto n4 = new (concurrency_fast_alloc(get_node_size(NTypes::N4)))
@@ -1197,14 +1221,14 @@ ROART_Leaf *ROART::allocLeaf(const ROART_KEY *k) const {
 #else
 
     ROART_Leaf *newLeaf =
-        new (alloc_new_node_from_size(sizeof(ROART_Leaf) + k->key_len + k->val_len))
+        new (alloc_new_node_from_size(sizeof(ROART_Leaf) + k->key_len + k->val_len, roart_tag_leaf))
             ROART_Leaf(k);
     flush_data((void *)newLeaf, sizeof(ROART_Leaf) + k->key_len + k->val_len);
 #endif
     return newLeaf;
 #else
     ROART_Leaf *newLeaf =
-            new(concurrency_fast_alloc(get_node_size(NTypes::ROART_Leaf))) ROART_Leaf(k); // not persist
+            new(concurrency_fast_alloc(get_node_size(NTypes::ROART_Leaf), true, roart_tag_leaf)) ROART_Leaf(k); // not persist
     roart_memory_usage += get_node_size(NTypes::ROART_Leaf);
     clflush((char *) newLeaf, sizeof(ROART_Leaf));
     return newLeaf;
@@ -1221,14 +1245,14 @@ ROART_Leaf *ROART::allocLeaf(uint64_t _key, uint64_t _value, uint8_t *_fkey) con
 #else
 
     ROART_Leaf *newLeaf =
-        new (alloc_new_node_from_size(sizeof(ROART_Leaf) + k->key_len + k->val_len))
+        new (alloc_new_node_from_size(sizeof(ROART_Leaf) + k->key_len + k->val_len, roart_tag_leaf))
             ROART_Leaf(k);
     flush_data((void *)newLeaf, sizeof(ROART_Leaf) + k->key_len + k->val_len);
 #endif
     return newLeaf;
 #else
     ROART_Leaf *newLeaf =
-            new(concurrency_fast_alloc(get_node_size(NTypes::ROART_Leaf))) ROART_Leaf(_key, _value, _fkey); // not persist
+            new(concurrency_fast_alloc(get_node_size(NTypes::ROART_Leaf), true, roart_tag_leaf)) ROART_Leaf(_key, _value, _fkey); // not persist
     roart_memory_usage += get_node_size(NTypes::ROART_Leaf);
     clflush((char *) newLeaf, sizeof(ROART_Leaf));
     return newLeaf;
@@ -1566,7 +1590,7 @@ void ROART::graphviz_debug() {
 }
 
 ROART *new_roart() {
-    ROART *_new_roart = new(concurrency_fast_alloc(sizeof(ROART))) ROART();
+    ROART *_new_roart = new(concurrency_fast_alloc(sizeof(ROART), true, roart_tag_tree)) ROART();
     roart_memory_usage += sizeof(ROART);
     return _new_roart;
 }
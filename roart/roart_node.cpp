@@ -22,6 +22,7 @@ inline void clflush(void *data, size_t len) {
     for (; ptr < (char *)data + len; ptr += CACHELINESIZE) {
         asm volatile("clflush %0" : "+m" (*(volatile char *) ptr));
     }
+    pm_emulate_flush(pm_flush_line_num(data, len));
     mfence();
 }
 
@@ -49,20 +50,38 @@ size_t get_node_size(NTypes type) {
     }
 }
 
+int roart_node_tag(NTypes type) {
+    switch (type) {
+        case NTypes::N4:
+            return roart_tag_n4;
+        case NTypes::N16:
+            return roart_tag_n16;
+        case NTypes::N48:
+            return roart_tag_n48;
+        case NTypes::N256:
+            return roart_tag_n256;
+        case NTypes::ROART_Leaf:
+            return roart_tag_leaf;
+        case NTypes::LeafArray:
+            return roart_tag_leaf_array;
+        default:
+            return FASTALLOC_TAG_UNTAGGED;
+    }
+}
+
 void *alloc_new_node_from_type(NTypes type) {
 
-    size_t node_size = size_align(get_node_size(type), 64);
-    void *addr = concurrency_fast_alloc(node_size);
+    // fastalloc rounds to cache lines itself and accounts the padding per tag
+    void *addr = concurrency_fast_alloc(get_node_size(type), true, roart_node_tag(type));
     roart_memory_usage += get_node_size(type);
 
     return addr;
 }
 
 
-void *alloc_new_node_from_size(size_t size) {
+void *alloc_new_node_from_size(size_t size, int tag) {
 
-    size_t node_size = size_align(size, 64);
-    void *addr = concurrency_fast_alloc(node_size);
+    void *addr = concurrency_fast_alloc(size, true, tag);
     roart_memory_usage += size;
 
     return addr;
@@ -78,8 +97,8 @@ ROART_Leaf::ROART_Leaf(uint64_t _key, uint64_t _value, uint8_t *_fkey) : BaseNod
     memcpy(kv + key_len, (void *)k->value, val_len);
 #else
     // allocate from NVM for variable key
-    fkey = new (alloc_new_node_from_size(key_len)) uint8_t[key_len];
-    value = new (alloc_new_node_from_size(val_len)) char[val_len];
+    fkey = new (alloc_new_node_from_size(key_len, roart_tag_key)) uint8_t[key_len];
+    value = new (alloc_new_node_from_size(val_len, roart_tag_value)) char[val_len];
     memcpy(fkey, _fkey, key_len);
     memcpy(value, (char *)&(_value), val_len);
     clflush((void *)fkey, key_len);
@@ -101,8 +120,8 @@ ROART_Leaf::ROART_Leaf(const ROART_KEY *k) : BaseNode(NTypes::ROART_Leaf) {
     memcpy(kv + key_len, (void *)k->value, val_len);
 #else
     // allocate from NVM for variable key
-    fkey = new (alloc_new_node_from_size(key_len)) uint8_t[key_len];
-    value = new (alloc_new_node_from_size(val_len)) char[val_len];
+    fkey = new (alloc_new_node_from_size(key_len, roart_tag_key)) uint8_t[key_len];
+    value = new (alloc_new_node_from_size(val_len, roart_tag_value)) char[val_len];
     memcpy(fkey, k->fkey, key_len);
     memcpy(value, (char *)&(k->value), val_len);
     clflush((void *)fkey, key_len);
@@ -124,7 +143,7 @@ ROART_Leaf::ROART_Leaf(uint8_t *key_, size_t key_len_, char *value_, size_t val_
     memcpy(kv + key_len, value_, val_len);
 #else
     fkey = key_; // no need to alloc a new key, key_ is persistent
-    value = new (alloc_new_node_from_size(val_len)) char[val_len];
+    value = new (alloc_new_node_from_size(val_len, roart_tag_value)) char[val_len];
     memcpy(value, (void *)value_, val_len);
     clflush((void *)value, val_len);
 #endif
@@ -53,9 +53,25 @@ size_t size_align(size_t s, int align);
 
 size_t get_node_size(NTypes type);
 
+// allocation tags
+inline const int roart_tag_tree = fast_alloc_tag("roart.tree");
+inline const int roart_tag_n4 = fast_alloc_tag("roart.n4");
+inline const int roart_tag_n16 = fast_alloc_tag("roart.n16");
+inline const int roart_tag_n48 = fast_alloc_tag("roart.n48");
+inline const int roart_tag_n256 = fast_alloc_tag("roart.n256");
+inline const int roart_tag_leaf = fast_alloc_tag("roart.leaf");
+inline const int roart_tag_leaf_array = fast_alloc_tag("roart.leaf_array");
+inline const int roart_tag_key = fast_alloc_tag("roart.key");
+inline const int roart_tag_value = fast_alloc_tag("roart.value");
+
+int roart_node_tag(NTypes type);
+
 void *alloc_new_node_from_type(NTypes type);
 
-void *alloc_new_node_from_size(size_t size);
+void *alloc_new_node_from_size(size_t size, int tag);
+
+// Nodes replaced by grow/compact/shrink are never freed. ROART::get follows children without
+// checking node versions, and there are no reader epochs to delay the reuse of a block.
 
 class LeafArray;
 
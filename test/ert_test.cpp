@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../extendible_radix_tree/ERT_int.h"
+#include "../rng/rng.h"
+#include "pm_pool.h"
+
+/*
+ * Checks of ERTInt behaviour the benchmarks do not exercise. Every failed check is printed and
+ * makes the program exit with 1.
+ *
+ * usage: ert_test
+ */
+
+using namespace std;
+
+rng r;
+int failures = 0;
+
+void check(bool ok, const string &what) {
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+// n distinct random keys in ascending order
+vector<uint64_t> sorted_keys(int n) {
+    vector<uint64_t> keys;
+    while ((int) keys.size() < n) {
+        while ((int) keys.size() < n) {
+            keys.push_back(rng_next(&r) | 1);
+        }
+        sort(keys.begin(), keys.end());
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    }
+    return keys;
+}
+
+// inserts still in the write buffer are seen by scans, by Freeze and by memory_profile
+void buffer_test() {
+    const int n = 100;
+    vector<uint64_t> keys = sorted_keys(n);
+    ERTInt *tree = NewExtendibleRadixTreeInt();
+    uint64_t empty = tree->memory_profile(NULL);
+    tree->EnableWriteBuffer();
+    for (uint64_t key : keys) {
+        tree->Insert(key, key);
+    }
+    int found = 0;
+    for (uint64_t key : keys) {
+        found += tree->Search(key) == key;
+    }
+    check(found == n, "buffer: Search found " + to_string(found) + " of " + to_string(n));
+
+    vector<ERTIntKeyValue> res;
+    tree->nodeScan(tree->root, keys.front(), keys.back(), res);
+    check(res.size() == (size_t) n, "buffer: nodeScan returned " + to_string(res.size()) + " of " + to_string(n));
+
+    for (uint64_t key : keys) {
+        tree->Insert(key + 1, key + 1);
+    }
+    ERTIntFrozen *frozen = tree->Freeze();
+    found = 0;
+    for (uint64_t key : keys) {
+        found += (frozen->Search(key) == key) + (frozen->Search(key + 1) == key + 1);
+    }
+    check(found == 2 * n, "buffer: frozen copy holds " + to_string(found) + " of " + to_string(2 * n));
+    res.clear();
+    frozen->nodeScan(frozen->root, keys.front(), keys.back() + 1, res);
+    check(res.size() == (size_t) 2 * n,
+          "buffer: frozen nodeScan returned " + to_string(res.size()) + " of " + to_string(2 * n));
+    uint64_t counted = frozen->scan(keys.front(), keys.back() + 1);
+    check(counted == (uint64_t) 2 * n, "buffer: frozen scan counted " + to_string(counted) + " of " + to_string(2 * n));
+
+    for (uint64_t key : keys) {
+        tree->Insert(key + 2, key + 2);
+    }
+    check(tree->memory_profile(NULL) > empty, "buffer: memory_profile ignores buffered inserts");
+    res.clear();
+    tree->nodeScan(NULL, keys.front(), keys.back() + 2, res);
+    check(res.size() == (size_t) 3 * n,
+          "buffer: nodeScan returned " + to_string(res.size()) + " of " + to_string(3 * n));
+}
+
+// Remove clears a slot to subkey 0 and value 0, which must not hide a live entry of subkey 0 in the
+// same bucket. Keys below 2^32 all take subkey 0 at the root, 256 << 32 takes subkey 256 in the
+// same bucket
+void remove_test() {
+    const uint64_t n = 1000, high = (uint64_t) 256 << 32;
+    ERTInt *tree = NewExtendibleRadixTreeInt();
+    tree->Insert(high, 1);
+    for (uint64_t key = 1; key <= n; ++key) {
+        tree->Insert(key, key);
+    }
+    check(tree->Remove(high), "remove: key not removed");
+    check(!tree->Remove(high), "remove: removed key removed twice");
+    check(tree->Search(high) == 0, "remove: key found after remove");
+    uint64_t found = 0;
+    for (uint64_t key = 1; key <= n; ++key) {
+        found += tree->Search(key) == key;
+    }
+    check(found == n, "remove: Search found " + to_string(found) + " of " + to_string(n) + " keys of subkey 0");
+    check(tree->Remove(n / 2), "remove: key below the cleared slot not removed");
+    vector<ERTIntKeyValue> res;
+    tree->nodeScan(NULL, 0, UINT64_MAX, res);
+    check(res.size() == n - 1, "remove: nodeScan returned " + to_string(res.size()) + " of " + to_string(n - 1));
+
+    // the same at the last level: 256 and 0 share a bucket of the node below the root
+    tree = NewExtendibleRadixTreeInt();
+    tree->Insert(256, 1);
+    tree->Insert(0, 2);
+    check(tree->Remove(256), "remove: last level key not removed");
+    check(tree->Search(0) == 2, "remove: key 0 lost after removing 256");
+    tree->Insert(0, 3);
+    check(tree->Search(0) == 3, "remove: key 0 not updated");
+    res.clear();
+    tree->nodeScan(NULL, 0, 1000, res);
+    check(res.size() == 1 && res[0].key == 0 && res[0].value == 3,
+          "remove: nodeScan returned " + to_string(res.size()) + " entries instead of key 0 once");
+}
+
+// blocks writers unlink wait on the retired list until Reclaim, and freeing them loses no key
+void retire_test() {
+    const int n = 100000;
+    vector<uint64_t> keys = sorted_keys(2 * n);
+    ERTInt *tree = NewExtendibleRadixTreeInt();
+    for (int i = 0; i < n; ++i) {
+        tree->Insert(keys[i], keys[i]);
+    }
+    check(tree->snapshots != NULL && !tree->snapshots->retired.empty(),
+          "retire: no directory or leaf was retired by " + to_string(n) + " inserts");
+    tree->Reclaim();
+    check(tree->snapshots->retired.empty(), "retire: Reclaim kept retired blocks without a snapshot");
+    // the freed blocks are reused by these inserts
+    for (int i = n; i < 2 * n; ++i) {
+        tree->Insert(keys[i], keys[i]);
+    }
+    int found = 0;
+    for (uint64_t key : keys) {
+        found += tree->Search(key) == key;
+    }
+    check(found == 2 * n, "retire: Search found " + to_string(found) + " of " + to_string(2 * n));
+}
+
+// a frozen copy answers like the tree it was made from and misses inserts made after Freeze
+void freeze_test() {
+    const int n = 10000, range = 1000;
+    vector<uint64_t> keys = sorted_keys(2 * n);
+    ERTInt *tree = NewExtendibleRadixTreeInt();
+    for (int i = 0; i < 2 * n; i += 2) {
+        tree->Insert(keys[i], keys[i]);
+    }
+    ERTIntFrozen *frozen = tree->Freeze();
+    for (int i = 1; i < 2 * n; i += 2) {
+        tree->Insert(keys[i], keys[i]);
+    }
+    int found = 0, absent = 0;
+    for (int i = 0; i < 2 * n; ++i) {
+        if (i % 2 == 0) {
+            found += frozen->Search(keys[i]) == keys[i];
+        } else {
+            absent += frozen->Search(keys[i]) == 0;
+        }
+    }
+    check(found == n, "freeze: Search found " + to_string(found) + " of " + to_string(n));
+    check(absent == n, "freeze: " + to_string(n - absent) + " keys inserted after Freeze found");
+    uint64_t counted = frozen->scan(keys[n], keys[n + range - 1]);
+    check(counted == (uint64_t) range / 2, "freeze: scan counted " + to_string(counted) + " of " + to_string(range / 2));
+    counted = tree->scan(keys[n], keys[n + range - 1]);
+    check(counted == (uint64_t) range, "freeze: tree scan counted " + to_string(counted) + " of " + to_string(range));
+}
+
+// a snapshot keeps the keys and values of the moment it was taken while the tree is updated,
+// removed from and inserted into, and releasing it frees the blocks the writers copied
+void snapshot_test() {
+    const int n = 10000;
+    vector<uint64_t> keys = sorted_keys(2 * n);
+    ERTInt *tree = NewExtendibleRadixTreeInt();
+    for (int i = 0; i < n; ++i) {
+        tree->Insert(keys[i], keys[i]);
+    }
+    ERTIntSnapshot *snapshot = tree->Snapshot();
+    for (int i = 0; i < n / 2; ++i) {
+        tree->Insert(keys[i], keys[i] + 1);
+    }
+    for (int i = n / 2; i < n; ++i) {
+        tree->Remove(keys[i]);
+    }
+    for (int i = n; i < 2 * n; ++i) {
+        tree->Insert(keys[i], keys[i]);
+    }
+    int old_found = 0, new_found = 0;
+    for (int i = 0; i < 2 * n; ++i) {
+        old_found += snapshot->Search(keys[i]) == (i < n ? keys[i] : 0);
+        uint64_t expected = i < n / 2 ? keys[i] + 1 : i < n ? 0 : keys[i];
+        new_found += tree->Search(keys[i]) == expected;
+    }
+    check(old_found == 2 * n, "snapshot: " + to_string(2 * n - old_found) + " keys changed in the snapshot");
+    check(new_found == 2 * n, "snapshot: " + to_string(2 * n - new_found) + " keys wrong in the tree");
+    uint64_t counted = snapshot->scan(0, UINT64_MAX);
+    check(counted == (uint64_t) n, "snapshot: scan counted " + to_string(counted) + " of " + to_string(n));
+    counted = tree->scan(0, UINT64_MAX);
+    check(counted == (uint64_t) n / 2 + n, "snapshot: tree scan counted " + to_string(counted) + " of " +
+                                           to_string(n / 2 + n));
+    check(!tree->snapshots->retired.empty(), "snapshot: writers copied nothing");
+    tree->ReleaseSnapshot(snapshot);
+    check(tree->snapshots->live.empty() && tree->snapshots->retired.empty(),
+          "snapshot: blocks still retired after the release");
+}
+
+// the hot-key cache never serves a value the tree no longer holds
+void cache_test() {
+    const int n = 1000;
+    vector<uint64_t> keys = sorted_keys(n);
+    ERTInt *tree = NewExtendibleRadixTreeInt();
+    tree->EnableCache(n);
+    for (uint64_t key : keys) {
+        tree->Insert(key, key);
+    }
+    int found = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (uint64_t key : keys) {
+            found += tree->Search(key) == key;
+        }
+    }
+    check(found == 2 * n, "cache: Search found " + to_string(found) + " of " + to_string(2 * n));
+    check(tree->cache->hits.load() > 0, "cache: no hits on the second pass");
+    for (int i = 0; i < n; ++i) {
+        if (i % 2 == 0) {
+            tree->Insert(keys[i], keys[i] + 1);
+        } else {
+            tree->Remove(keys[i]);
+        }
+    }
+    int stale = 0;
+    for (int i = 0; i < n; ++i) {
+        stale += tree->Search(keys[i]) != (i % 2 == 0 ? keys[i] + 1 : 0);
+    }
+    check(stale == 0, "cache: " + to_string(stale) + " stale values after updates and removes");
+}
+
+// hybrid mode: a collision below the root starts an ART node of 4 entries, which grows to 16 and
+// is promoted to an ERT node. Groups of keys sharing their top 32 bits reach each stage
+void art_test() {
+    const int sizes[] = {2, 5, 17, 40};
+    vector<uint64_t> keys;
+    for (int group = 0; group < 100; ++group) {
+        uint64_t high = (rng_next(&r) >> 31) << 32;
+        for (int i = 0; i < sizes[group % 4]; ++i) {
+            keys.push_back(high | (rng_next(&r) & 0xffffffff) | 1);
+        }
+    }
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    ERTInt *tree = NewExtendibleRadixTreeInt(), *plain = NewExtendibleRadixTreeInt();
+    tree->EnableHybrid();
+    for (uint64_t key : keys) {
+        tree->Insert(key, key);
+        plain->Insert(key, key);
+    }
+    int n = keys.size(), found = 0;
+    for (uint64_t key : keys) {
+        found += tree->Search(key) == key;
+    }
+    check(found == n, "art: Search found " + to_string(found) + " of " + to_string(n));
+    check(tree->memory_profile(NULL) < plain->memory_profile(NULL), "art: hybrid tree is not smaller");
+    int removed = 0;
+    for (int i = 0; i < n; i += 3) {
+        removed += tree->Remove(keys[i]);
+    }
+    check(removed == (n + 2) / 3, "art: removed " + to_string(removed) + " of " + to_string((n + 2) / 3));
+    found = 0;
+    for (int i = 0; i < n; ++i) {
+        found += tree->Search(keys[i]) == (i % 3 == 0 ? 0 : keys[i]);
+    }
+    check(found == n, "art: " + to_string(n - found) + " keys wrong after removes");
+    uint64_t counted = tree->scan(0, UINT64_MAX);
+    check(counted == (uint64_t) n - removed, "art: scan counted " + to_string(counted) + " of " +
+                                             to_string(n - removed));
+}
+
+// a key that ends inside the prefix of a node lives in treeNodeValues. Nodes come zeroed from the
+// allocator and inserts never give them such a prefix, so the node at byte 4 gets one here
+void prefix_remove_test() {
+    ERTInt *tree = NewExtendibleRadixTreeInt();
+    int pos = ERT_KEY_LENGTH / SIZE_OF_CHAR - ERT_NODE_LENGTH / SIZE_OF_CHAR;
+    uint64_t key = rng_next(&r) | 1, other = key ^ 0x80;
+    ERTIntNode *node = NewERTIntNode(ERT_NODE_LENGTH, 1);
+    node->header.len = ERT_KEY_LENGTH / SIZE_OF_CHAR - pos;
+    node->header.assign(key, pos * SIZE_OF_CHAR);
+    tree->nodeInsert(key, key, node, pos, (uint64_t) &node);
+    check(tree->nodeSearch(key, node, pos) == key, "prefix remove: key not found after insert");
+    // the frozen copy takes the values the node has, not one per prefix byte
+    ERTIntFrozen *frozen = NewERTIntFrozen(node);
+    vector<ERTIntKeyValue> res;
+    frozen->nodeScan(frozen->root, 0, UINT64_MAX, res, pos);
+    check(res.size() == 1 && res[0].key == key && res[0].value == key,
+          "prefix remove: frozen copy holds " + to_string(res.size()) + " entries instead of the key once");
+    check(!tree->nodeRemove(other, node, pos), "prefix remove: removed a key that differs in the prefix");
+    check(tree->nodeSearch(key, node, pos) == key, "prefix remove: a failed remove cleared the key");
+    check(tree->nodeRemove(key, node, pos), "prefix remove: key not removed");
+    check(tree->nodeSearch(key, node, pos) == 0, "prefix remove: key found after remove");
+    res.clear();
+    tree->nodeValuesScan(node, 0, UINT64_MAX, res);
+    check(res.empty(), "prefix remove: scan returned the removed key");
+}
+
+// the tree OpenExtendibleRadixTreeInt publishes in a pm pool is found again with its keys when
+// the pool is reopened
+void pm_open_test() {
+    const int n = 1000;
+    vector<uint64_t> keys = sorted_keys(n);
+    string path = pool_path();
+    init_fast_allocator(true, true, path);
+    ERTInt *tree = OpenExtendibleRadixTreeInt();
+    for (uint64_t key : keys) {
+        tree->Insert(key, key);
+    }
+    check(OpenExtendibleRadixTreeInt() == tree, "pm open: a second open made a new tree");
+    fast_free();
+
+    set_fast_alloc_pm_reopen(true);
+    init_fast_allocator(true, true, path);
+    tree = OpenExtendibleRadixTreeInt();
+    int found = 0;
+    for (uint64_t key : keys) {
+        found += tree->Search(key) == key;
+    }
+    check(found == n, "pm open: reopened tree holds " + to_string(found) + " of " + to_string(n));
+    fast_free();
+    set_fast_alloc_pm_reopen(false);
+    remove_pool(path);
+}
+
+// inserts still in the write buffer when the process dies are pending again in the reopened tree
+void pm_buffer_test() {
+    const int n = 100;
+    vector<uint64_t> keys = sorted_keys(n);
+    string path = pool_path();
+    init_fast_allocator(true, true, path);
+    ERTInt *tree = OpenExtendibleRadixTreeInt();
+    tree->EnableWriteBuffer();
+    for (uint64_t key : keys) {
+        tree->Insert(key, key);
+    }
+    check(tree->buffer->merged_keys == 0, "pm buffer: inserts merged before the crash");
+    // the DRAM maps of the buffer are lost, only the pm logs remain
+    fast_free();
+
+    set_fast_alloc_pm_reopen(true);
+    init_fast_allocator(true, true, path);
+    tree = OpenExtendibleRadixTreeInt();
+    check(tree->buffer != NULL, "pm buffer: reopened tree has no write buffer");
+    int found = 0;
+    for (uint64_t key : keys) {
+        found += tree->Search(key) == key;
+    }
+    check(found == n, "pm buffer: Search found " + to_string(found) + " of " + to_string(n));
+    uint64_t counted = tree->scan(0, UINT64_MAX);
+    check(counted == (uint64_t) n, "pm buffer: scan counted " + to_string(counted) + " of " + to_string(n));
+    fast_free();
+    set_fast_alloc_pm_reopen(false);
+    remove_pool(path);
+}
+
+int main() {
+    init_fast_allocator(true, false, "");
+    rng_init(&r, 1, 2);
+    buffer_test();
+    remove_test();
+    retire_test();
+    freeze_test();
+    snapshot_test();
+    cache_test();
+    art_test();
+    prefix_remove_test();
+    fast_free();
+    pm_open_test();
+    pm_buffer_test();
+    if (failures != 0) {
+        cout << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "all checks passed" << endl;
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "../fastalloc/fastalloc.h"
+#include "pm_pool.h"
+
+/*
+ * Checks of fastalloc behaviour the benchmarks do not exercise. Every failed check is printed and
+ * makes the program exit with 1.
+ *
+ * usage: fastalloc_test
+ */
+
+using namespace std;
+
+int failures = 0;
+
+void check(bool ok, const string &what) {
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+// a publish or release that got as far as its log record, as if the process died right after
+void crash_logged(int slot, uint64_t op, void *ptr, uint64_t size, uint64_t *link, uint64_t value) {
+    fastalloc_pm_log &log = fastalloc_pm.header->logs[slot];
+    log.block = fastalloc_pm.offset(ptr);
+    log.size = size;
+    log.link = fastalloc_pm.offset(link);
+    log.value = value;
+    log.op = op;
+    log.checksum = log.sum();
+}
+
+// fast_free deletes the arenas of every thread, a thread that allocated before must get a new
+// one afterwards without touching the deleted arena
+void arena_generation_test() {
+    init_fast_allocator(true, false, "");
+    atomic<int> step{0};
+    thread worker([&step]() {
+        concurrency_fast_alloc(64, false);
+        step.store(1);
+        while (step.load() != 2) {
+            this_thread::yield();
+        }
+        concurrency_fast_alloc(128, false);
+        step.store(3);
+    });
+    while (step.load() != 1) {
+        this_thread::yield();
+    }
+    fast_free();
+    init_fast_allocator(true, false, "");
+    step.store(2);
+    worker.join();
+    uint64_t requested = 0;
+    for (fastalloc_stats &stats : fast_alloc_arena_stats()) {
+        requested += stats.requested_bytes;
+    }
+    check(requested == 128, "arena generation: arenas after fast_free hold " + to_string(requested) +
+                            " requested bytes instead of 128");
+    fast_free();
+}
+
+// reopening replays the log records of a publish and a release cut short, and frees the block
+// that was reserved but never published. Blocks are carved back to back from one chunk:
+// root | a 256 B | b 128 B | c | d
+void pm_crash_test() {
+    string path = pool_path();
+    init_fast_allocator(true, true, path);
+    uint64_t *root = (uint64_t *) fast_alloc_pm_root(3 * sizeof(uint64_t));
+    char *a = (char *) fast_alloc_pm_reserve(256);
+    fast_alloc_pm_publish(a, 256, &root[0], fast_alloc_pm_offset(a));
+    char *b = (char *) fast_alloc_pm_reserve(128);
+    char *c = (char *) fast_alloc_pm_reserve(64);
+    char *d = (char *) fast_alloc_pm_reserve(64);
+    fast_alloc_pm_publish(d, 64, &root[2], fast_alloc_pm_offset(d));
+    check(a + 256 == b && b + 128 == c && c + 64 == d, "pm crash: blocks are not contiguous");
+    crash_logged(FASTALLOC_PM_LOG_NUM - 1, FASTALLOC_PM_LOG_PUBLISH, c, 64, &root[1], fast_alloc_pm_offset(c));
+    crash_logged(FASTALLOC_PM_LOG_NUM - 2, FASTALLOC_PM_LOG_RELEASE, a, 256, &root[0], 0);
+    uint64_t c_offset = fast_alloc_pm_offset(c), d_offset = fast_alloc_pm_offset(d);
+    // nothing is cleaned up on the pool, so this drops the process state like a crash
+    fast_free();
+
+    set_fast_alloc_pm_reopen(true);
+    init_fast_allocator(true, true, path);
+    fastalloc_pm_recovery &rec = fastalloc_pm.recovery;
+    check(fast_alloc_pm_reopened(), "pm crash: pool not reopened");
+    check(rec.replayed == 2, "pm crash: " + to_string(rec.replayed) + " log records replayed instead of 2");
+    check(rec.live_blocks == 3, "pm crash: " + to_string(rec.live_blocks) + " live blocks instead of root, c and d");
+    check(rec.reclaimed_bytes == 384, "pm crash: " + to_string(rec.reclaimed_bytes) +
+                                      " bytes reclaimed instead of a and b, 384");
+    root = (uint64_t *) fast_alloc_pm_root(3 * sizeof(uint64_t));
+    check(root[0] == 0 && root[1] == c_offset && root[2] == d_offset, "pm crash: links not redone");
+    fast_free();
+    set_fast_alloc_pm_reopen(false);
+    remove_pool(path);
+}
+
+// the root and the blocks persistent_ptrs in it point to survive a reopen, and a pool opened
+// without reopen starts empty
+void pm_root_test() {
+    string path = pool_path();
+    init_fast_allocator(true, true, path);
+    persistent_ptr<uint64_t> *root = (persistent_ptr<uint64_t> *) fast_alloc_pm_root(sizeof(persistent_ptr<uint64_t>));
+    check(!*root, "pm root: root of a new pool is not zeroed");
+    uint64_t *value = (uint64_t *) concurrency_fast_alloc(sizeof(uint64_t), true);
+    *value = 42;
+    *root = persistent_ptr<uint64_t>(value);
+    check(root->raw != (uint64_t) value && root->get() == value, "pm root: persistent_ptr holds a raw address");
+    fast_free();
+
+    set_fast_alloc_pm_reopen(true);
+    init_fast_allocator(true, true, path);
+    root = (persistent_ptr<uint64_t> *) fast_alloc_pm_root(sizeof(persistent_ptr<uint64_t>));
+    check(fast_alloc_pm_reopened() && *root && **root == 42, "pm root: reopen lost the root");
+    fast_free();
+
+    set_fast_alloc_pm_reopen(false);
+    init_fast_allocator(true, true, path);
+    check(!fast_alloc_pm_reopened() && fastalloc_pm.header->root_offset == 0, "pm root: pool kept without reopen");
+    check(access((path + "0").c_str(), F_OK) != 0, "pm root: chunk file of the old pool kept");
+    fast_free();
+    remove_pool(path);
+}
+
+int main() {
+    arena_generation_test();
+    pm_crash_test();
+    pm_root_test();
+    if (failures != 0) {
+        cout << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "all checks passed" << endl;
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef NVMKV_TEST_PM_POOL_H
+#define NVMKV_TEST_PM_POOL_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// prefix of a pm pool in a new directory under /tmp
+inline std::string pool_path() {
+    char dir[] = "/tmp/nvmkv_test_XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    return std::string(dir) + "/pool_";
+}
+
+// remove the header and chunk files of the pool at path and its directory
+inline void remove_pool(const std::string &path) {
+    remove((path + "pool").c_str());
+    for (int i = 0; remove((path + std::to_string(i)).c_str()) == 0; i++) {
+    }
+    remove(path.substr(0, path.rfind('/')).c_str());
+}
+
+#endif //NVMKV_TEST_PM_POOL_H
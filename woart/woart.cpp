@@ -32,11 +32,13 @@ void flush_buffer(void *buf, unsigned long len, bool fence) {
         for (i = 0; i < len; i += CACHE_LINE_SIZE) {
             asm volatile ("clflush %0\n" : "+m" (*((char *) buf + i)));
         }
+        pm_emulate_flush((len + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE);
         mfence();
     } else {
         for (i = 0; i < len; i += CACHE_LINE_SIZE) {
             asm volatile ("clflush %0\n" : "+m" (*((char *) buf + i)));
         }
+        pm_emulate_flush((len + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE);
     }
 }
 
@@ -139,7 +141,7 @@ static woart_node *alloc_node(uint8_t type) {
     int i;
     switch (type) {
         case NODE4:
-            ret = concurrency_fast_alloc(sizeof(woart_node4));
+            ret = concurrency_fast_alloc(sizeof(woart_node4), true, woart_tag_node4);
             woart_memory_usage += sizeof(woart_node4) - sizeof(woart_leaf);
 //            posix_memalign(&ret, 64, sizeof(woart_node4));
             n = static_cast<woart_node *>(ret);
@@ -147,21 +149,21 @@ static woart_node *alloc_node(uint8_t type) {
                 ((woart_node4 *) n)->slot[i].i_ptr = -1;
             break;
         case NODE16:
-            ret = concurrency_fast_alloc(sizeof(woart_node16));
+            ret = concurrency_fast_alloc(sizeof(woart_node16), true, woart_tag_node16);
             woart_memory_usage += sizeof(woart_node16) - sizeof(woart_node4);
 //            posix_memalign(&ret, 64, sizeof(woart_node16));
             n = static_cast<woart_node *>(ret);
             ((woart_node16 *) n)->bitmap = 0;
             break;
         case NODE48:
-            ret = concurrency_fast_alloc(sizeof(woart_node48));
+            ret = concurrency_fast_alloc(sizeof(woart_node48), true, woart_tag_node48);
             woart_memory_usage += sizeof(woart_node48) - sizeof(woart_node16);
 //            posix_memalign(&ret, 64, sizeof(woart_node48));
             n = static_cast<woart_node *>(ret);
             memset(n, 0, sizeof(woart_node48));
             break;
         case NODE256:
-            ret = concurrency_fast_alloc(sizeof(woart_node256));
+            ret = concurrency_fast_alloc(sizeof(woart_node256), true, woart_tag_node256);
             woart_memory_usage += sizeof(woart_node256) - sizeof(woart_node48);
 //            posix_memalign(&ret, 64, sizeof(woart_node256));
             n = static_cast<woart_node *>(ret);
@@ -185,7 +187,7 @@ int woart_tree_init(woart_tree *t) {
 }
 
 woart_tree *new_woart_tree() {
-    woart_tree *_new_woart_tree = static_cast<woart_tree *>(concurrency_fast_alloc(sizeof(woart_tree)));
+    woart_tree *_new_woart_tree = static_cast<woart_tree *>(concurrency_fast_alloc(sizeof(woart_tree), true, woart_tag_tree));
     woart_memory_usage += sizeof(woart_tree);
     woart_tree_init(_new_woart_tree);
     return _new_woart_tree;
@@ -351,7 +353,7 @@ static woart_leaf *make_leaf(const unsigned long key, int key_len, void *value,
     //woart_leaf *l = (woart_leaf*)malloc(sizeof(woart_leaf));
     woart_leaf *l;
     void *ret;
-    ret = concurrency_fast_alloc(sizeof(woart_leaf));
+    ret = concurrency_fast_alloc(sizeof(woart_leaf), true, woart_tag_leaf);
     woart_memory_usage += sizeof(woart_leaf);
 //    posix_memalign(&ret, 64, sizeof(woart_leaf));
     l = static_cast<woart_leaf *>(ret);
@@ -426,7 +428,7 @@ static void add_child48(woart_node48 *n, woart_node **ref, unsigned char c, void
         *ref = (woart_node *) new_node;
         flush_buffer(ref, 8, true);
 
-//        free(n);
+        concurrency_fast_dealloc(n, sizeof(woart_node48), true, woart_tag_node48);
     }
 }
 
@@ -467,7 +469,7 @@ static void add_child16(woart_node16 *n, woart_node **ref, unsigned char c, void
         *ref = (woart_node *) new_node;
         flush_buffer(ref, sizeof(uintptr_t), true);
 
-//        free(n);
+        concurrency_fast_dealloc(n, sizeof(woart_node16), true, woart_tag_node16);
     }
 }
 
@@ -533,7 +535,7 @@ static void add_child4(woart_node4 *n, woart_node **ref, unsigned char c, void *
         *ref = (woart_node *) new_node;
         flush_buffer(ref, 8, true);
 
-//        free(n);
+        concurrency_fast_dealloc(n, sizeof(woart_node4), true, woart_tag_node4);
     }
 }
 
@@ -757,7 +759,7 @@ static void *recursive_insert(woart_node *n, woart_node **ref, const unsigned lo
  */
 void *woart_put(woart_tree *t, const unsigned long key, int key_len, void *value, int value_len) {
     int old_val = 0;
-    void *value_allocated = concurrency_fast_alloc(value_len);
+    void *value_allocated = concurrency_fast_alloc(value_len, true, woart_tag_value);
     woart_memory_usage += value_len;
     memcpy(value_allocated, value, value_len);
     flush_buffer(value_allocated, value_len, true);
@@ -807,19 +809,20 @@ void woart_node_scan(woart_node *n, uint64_t left, uint64_t right, uint64_t dept
         }
     } else {
         if (tmp->path.pwoartial_len) {
-            int max_cmp = min(min(tmp->path.pwoartial_len, WOART_MAX_PREFIX_LEN), WOART_MAX_HEIGHT - depth);
+            // the prefix beyond WOART_MAX_PREFIX_LEN is only in the leaves
+            woart_leaf *l = tmp->path.pwoartial_len > WOART_MAX_PREFIX_LEN ? minimum(tmp) : NULL;
+            int max_cmp = min((int) tmp->path.pwoartial_len, (int) (WOART_MAX_HEIGHT - depth));
             for (int idx = 0; idx < max_cmp; idx++) {
-                if (tmp->path.pwoartial[idx] > get_index(left, depth + idx)) {
-                    break;
-                } else if (tmp->path.pwoartial[idx] < get_index(left, depth + idx)) {
+                int c = l ? get_index(l->key, depth + idx) : tmp->path.pwoartial[idx];
+                // a subtree above left or below right drops that bound for the levels below
+                if (c < get_index(left, depth + idx) || c > get_index(right, depth + idx)) {
                     return;
                 }
-            }
-            for (int idx = 0; idx < max_cmp; idx++) {
-                if (tmp->path.pwoartial[idx] < get_index(right, depth + idx)) {
-                    break;
-                } else if (tmp->path.pwoartial[idx] > get_index(left, depth + idx)) {
-                    return;
+                if (c > get_index(left, depth + idx)) {
+                    left = 0;
+                }
+                if (c < get_index(right, depth + idx)) {
+                    right = 0xffffffffffffffff;
                 }
             }
             depth = depth + tmp->path.pwoartial_len;
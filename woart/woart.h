@@ -11,6 +11,15 @@
 #include <vector>
 #include "../fastalloc/fastalloc.h"
 
+// allocation tags
+inline const int woart_tag_tree = fast_alloc_tag("woart.tree");
+inline const int woart_tag_node4 = fast_alloc_tag("woart.node4");
+inline const int woart_tag_node16 = fast_alloc_tag("woart.node16");
+inline const int woart_tag_node48 = fast_alloc_tag("woart.node48");
+inline const int woart_tag_node256 = fast_alloc_tag("woart.node256");
+inline const int woart_tag_leaf = fast_alloc_tag("woart.leaf");
+inline const int woart_tag_value = fast_alloc_tag("woart.value");
+
 #ifdef __linux__
 #include <byteswap.h>
 #endif
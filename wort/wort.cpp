@@ -31,11 +31,13 @@ static void flush_buffer(void *buf, unsigned long len, bool fence) {
         for (i = 0; i < len; i += CACHE_LINE_SIZE) {
             asm volatile ("clflush %0\n" : "+m" (*((char *) buf + i)));
         }
+        pm_emulate_flush((len + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE);
         mfence();
     } else {
         for (i = 0; i < len; i += CACHE_LINE_SIZE) {
             asm volatile ("clflush %0\n" : "+m" (*((char *) buf + i)));
         }
+        pm_emulate_flush((len + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE);
     }
 }
 
@@ -53,7 +55,7 @@ static int get_index(unsigned long key, int depth) {
 static wort_node *alloc_node() {
     wort_node *n;
     void *ret;
-    ret = concurrency_fast_alloc(sizeof(wort_node16));
+    ret = concurrency_fast_alloc(sizeof(wort_node16), true, wort_tag_node);
     wort_memory_usage += sizeof(wort_node16);
 //    posix_memalign(&ret, 64, sizeof(wort_node16));
     n = static_cast<wort_node *>(ret);
@@ -72,7 +74,7 @@ int wort_tree_init(wort_tree *t) {
 }
 
 wort_tree *new_wort_tree() {
-    wort_tree *_new_wort_tree = static_cast<wort_tree *>(concurrency_fast_alloc(sizeof(wort_tree)));
+    wort_tree *_new_wort_tree = static_cast<wort_tree *>(concurrency_fast_alloc(sizeof(wort_tree), true, wort_tag_tree));
     wort_memory_usage += sizeof(wort_tree);
     wort_tree_init(_new_wort_tree);
     return _new_wort_tree;
@@ -214,7 +216,7 @@ static wort_leaf *make_leaf(const unsigned long key, int key_len, void *value, b
     //wort_leaf *l = (wort_leaf*)malloc(sizeof(wort_leaf));
     wort_leaf *l;
     void *ret;
-    ret = concurrency_fast_alloc(sizeof(wort_leaf));
+    ret = concurrency_fast_alloc(sizeof(wort_leaf), true, wort_tag_leaf);
     wort_memory_usage += sizeof(wort_leaf);
 //    posix_memalign(&ret, 64, sizeof(wort_leaf));
     l = static_cast<wort_leaf *>(ret);
@@ -414,7 +416,7 @@ static void *recursive_insert(wort_node *n, wort_node **ref, const unsigned long
  */
 void *wort_put(wort_tree *t, const unsigned long key, int key_len, void *value, int value_len) {
     int old_val = 0;
-    void *value_allocated = concurrency_fast_alloc(value_len);
+    void *value_allocated = concurrency_fast_alloc(value_len, true, wort_tag_value);
     wort_memory_usage += value_len;
     memcpy(value_allocated, value, value_len);
     flush_buffer(value_allocated, value_len, true);
@@ -463,19 +465,20 @@ wort_node_scan(wort_node *n, uint64_t left, uint64_t right, uint64_t depth, vect
         }
     } else {
         if (tmp->pwortial_len) {
-            int max_cmp = min(min(tmp->pwortial_len, WORT_MAX_PREFIX_LEN), WORT_MAX_HEIGHT - depth);
+            // the prefix beyond WORT_MAX_PREFIX_LEN is only in the leaves
+            wort_leaf *l = tmp->pwortial_len > WORT_MAX_PREFIX_LEN ? minimum(tmp) : NULL;
+            int max_cmp = min((int) tmp->pwortial_len, (int) (WORT_MAX_HEIGHT - depth));
             for (int idx = 0; idx < max_cmp; idx++) {
-                if (tmp->pwortial[idx] > get_index(left, depth + idx)) {
-                    break;
-                } else if (tmp->pwortial[idx] < get_index(left, depth + idx)) {
+                int c = l ? get_index(l->key, depth + idx) : tmp->pwortial[idx];
+                // a subtree above left or below right drops that bound for the levels below
+                if (c < get_index(left, depth + idx) || c > get_index(right, depth + idx)) {
                     return;
                 }
-            }
-            for (int idx = 0; idx < max_cmp; idx++) {
-                if (tmp->pwortial[idx] < get_index(right, depth + idx)) {
-                    break;
-                } else if (tmp->pwortial[idx] > get_index(left, depth + idx)) {
-                    return;
+                if (c > get_index(left, depth + idx)) {
+                    left = 0;
+                }
+                if (c < get_index(right, depth + idx)) {
+                    right = 0xffffffffffffffff;
                 }
             }
             depth = depth + tmp->pwortial_len;
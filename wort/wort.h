@@ -10,6 +10,12 @@
 #include <vector>
 #include "../fastalloc/fastalloc.h"
 
+// allocation tags
+inline const int wort_tag_tree = fast_alloc_tag("wort.tree");
+inline const int wort_tag_node = fast_alloc_tag("wort.node");
+inline const int wort_tag_leaf = fast_alloc_tag("wort.leaf");
+inline const int wort_tag_value = fast_alloc_tag("wort.value");
+
 /* If you want to change the number of entries,
  * change the values of WORT_NODE_BITS & WORT_MAX_DEPTH */
 #define WORT_NODE_BITS            4